@@ -0,0 +1,571 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#include "contigs.h"
+
+/*******************************************************************************
+  Sequences are read ahead into a batch, up to 'limit' of them or
+  BATCH_BASES in all, and the threads then find the genes in them, each in
+  its own workspace, taking the longest sequences first so that a few big
+  ones left to the end don't hold up the rest.  Each sequence's output is
+  kept in memory until the batch is done, and written in input order, so
+  it comes out the same as with one thread.  With one thread, or with an
+  update state file (which has to see the sequences in order), a batch is
+  a single sequence.  'out' holds the gene, start, translation and
+  nucleotide files, NULL for those not asked for.
+*******************************************************************************/
+void init_batch(struct _batch *b, struct _finder *fd, FILE **out, int quiet) {
+  int i;
+
+  b->fd = fd; b->quiet = quiet;
+  for(i = 0; i < NUM_OUT; i++) b->out[i] = out[i];
+  b->nws = num_threads();
+  b->limit = (b->nws == 1 || fd->upd != NULL) ? 1 : BATCH_CONTIGS;
+  b->n = 0; b->bases = 0; b->next = 0;
+  b->cap = b->limit;
+  b->ctg = (struct _contig *)malloc(b->cap*sizeof(struct _contig));
+  b->order = (struct _contig **)malloc(b->cap*sizeof(struct _contig *));
+  b->ws = (struct _workspace *)malloc(b->nws*sizeof(struct _workspace));
+  if(b->ctg == NULL || b->order == NULL || b->ws == NULL) {
+    fprintf(stderr, "Malloc failed on sequence batch\n\n");
+    exit(11);
+  }
+  for(i = 0; i < b->nws; i++) init_workspace(&b->ws[i], fd->nmt);
+}
+
+void free_batch(struct _batch *b) {
+  int i;
+
+  for(i = 0; i < b->nws; i++) free_workspace(&b->ws[i]);
+  free(b->ws);
+  free(b->order);
+  free(b->ctg);
+}
+
+/*******************************************************************************
+  Copy a sequence just read into the batch.  Returns 1 if the batch is now
+  full and should be run.  A sequence of BATCH_BASES or more is left to a
+  batch of its own, so that all the threads work on it.
+*******************************************************************************/
+int add_contig(struct _batch *b, unsigned char *seq, unsigned char *useq, int
+               slen, double gc, mask *mlist, int nmask, int num, char
+               *header) {
+  int i;
+  struct _contig *c;
+
+  if(slen >= BATCH_BASES) run_batch(b);
+  c = &b->ctg[b->n];
+
+  c->num = num; c->slen = slen; c->gc = gc; c->nmask = nmask;
+  c->seq = (unsigned char *)calloc(slen/4+SEQ_PAD, sizeof(unsigned char));
+  c->useq = (unsigned char *)calloc(slen/8+SEQ_PAD, sizeof(unsigned char));
+  c->mlist = (mask *)malloc((nmask+1)*sizeof(mask));
+  if(c->seq == NULL || c->useq == NULL || c->mlist == NULL) {
+    fprintf(stderr, "Malloc failed on sequence batch\n\n");
+    exit(11);
+  }
+  memcpy(c->seq, seq, (slen/4+1)*sizeof(unsigned char));
+  memcpy(c->useq, useq, (slen/8+1)*sizeof(unsigned char));
+  memcpy(c->mlist, mlist, nmask*sizeof(mask));
+  strcpy(c->header, header);
+  calc_short_header(c->header, c->short_header, num);
+  for(i = 0; i < NUM_OUT; i++) { c->text[i] = NULL; c->tlen[i] = 0; }
+  b->n++;
+  b->bases += slen;
+  return (b->n == b->limit || b->bases >= BATCH_BASES);
+}
+
+/*******************************************************************************
+  Find the genes in every sequence of the batch and write them out.  The
+  metagenomic bins the sequences will try are built first, as the threads
+  only read them.  A batch of one sequence is run in this thread, so that
+  the scoring can still use the others.
+*******************************************************************************/
+void run_batch(struct _batch *b) {
+  int i, j;
+  unsigned char use[NUM_META];
+  struct _contig *c;
+
+  if(b->n == 0) return;
+  if(b->fd->is_meta == 1) {
+    for(i = 0; i < b->n; i++) {
+      gc_bins(b->fd->meta, b->ctg[i].gc, use);
+      for(j = 0; j < NUM_META; j++)
+        if(use[j] == 1) load_meta_bin(b->fd->meta, j);
+    }
+  }
+
+  if(b->n == 1) {
+    c = &b->ctg[0];
+    b->ws[0].spread = 1;
+    if(b->quiet == 0)
+      fprintf(stderr, "Finding genes in sequence #%d (%d bp)...", c->num,
+              c->slen);
+    find_contig_genes(b->fd, &b->ws[0], c, b->out);
+    if(b->quiet == 0) fprintf(stderr, "done!\n");
+    fflush(b->out[OUT_GENES]);
+  }
+  else {
+    for(i = 0; i < b->n; i++) b->order[i] = &b->ctg[i];
+    qsort(b->order, b->n, sizeof(struct _contig *), &compare_contig_len);
+    b->next = 0;
+    parallel_tasks(b->nws, contig_range, b);
+    for(i = 0; i < b->n; i++) write_contig(b, &b->ctg[i]);
+  }
+
+  for(i = 0; i < b->n; i++) {
+    c = &b->ctg[i];
+    free(c->seq); free(c->useq); free(c->mlist);
+  }
+  b->n = 0;
+  b->bases = 0;
+}
+
+/* Threads [lo, hi) take sequences from the batch until none are left */
+void contig_range(void *arg, int lo, int hi) {
+  struct _batch *b = (struct _batch *)arg;
+  struct _contig *c;
+  FILE *out[NUM_OUT];
+  int i, k, t;
+
+  for(t = lo; t < hi; t++) {
+    while((k = take_item(&b->next, b->n)) != -1) {
+      c = b->order[k];
+      b->ws[t].spread = 0;
+      for(i = 0; i < NUM_OUT; i++) {
+        out[i] = NULL;
+        if(b->out[i] == NULL) continue;
+        out[i] = open_memstream(&c->text[i], &c->tlen[i]);
+        if(out[i] == NULL) {
+          fprintf(stderr, "\nError: could not buffer output.\n\n");
+          exit(11);
+        }
+      }
+      find_contig_genes(b->fd, &b->ws[t], c, out);
+      for(i = 0; i < NUM_OUT; i++) if(out[i] != NULL) fclose(out[i]);
+    }
+  }
+}
+
+/* Write out the buffered output of a sequence */
+void write_contig(struct _batch *b, struct _contig *c) {
+  int i;
+
+  if(b->quiet == 0)
+    fprintf(stderr, "Finding genes in sequence #%d (%d bp)...done!\n",
+            c->num, c->slen);
+  for(i = 0; i < NUM_OUT; i++) {
+    if(c->text[i] == NULL) continue;
+    if(c->tlen[i] > 0 && fwrite(c->text[i], 1, c->tlen[i], b->out[i]) !=
+       c->tlen[i]) {
+      fprintf(stderr, "\nError: could not write output.\n\n");
+      exit(11);
+    }
+    free(c->text[i]);
+    c->text[i] = NULL;
+  }
+  fflush(b->out[OUT_GENES]);
+}
+
+/* Longest sequences first, in input order when the same length */
+int compare_contig_len(const void *v1, const void *v2) {
+  struct _contig *c1 = *(struct _contig **)v1, *c2 = *(struct _contig **)v2;
+
+  if(c1->slen > c2->slen) return -1;
+  if(c1->slen < c2->slen) return 1;
+  if(c1->num < c2->num) return -1;
+  if(c1->num > c2->num) return 1;
+  return 0;
+}
+
+/*******************************************************************************
+  A thread's buffers.  They are sized for the longest sequence it has seen
+  so far (see size_workspace), and allocated zeroed so that the pages of
+  the large node lists only take up memory once they are used.
+*******************************************************************************/
+void init_workspace(struct _workspace *ws, int nmt) {
+  int i;
+
+  memset(ws, 0, sizeof(struct _workspace));
+  ws->nmt = nmt;
+  ws->genes = (struct _gene *)calloc(MAX_GENES, sizeof(struct _gene));
+  if(ws->genes == NULL) {
+    fprintf(stderr, "\nError: Malloc failed on genes.\n\n");
+    exit(1);
+  }
+  for(i = 0; i < NUM_META; i++) ws->mt_col[i] = -1;
+}
+
+void free_workspace(struct _workspace *ws) {
+  int i;
+
+  free(ws->rseq);
+  free(ws->nodes);
+  free(ws->genes);
+  for(i = 0; i < ws->nmt; i++) {
+    free(ws->mt_nodes[i]);
+    free_node_feats(&ws->mt_feat[i]);
+  }
+}
+
+/* Make room for a sequence of length 'slen', and clear the reverse strand */
+void size_workspace(struct _workspace *ws, int slen) {
+  int i, need;
+
+  if(slen/4+SEQ_PAD > ws->rcap) {
+    free(ws->rseq);
+    ws->rcap = slen/4+SEQ_PAD;
+    ws->rseq = (unsigned char *)calloc(ws->rcap, sizeof(unsigned char));
+    if(ws->rseq == NULL) {
+      fprintf(stderr, "Malloc failed on sequence\n\n");
+      exit(11);
+    }
+  }
+  else memset(ws->rseq, 0, (slen/4+SEQ_PAD)*sizeof(unsigned char));
+
+  need = (slen > STT_NOD*8) ? slen/8 : STT_NOD;
+  if(need <= ws->ncap) return;
+  free(ws->nodes);
+  ws->nodes = (struct _node *)calloc(need, sizeof(struct _node));
+  if(ws->nodes == NULL) {
+    fprintf(stderr, "Realloc failed on nodes\n\n");
+    exit(11);
+  }
+  for(i = 0; i < ws->nmt; i++) {
+    free(ws->mt_nodes[i]);
+    ws->mt_nodes[i] = (struct _node *)calloc(need, sizeof(struct _node));
+    if(ws->mt_nodes[i] == NULL) {
+      fprintf(stderr, "Realloc failed on nodes\n\n");
+      exit(11);
+    }
+    ws->mt_nn[i] = 0;
+  }
+  ws->ncap = need;
+}
+
+/*******************************************************************************
+  Find the genes in one sequence and write them to 'out'.  Only the
+  workspace and the sequence's own data are changed, so threads can run
+  this on different sequences at once.
+*******************************************************************************/
+void find_contig_genes(struct _finder *fd, struct _workspace *ws, struct
+                       _contig *c, FILE **out) {
+  int *gc_sum;
+
+  size_workspace(ws, c->slen);
+  rcom_seq(c->seq, ws->rseq, c->useq, c->slen);
+
+  /* Running GC counts shared by every scoring pass on this sequence */
+  gc_sum = calc_gc_frame_sums(c->seq, c->slen);
+  if(gc_sum == NULL) {
+    fprintf(stderr, "Malloc failed on gc frame counts\n\n");
+    exit(11);
+  }
+  if(fd->is_meta == 0) single_contig_genes(fd, ws, c, gc_sum, out);
+  else meta_contig_genes(fd, ws, c, gc_sum, out);
+  free(gc_sum);
+}
+
+/* Single genome gene finding on one sequence */
+void single_contig_genes(struct _finder *fd, struct _workspace *ws, struct
+                         _contig *c, int *gc_sum, FILE **out) {
+  unsigned char *seq = c->seq, *rseq = ws->rseq, *useq = c->useq;
+  int nn, ng, ipath, slen = c->slen;
+  struct _node *nodes = ws->nodes;
+  struct _training *tinf = fd->tinf;
+
+  /***********************************************************************
+    Find all the potential starts and stops, sort them, and create a 
+    comprehensive list of nodes for dynamic programming.
+  ***********************************************************************/
+  nn = add_nodes(seq, rseq, slen, nodes, fd->closed, c->mlist, c->nmask,
+                 tinf);
+  qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
+  link_orfs(nodes, nn);
+
+  /***********************************************************************
+    Second dynamic programming, using the dicodon statistics as the
+    scoring function.                                
+  ***********************************************************************/
+  if(fd->upd == NULL)
+    score_nodes(seq, rseq, slen, gc_sum, NULL, nodes, nn, tinf, fd->mt,
+                fd->closed, 0);
+  else update_scores(seq, rseq, useq, slen, gc_sum, c->header, nodes, nn,
+                     tinf, fd->mt, fd->closed, fd->upd);
+  if(out[OUT_STARTS] != NULL)
+    write_start_file(out[OUT_STARTS], nodes, nn, tinf, c->num, slen, 0, NULL,
+                     fd->version, c->header);
+  record_overlapping_starts(nodes, nn, tinf, 1);
+  if(fd->upd == NULL)
+    ipath = dprog(nodes, nn, tinf, 1, fd->exact_dp, c->mlist, c->nmask);
+  else ipath = update_dprog(nodes, nn, tinf, fd->exact_dp, c->mlist,
+                            c->nmask, fd->upd);
+  eliminate_bad_genes(nodes, ipath, tinf);
+  ng = add_genes(ws->genes, nodes, ipath);
+  tweak_final_starts(ws->genes, ng, nodes, nn, tinf);
+  record_gene_data(ws->genes, ng, nodes, tinf);
+
+  write_contig_genes(fd, ws, c, out, ng, NULL, tinf);
+  memset(nodes, 0, nn*sizeof(struct _node));
+}
+
+/* Metagenomic gene finding on one sequence */
+void meta_contig_genes(struct _finder *fd, struct _workspace *ws, struct
+                       _contig *c, int *gc_sum, FILE **out) {
+  unsigned char *seq = c->seq, *rseq = ws->rseq, use[NUM_META];
+  unsigned char built[NUM_META], fresh[NUM_META];
+  int i, j, k, nn = 0, ng = 0, ipath, slen = c->slen, max_phase, best_nn = -1;
+  int best_clean = 0, cur_edges[2], bins[NUM_META], nbins, nslice;
+  double score, max_score = -100.0;
+  struct _node *nodes = ws->nodes;
+  struct _metagenomic_bin *meta = fd->meta;
+
+  /***********************************************************************
+    Node positions depend only on the sequence and the translation
+    table, so each table's sorted node list is built once per sequence,
+    along with the features of the nodes that do not depend on the
+    bin's weights (calc_node_feats).  The initial coding scores of all
+    the bins that will run on a table are then summed up together in a
+    single pass over the sequence (batch_coding_scores), unless that
+    would take too much memory.
+  ***********************************************************************/
+  gc_bins(meta, c->gc, use);
+  for(i = 0; use[i] == 0; i++);
+  max_phase = i;
+  for(j = 0; j < fd->nmt; j++) { ws->mt_nb[j] = 0; built[j] = 0; }
+  for(i = 0; i < NUM_META; i++) {
+    j = fd->mt_slot[i];
+    ws->mt_col[i] = -1;
+    if(use[i] == 0) continue;
+    load_meta_bin(meta, i);
+    if(built[j] == 0) {
+      memset(ws->mt_nodes[j], 0, ws->mt_nn[j]*sizeof(struct _node));
+      ws->mt_nn[j] = add_nodes(seq, rseq, slen, ws->mt_nodes[j], fd->closed,
+                               c->mlist, c->nmask, meta[i].tinf);
+      qsort(ws->mt_nodes[j], ws->mt_nn[j], sizeof(struct _node),
+            &compare_nodes);
+      link_orfs(ws->mt_nodes[j], ws->mt_nn[j]);
+      save_end_edges(ws->mt_nodes[j], ws->mt_nn[j], ws->mt_edges[j]);
+      calc_node_feats(seq, rseq, slen, gc_sum, ws->mt_nodes[j], ws->mt_nn[j],
+                      meta[i].tinf, &ws->mt_feat[j]);
+      built[j] = 1;
+    }
+    ws->mt_col[i] = ws->mt_nb[j];
+    ws->mt_tinf[j][ws->mt_nb[j]++] = meta[i].tinf;
+  }
+  for(j = 0; j < fd->nmt; j++) {
+    if(ws->mt_nb[j] == 0) continue;
+    if((double)ws->mt_nn[j]*ws->mt_nb[j] > MAX_BATCH) {
+      ws->mt_nb[j] = 0;
+      continue;
+    }
+    batch_coding_scores(seq, rseq, slen, ws->mt_nodes[j], ws->mt_nn[j],
+                        ws->mt_tinf[j], ws->mt_nb[j], &ws->mt_feat[j],
+                        fd->compact);
+  }
+
+  /***********************************************************************
+    Each bin resets the scores of its table's nodes in place.  The edge
+    flags are put back whenever the table changes from one bin to the
+    next, which is when the nodes used to be rebuilt; otherwise a bin
+    starts with the end starts already converted to edges by the one
+    before.  The scored nodes of the best bin so far are copied into
+    'nodes' before eliminate_bad_genes adjusts them; they only need
+    rescoring if that bin ran with end starts converted.  Given the
+    threads, the bins of a sequence running on its own are instead
+    scored side by side on copies of the node lists (score_bin_range),
+    and then the best of them again here.
+  ***********************************************************************/
+  for(i = 0, nbins = 0; i < NUM_META; i++) {
+    j = fd->mt_slot[i];
+    if(i == 0 || meta[i].trans_table != meta[i-1].trans_table)
+      ws->mt_fresh[j] = 1;
+    if(ws->mt_col[i] == -1) continue;
+    fresh[i] = ws->mt_fresh[j];
+    ws->mt_fresh[j] = 0;
+    bins[nbins++] = i;
+  }
+  nslice = (ws->spread == 1) ? imin(num_threads(), nbins) : 1;
+  if(nslice > 1) {
+    i = pick_best_bin(fd, ws, c, gc_sum, bins, nbins, fresh, nslice);
+    nbins = 0;
+    if(i != -1) bins[nbins++] = i;
+  }
+  for(k = 0; k < nbins; k++) {
+    i = bins[k];
+    j = fd->mt_slot[i];
+    score = score_meta_bin(fd, ws, c, gc_sum, i, ws->mt_nodes[j],
+                           &ws->mt_feat[j], fresh[i], cur_edges, &ipath);
+    if(score > max_score) {
+      max_phase = i;
+      max_score = score;
+      memset(nodes, 0, nn*sizeof(struct _node));
+      nn = ws->mt_nn[j]; best_nn = nn;
+      best_clean = (cur_edges[0] == ws->mt_edges[j][0] && cur_edges[1] ==
+                    ws->mt_edges[j][1]);
+      memcpy(nodes, ws->mt_nodes[j], nn*sizeof(struct _node));
+      eliminate_bad_genes(ws->mt_nodes[j], ipath, meta[i].tinf);
+      ng = add_genes(ws->genes, ws->mt_nodes[j], ipath);
+      tweak_final_starts(ws->genes, ng, ws->mt_nodes[j], ws->mt_nn[j],
+                         meta[i].tinf);
+      record_gene_data(ws->genes, ng, ws->mt_nodes[j], meta[i].tinf);
+    }
+  }    
+
+  /* Recover the nodes for the best of the runs if needed */
+  if(best_nn != -1 && best_clean == 0) {
+    j = fd->mt_slot[max_phase];
+    restore_end_edges(nodes, nn, ws->mt_edges[j]);
+    ws->mt_feat[j].bin = (ws->mt_nb[j] > 0) ? ws->mt_col[max_phase] : -1;
+    reset_node_scores(nodes, nn);
+    score_nodes(seq, rseq, slen, gc_sum, &ws->mt_feat[j], nodes, nn,
+                meta[max_phase].tinf, meta[max_phase].mt, fd->closed, 1);
+  }
+  else if(best_nn == -1) {
+    memset(nodes, 0, nn*sizeof(struct _node));
+    nn = add_nodes(seq, rseq, slen, nodes, fd->closed, c->mlist, c->nmask,
+                   meta[max_phase].tinf);
+    qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
+    link_orfs(nodes, nn);
+    score_nodes(seq, rseq, slen, gc_sum, NULL, nodes, nn,
+                meta[max_phase].tinf, meta[max_phase].mt, fd->closed, 1);
+  }
+  if(out[OUT_STARTS] != NULL)
+    write_start_file(out[OUT_STARTS], nodes, nn, meta[max_phase].tinf,
+                     c->num, slen, 1, meta[max_phase].desc, fd->version,
+                     c->header);
+
+  write_contig_genes(fd, ws, c, out, ng, meta[max_phase].desc,
+                     meta[max_phase].tinf);
+  memset(nodes, 0, nn*sizeof(struct _node));
+}
+
+/*******************************************************************************
+  Score bin i on the nodes 'nod' of its translation table, with 'feat' the
+  table's node features, and return the score of the best path, whose last
+  node is put in 'ipath' (with no path at all, -1 and a score of 0).  If
+  'fresh' is 1, the edge flags of the end nodes are first put back as the
+  list was built; otherwise the end starts are converted to edges, as a
+  previous bin's score_nodes leaves them.  The flags the bin ran with are
+  saved in 'edges'.
+*******************************************************************************/
+double score_meta_bin(struct _finder *fd, struct _workspace *ws, struct
+                      _contig *c, int *gc_sum, int i, struct _node *nod,
+                      struct _node_feats *feat, int fresh, int *edges, int
+                      *ipath) {
+  int k, j = fd->mt_slot[i], nn = ws->mt_nn[j];
+  struct _metagenomic_bin *meta = fd->meta;
+
+  if(fresh == 1) restore_end_edges(nod, nn, ws->mt_edges[j]);
+  else for(k = 0; k < nn; k++)
+    if(becomes_edge(&nod[k], c->slen, fd->closed) == 1) nod[k].edge = 1;
+  save_end_edges(nod, nn, edges);
+  feat->bin = (ws->mt_nb[j] > 0) ? ws->mt_col[i] : -1;
+  reset_node_scores(nod, nn);
+  score_nodes(c->seq, ws->rseq, c->slen, gc_sum, feat, nod, nn, meta[i].tinf,
+              meta[i].mt, fd->closed, 1);
+  record_overlapping_starts(nod, nn, meta[i].tinf, 1);
+  *ipath = dprog(nod, nn, meta[i].tinf, 1, fd->exact_dp, c->mlist, c->nmask);
+  if(*ipath == -1) return 0.0;
+  return nod[*ipath].score;
+}
+
+/*******************************************************************************
+  Score the 'nbins' bins in 'bins' (in increasing order) on 'nslice'
+  threads, and return the one the serial loop in meta_contig_genes would
+  keep, or -1 if none scores above -100.  Each thread takes a run of the
+  bins and scores them on its own copy of the node lists, keeping the
+  first of its best; the first best of the threads' bests, taken in order,
+  is then the first best of all.
+*******************************************************************************/
+int pick_best_bin(struct _finder *fd, struct _workspace *ws, struct _contig
+                  *c, int *gc_sum, int *bins, int nbins, unsigned char
+                  *fresh, int nslice) {
+  int k, t, most = 0, best = -1;
+  double max_score = -100.0;
+  struct _bin_job job;
+
+  for(k = 0; k < nbins; k++)
+    if(ws->mt_nn[fd->mt_slot[bins[k]]] > most)
+      most = ws->mt_nn[fd->mt_slot[bins[k]]];
+  job.fd = fd; job.ws = ws; job.c = c; job.gc_sum = gc_sum;
+  job.bins = bins; job.nbins = nbins; job.fresh = fresh; job.nslice = nslice;
+  job.nod = (struct _node *)malloc((long)nslice*most*sizeof(struct _node));
+  if(job.nod == NULL) {
+    fprintf(stderr, "Malloc failed on bin nodes\n\n");
+    exit(11);
+  }
+  job.most = most;
+  parallel_tasks(nslice, score_bin_range, &job);
+  free(job.nod);
+
+  for(t = 0; t < nslice; t++) {
+    if(job.best[t] == -1 || job.score[t] <= max_score) continue;
+    max_score = job.score[t];
+    best = job.best[t];
+  }
+  return best;
+}
+
+/* Score the runs of bins [lo, hi) of a pick_best_bin job */
+void score_bin_range(void *arg, int lo, int hi) {
+  struct _bin_job *job = (struct _bin_job *)arg;
+  struct _workspace *ws = job->ws;
+  struct _node *nod;
+  struct _node_feats feat;
+  int i, j, k, t, ipath, edges[2];
+  double score;
+
+  for(t = lo; t < hi; t++) {
+    nod = &job->nod[(long)t*job->most];
+    job->best[t] = -1;
+    job->score[t] = -100.0;
+    for(k = job->nbins*t/job->nslice; k < job->nbins*(t+1)/job->nslice;
+        k++) {
+      i = job->bins[k];
+      j = job->fd->mt_slot[i];
+      memcpy(nod, ws->mt_nodes[j], ws->mt_nn[j]*sizeof(struct _node));
+      memcpy(&feat, &ws->mt_feat[j], sizeof(struct _node_feats));
+      score = score_meta_bin(job->fd, ws, job->c, job->gc_sum, i, nod, &feat,
+                             job->fresh[i], edges, &ipath);
+      if(score > job->score[t]) {
+        job->score[t] = score;
+        job->best[t] = i;
+      }
+    }
+  }
+}
+
+/* Print the genes of a sequence, and their translations and sequences */
+void write_contig_genes(struct _finder *fd, struct _workspace *ws, struct
+                        _contig *c, FILE **out, int ng, char *desc, struct
+                        _training *tinf) {
+  print_genes(out[OUT_GENES], ws->genes, ng, ws->nodes, c->slen, fd->output,
+              c->num, fd->is_meta, desc, tinf, c->header, c->short_header,
+              fd->version);
+  if(out[OUT_TRANS] != NULL)
+    write_translations(out[OUT_TRANS], ws->genes, ng, ws->nodes, c->seq,
+                       ws->rseq, c->useq, c->slen, tinf, c->num,
+                       c->short_header, 1);
+  if(out[OUT_NUCS] != NULL)
+    write_nucleotide_seqs(out[OUT_NUCS], ws->genes, ng, ws->nodes, c->seq,
+                          ws->rseq, c->useq, c->slen, tinf, c->num,
+                          c->short_header, 1);
+}
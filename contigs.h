@@ -0,0 +1,154 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#ifndef _CONTIGS_H
+#define _CONTIGS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sequence.h"
+#include "metagenomic.h"
+#include "node.h"
+#include "dprog.h"
+#include "gene.h"
+#include "update.h"
+
+#define NUM_OUT 4            /* Gene, start, translation, nucleotide files */
+#define OUT_GENES 0
+#define OUT_STARTS 1
+#define OUT_TRANS 2
+#define OUT_NUCS 3
+#define BATCH_CONTIGS 4096   /* Most sequences read ahead at once */
+#define BATCH_BASES 8000000  /* Sequences read ahead stop after this many */
+#define SEQ_PAD 16           /* Zero bytes kept after a sequence copy */
+
+/* Settings and models for gene finding, shared read-only by the threads */
+struct _finder {
+  int is_meta;
+  int closed;          /* Genes may not run off the edges */
+  int exact_dp;        /* Exact dynamic programming (-e) */
+  int output;          /* Output format (-f) */
+  int compact;         /* Single precision coding tables (-r) */
+  char *version;
+  struct _training *tinf;   /* Single genome model */
+  struct _motif_table *mt;  /* Its motif table */
+  struct _metagenomic_bin *meta;
+  int nmt;             /* Distinct translation tables among the bins */
+  int mt_slot[NUM_META];    /* Each bin's translation table */
+  struct _update *upd; /* Incremental update state, or NULL */
+};
+
+/* A sequence read ahead, and the output written for it */
+struct _contig {
+  int num;             /* Sequence number */
+  int slen;
+  double gc;
+  unsigned char *seq;  /* Own copies of the sequence and its masks */
+  unsigned char *useq;
+  mask *mlist;
+  int nmask;
+  char header[MAX_LINE];
+  char short_header[MAX_LINE];
+  char *text[NUM_OUT]; /* Output for each file, until it is written */
+  size_t tlen[NUM_OUT];
+};
+
+/* Everything one thread changes while finding the genes in a sequence */
+struct _workspace {
+  unsigned char *rseq; /* Reverse complement */
+  int rcap;            /* Bytes of rseq */
+  struct _node *nodes; /* Nodes of the sequence (of the best bin, if meta) */
+  int ncap;            /* Nodes there is room for in each node list */
+  struct _gene *genes;
+  int nmt;
+  struct _node *mt_nodes[NUM_META]; /* Node list of each translation table */
+  struct _node_feats mt_feat[NUM_META];
+  int mt_nn[NUM_META];
+  int mt_edges[NUM_META][2];
+  int mt_fresh[NUM_META];
+  int mt_col[NUM_META];
+  int mt_nb[NUM_META];
+  struct _training *mt_tinf[NUM_META][NUM_META];
+  int spread;          /* 1 if the sequence has the threads to itself */
+};
+
+/* Bins of one sequence scored in parallel (see pick_best_bin) */
+struct _bin_job {
+  struct _finder *fd;
+  struct _workspace *ws;
+  struct _contig *c;
+  int *gc_sum;
+  int *bins;           /* The bins to score, in increasing order */
+  int nbins;
+  unsigned char *fresh; /* Whether each bin starts with the saved edges */
+  int nslice;          /* Runs of bins, one per thread */
+  struct _node *nod;   /* Node list of each run, 'most' nodes apart */
+  int most;
+  int best[MAX_THREADS];    /* First best bin of each run, or -1 */
+  double score[MAX_THREADS];
+};
+
+/* Sequences read ahead, which the threads take longest first */
+struct _batch {
+  struct _finder *fd;
+  struct _contig *ctg;
+  int n;
+  int cap;
+  int limit;           /* Sequences read ahead at most */
+  long bases;          /* Total length of the sequences */
+  struct _contig **order;   /* The sequences, longest first */
+  int next;            /* Next of 'order' to be taken */
+  struct _workspace *ws; /* One per thread */
+  int nws;
+  FILE *out[NUM_OUT];  /* Files the output goes to (NULL if not wanted) */
+  int quiet;
+};
+
+void init_batch(struct _batch *, struct _finder *, FILE **, int);
+void free_batch(struct _batch *);
+int add_contig(struct _batch *, unsigned char *, unsigned char *, int, double,
+               mask *, int, int, char *);
+void run_batch(struct _batch *);
+void contig_range(void *, int, int);
+void write_contig(struct _batch *, struct _contig *);
+int compare_contig_len(const void *, const void *);
+
+void init_workspace(struct _workspace *, int);
+void free_workspace(struct _workspace *);
+void size_workspace(struct _workspace *, int);
+
+void find_contig_genes(struct _finder *, struct _workspace *,
+                       struct _contig *, FILE **);
+void single_contig_genes(struct _finder *, struct _workspace *,
+                         struct _contig *, int *, FILE **);
+void meta_contig_genes(struct _finder *, struct _workspace *,
+                       struct _contig *, int *, FILE **);
+double score_meta_bin(struct _finder *, struct _workspace *,
+                      struct _contig *, int *, int, struct _node *,
+                      struct _node_feats *, int, int *, int *);
+int pick_best_bin(struct _finder *, struct _workspace *, struct _contig *,
+                  int *, int *, int, unsigned char *, int);
+void score_bin_range(void *, int, int);
+void write_contig_genes(struct _finder *, struct _workspace *,
+                        struct _contig *, FILE **, int, char *,
+                        struct _training *);
+
+#endif
@@ -20,56 +20,101 @@
 
 #include "dprog.h"
 
+/* Connection scoring routine for each (predecessor class, node class) */
+static conn_func connect[4][4] = {
+  /* from 5'fwd */ { NULL, &gene_fwd, NULL, NULL },
+  /* from 3'fwd */ { &intergenic_fwd, &operon_fwd, &overlap_fwd_rev,
+                     &intergenic_fwd_rev },
+  /* from 5'rev */ { &intergenic_rev_fwd, NULL, NULL, &intergenic_rev },
+  /* from 3'rev */ { NULL, NULL, &gene_rev, &operon_rev }
+};
+
 /*******************************************************************************
   Basic dynamic programming routine for predicting genes.  The 'flag' variable
   is set to 0 for the initial dynamic programming routine based solely on GC
   frame plot (used to construct a training set.  If the flag is set to 1, the
   routine does the final dynamic programming based on
   coding, RBS scores, etc.
+
+  Only some kinds of node can connect to one another (a 5'fwd can only be
+  reached from a 3'fwd or a 5'rev, and so on), so the nodes are split into
+  one list per class and each node only looks at the lists of the classes
+  that can legally precede it.  If 'exact' is 1, every earlier node is
+  considered as a predecessor (exact_segments) rather than just those
+  within MAX_NODE_DIST (window_connections).  The mask list is used to
+  split the exact run into independent pieces.
 *******************************************************************************/
 
-int dprog(struct _node *nod, int nn, struct _training *tinf, int flag) {
-  int i, j, min, max_ndx = -1, path, nxt, tmp;
-  double max_sc = -1.0;
+int dprog(struct _node *nod, int nn, struct _training *tinf, int flag,
+          int exact, mask *mlist, int nm) {
+  dprog_fill(nod, nn, tinf, flag, exact, mlist, nm, 0);
+  return dprog_trace(nod, nn);
+}
 
-  if(nn == 0) return -1;
-  for(i = 0; i < nn; i++) {
+/*******************************************************************************
+  Fill in the score and traceback of every node from 'first' on.  Nodes
+  before 'first' must already hold what an earlier fill gave them (this
+  only matters to window_connections; the exact routine always starts
+  from the beginning).
+*******************************************************************************/
+void dprog_fill(struct _node *nod, int nn, struct _training *tinf, int flag,
+                int exact, mask *mlist, int nm, int first) {
+  int i;
+
+  if(exact == 1) first = 0;
+  for(i = first; i < nn; i++) {
     nod[i].score = 0;
     nod[i].traceb = -1;
-    nod[i].tracef = -1;
+    nod[i].gap = HUGE_VAL;
   }
-  for(i = 0; i < nn; i++) {
 
-    /* Set up distance constraints for making connections, */
-    /* but make exceptions for giant ORFS.                 */
-    if(i < MAX_NODE_DIST) min = 0; else min = i-MAX_NODE_DIST;
-    if(nod[i].strand == -1 && nod[i].type != STOP && nod[min].ndx >=
-       nod[i].stop_val)
-      while(min >= 0 && nod[i].ndx != nod[i].stop_val) min--;
-    if(nod[i].strand == 1 && nod[i].type == STOP && nod[min].ndx >=
-       nod[i].stop_val)
-      while(min >= 0 && nod[i].ndx != nod[i].stop_val) min--;
-    if(min < MAX_NODE_DIST) min = 0;
-    else min = min-MAX_NODE_DIST;
-    for(j = min; j < i; j++) {
-      score_connection(nod, j, i, tinf, flag);
-    }
-  }
+  if(exact == 1) exact_segments(nod, nn, tinf, flag, mlist, nm);
+  else window_connections(nod, nn, tinf, flag, first);
+}
+
+/*******************************************************************************
+  Pick the best scoring end node, untangle the overlapping genes on its
+  path and set the forward pointers.  Returns the last node of the path,
+  or -1 if there is no path.
+*******************************************************************************/
+int dprog_trace(struct _node *nod, int nn) {
+  int i, max_ndx = -1;
+  double max_sc = -1.0;
+
+  if(nn == 0) return -1;
+  for(i = 0; i < nn; i++) nod[i].tracef = -1;
   for(i = nn-1; i >= 0; i--) {
     if(nod[i].strand == 1 && nod[i].type != STOP) continue;
     if(nod[i].strand == -1 && nod[i].type == STOP) continue;
     if(nod[i].score > max_sc) { max_sc = nod[i].score; max_ndx = i; }
   }
 
+  if(max_ndx == -1) return -1;
+  untangle_path(nod, max_ndx, -1);
+
+  if(nod[max_ndx].traceb == -1) return -1;
+  else return max_ndx;
+}
+
+/*******************************************************************************
+  Untangle the overlapping genes on the path running back from 'last' and
+  set its forward pointers, stopping at node 'first' (-1 for the start of
+  the path).  Each overlap is fixed up between one node and the one it
+  traces back to, so a path can be done a stretch at a time from the
+  bottom up.
+*******************************************************************************/
+void untangle_path(struct _node *nod, int last, int first) {
+  int i, path, nxt, tmp;
+
   /* First Pass: untangle the triple overlaps */
-  path = max_ndx;
-  while(nod[path].traceb != -1) {
+  path = last;
+  while(path != first && nod[path].traceb != -1) {
     nxt = nod[path].traceb;
     if(nod[path].strand == -1 && nod[path].type == STOP &&
       nod[nxt].strand == 1 && nod[nxt].type == STOP &&
       nod[path].ov_mark != -1 && nod[path].ndx > nod[nxt].ndx) {
       tmp = nod[path].star_ptr[nod[path].ov_mark];
-      for(i = tmp; nod[i].ndx != nod[tmp].stop_val; i--);
+      i = nod[tmp].stop_ptr;
       nod[path].traceb = tmp;
       nod[tmp].traceb = i;
       nod[i].ov_mark = -1;
@@ -79,12 +124,12 @@ int dprog(struct _node *nod, int nn, struct _training *tinf, int flag) {
   }
 
   /* Second Pass: Untangle the simple overlaps */
-  path = max_ndx;
-  while(nod[path].traceb != -1) {
+  path = last;
+  while(path != first && nod[path].traceb != -1) {
     nxt = nod[path].traceb;
     if(nod[path].strand == -1 && nod[path].type != STOP && nod[nxt].strand == 1
        && nod[nxt].type == STOP) {
-      for(i = path; nod[i].ndx != nod[path].stop_val; i--);
+      i = nod[path].stop_ptr;
       nod[path].traceb = i; nod[i].traceb = nxt;
     }
     if(nod[path].strand == 1 && nod[path].type == STOP && nod[nxt].strand == 1
@@ -101,200 +146,605 @@ int dprog(struct _node *nod, int nn, struct _training *tinf, int flag) {
   }
 
   /* Mark forward pointers */
-  path = max_ndx;
-  while(nod[path].traceb != -1) {
+  path = last;
+  while(path != first && nod[path].traceb != -1) {
     nod[nod[path].traceb].tracef = path;
     path = nod[path].traceb;
   }
-
-  if(nod[max_ndx].traceb == -1) return -1;
-  else return max_ndx;
 }
 
 /*******************************************************************************
-  This routine scores the connection between two nodes, the most basic of which
-  is 5'fwd->3'fwd (gene) and 3'rev->5'rev (rev gene).  If the connection ending
-  at n2 is the maximal scoring model, it updates the pointers in the dynamic
-  programming model.  n3 is used to handle overlaps, i.e. cases where 5->3'
-  overlaps 5'->3' on the same strand.  In this case, 3' connects directly to 3',
-  and n3 is used to untangle the 5' end of the second gene.
+  Connect each node from 'first' on to its predecessors within MAX_NODE_DIST
+  nodes (or further back for giant ORFs).
 *******************************************************************************/
+void window_connections(struct _node *nod, int nn, struct _training *tinf,
+                        int flag, int first) {
+  int i, j, c1, c2, min, seen[4], *cls_ndx, *cls_list[4], cls_ct[4];
+  conn_func conn;
 
-void score_connection(struct _node *nod, int p1, int p2, struct _training *tinf,
-                      int flag) {
-  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]), *n3;
-  int i, left = n1->ndx, right = n2->ndx, bnd, ovlp = 0, maxfr = -1;
-  double score = 0.0, scr_mod = 0.0, maxval;
+  cls_ndx = class_lists(nod, 0, nn, cls_list, cls_ct);
+  for(c1 = 0; c1 < 4; c1++)
+    seen[c1] = first_node(cls_list[c1], cls_ct[c1], first);
+  for(i = first; i < nn; i++) {
 
-  /***********************/
-  /* Invalid Connections */
-  /***********************/
-
-  /* 5'fwd->5'fwd, 5'rev->5'rev */
-  if(n1->type != STOP && n2->type != STOP && n1->strand == n2->strand) return;
-
-  /* 5'fwd->5'rev, 5'fwd->3'rev */
-  else if(n1->strand == 1 && n1->type != STOP && n2->strand == -1) return;
-
-  /* 3'rev->5'fwd, 3'rev->3'fwd) */
-  else if(n1->strand == -1 && n1->type == STOP && n2->strand == 1) return;
-
-  /* 5'rev->3'fwd */
-  else if(n1->strand == -1 && n1->type != STOP && n2->strand == 1 && n2->type ==
-          STOP) return;
-
-  /******************/
-  /* Edge Artifacts */
-  /******************/
-  if(n1->traceb == -1 && n1->strand == 1 && n1->type == STOP) return;
-  if(n1->traceb == -1 && n1->strand == -1 && n1->type != STOP) return;
-
-  /*********/
-  /* Genes */
-  /*********/
-
-  /* 5'fwd->3'fwd */
-  else if(n1->strand == n2->strand && n1->strand == 1 && n1->type != STOP &&
-          n2->type == STOP) {
-    if(n2->stop_val >= n1->ndx) return;
-    if(n1->ndx % 3 != n2->ndx % 3) return;
-    right += 2;
-    if(flag == 0) scr_mod = tinf->bias[0]*n1->gc_score[0] +
-                  tinf->bias[1]*n1->gc_score[1] + tinf->bias[2]*n1->gc_score[2];
-    else if(flag == 1) score = n1->cscore + n1->sscore;
-  }
+    /* Set up distance constraints for making connections, */
+    /* but make exceptions for giant ORFS.                 */
+    if(i < MAX_NODE_DIST) min = 0; else min = i-MAX_NODE_DIST;
+    if(nod[i].strand == -1 && nod[i].type != STOP && nod[min].ndx >=
+       nod[i].stop_val)
+      while(min >= 0 && nod[i].ndx != nod[i].stop_val) min--;
+    if(nod[i].strand == 1 && nod[i].type == STOP && nod[min].ndx >=
+       nod[i].stop_val)
+      while(min >= 0 && nod[i].ndx != nod[i].stop_val) min--;
+    if(min < MAX_NODE_DIST) min = 0;
+    else min = min-MAX_NODE_DIST;
 
-  /* 3'rev->5'rev */
-  else if(n1->strand == n2->strand && n1->strand == -1 && n1->type == STOP &&
-          n2->type != STOP) {
-    if(n1->stop_val <= n2->ndx) return;
-    if(n1->ndx % 3 != n2->ndx % 3) return;
-    left -= 2;
-    if(flag == 0) scr_mod = tinf->bias[0]*n2->gc_score[0] +
-                  tinf->bias[1]*n2->gc_score[1] + tinf->bias[2]*n2->gc_score[2];
-    else if(flag == 1) score = n2->cscore + n2->sscore;
+    /* Nodes min..i-1 of each class that can connect to this one */
+    c2 = node_class(&nod[i]);
+    for(c1 = 0; c1 < 4; c1++) {
+      conn = connect[c1][c2];
+      if(conn == NULL) continue;
+      for(j = first_node(cls_list[c1], seen[c1], min); j < seen[c1]; j++)
+        conn(nod, cls_list[c1][j], i, tinf, flag);
+    }
+    seen[c2]++;
   }
+  free(cls_ndx);
+}
 
-  /********************************/
-  /* Intergenic Space (Noncoding) */
-  /********************************/
+/*******************************************************************************
+  Split nodes [lo, hi) into one list of node indices per class.  Returns the
+  buffer holding all four lists, which the caller frees.
+*******************************************************************************/
+int *class_lists(struct _node *nod, int lo, int hi, int **cls_list,
+                 int *cls_ct) {
+  int i, c1, seen[4], *cls_ndx;
+
+  cls_ndx = (int *)malloc((hi-lo+1)*sizeof(int));
+  if(cls_ndx == NULL) {
+    fprintf(stderr, "Malloc failed on node classes\n\n");
+    exit(11);
+  }
+  for(c1 = 0; c1 < 4; c1++) { cls_ct[c1] = 0; seen[c1] = 0; }
+  for(i = lo; i < hi; i++) cls_ct[node_class(&nod[i])]++;
+  cls_list[0] = cls_ndx;
+  for(c1 = 1; c1 < 4; c1++) cls_list[c1] = cls_list[c1-1] + cls_ct[c1-1];
+  for(i = lo; i < hi; i++) {
+    c1 = node_class(&nod[i]);
+    cls_list[c1][seen[c1]++] = i;
+  }
+  return cls_ndx;
+}
 
-  /* 3'fwd->5'fwd */
-  else if(n1->strand == 1 && n1->type == STOP && n2->strand == 1 && n2->type !=
-          STOP) {
-    left += 2;
-    if(left >= right) return;
-    if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+/*******************************************************************************
+  Exact dynamic programming, split at masked gaps so the pieces can be run
+  in parallel.  No gene can cross a mask, and once the nodes either side of
+  it are more than 3*OPER_DIST apart the only connections left across the
+  gap are intergenic ones with a constant score.  Every 5'fwd or 3'rev past
+  the gap therefore sees the whole sequence before it through just one
+  node:  the best 3'fwd or 5'rev so far.  Segments after the first are
+  solved as if that node scored 0 (DP_RELATIVE), then joined on in order
+  once its real score is known (join_segment), so the result is exactly
+  that of a single pass.  In the GC frame pass (flag 0) every intergenic
+  connection scores 0, so different paths often tie but for rounding and
+  join_segment would nearly always have to redo the segment; there the
+  segments are just solved one after another from their real
+  predecessors.  Without masks there is no such node, and the sequence is
+  solved as one segment:  a long stretch with no nodes has no stop codon
+  in any frame, so genes can run right across it.
+*******************************************************************************/
+void exact_segments(struct _node *nod, int nn, struct _training *tinf,
+                    int flag, mask *mlist, int nm) {
+  struct _dp_job job;
+  int i, s, c1, nseg = 0, best = -1, *seg;
+
+  seg = (int *)malloc((nn+1)*sizeof(int));
+  if(seg == NULL) {
+    fprintf(stderr, "Malloc failed on dynamic programming segments\n\n");
+    exit(11);
+  }
+  seg[nseg++] = 0;
+  for(i = 1; i < nn; i++)
+    if(nod[i].ndx - nod[i-1].ndx > 3*OPER_DIST &&
+       cross_mask(nod[i-1].ndx, nod[i].ndx, mlist, nm) == 1) seg[nseg++] = i;
+  seg[nseg] = nn;
+
+  job.nod = nod; job.tinf = tinf; job.flag = flag; job.seg = seg;
+  if(flag == 1) parallel_tasks(nseg, &segment_range, &job);
+
+  for(s = 0; s < nseg; s++) {
+    if(flag == 0) exact_connections(nod, seg[s], seg[s+1], tinf, flag, best);
+    else if(s > 0) join_segment(nod, seg[s], seg[s+1], best, tinf, flag);
+    for(i = seg[s]; i < seg[s+1]; i++) {
+      c1 = node_class(&nod[i]);
+      if(c1 == 1 || c1 == 2) best = better_node(nod, best, i);
+    }
   }
+  free(seg);
+}
+
+/* Solve segments [lo, hi) of a _dp_job, each on its own */
+void segment_range(void *arg, int lo, int hi) {
+  struct _dp_job *job = (struct _dp_job *)arg;
+  int s;
 
-  /* 3'fwd->3'rev */
-  else if(n1->strand == 1 && n1->type == STOP && n2->strand == -1 && n2->type ==
-          STOP) {
-    left += 2; right -= 2;
-    if(left >= right) return;
-    /* Overlapping Gene Case 2: Three consecutive overlapping genes f r r */
-    maxfr = -1; maxval = 0.0;
-    for(i = 0; i < 3; i++) {
-      if(n2->star_ptr[i] == -1) continue;
-      n3 = &(nod[n2->star_ptr[i]]);
-      ovlp = left - n3->stop_val + 3;
-      if(ovlp <= 0 || ovlp >= MAX_OPP_OVLP) continue;
-      if(ovlp >= n3->ndx - left) continue;
-      if(n1->traceb == -1) continue;
-      if(ovlp >= n3->stop_val - nod[n1->traceb].ndx - 2) continue;
-      if((flag == 1 && n3->cscore + n3->sscore + intergenic_mod(n3, n2, tinf) >
-          maxval) || (flag == 0 && tinf->bias[0]*n3->gc_score[0] +
-          tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2] >
-          maxval)) {
-        maxfr = i;
-        maxval = n3->cscore + n3->sscore + intergenic_mod(n3, n2, tinf);
+  for(s = lo; s < hi; s++)
+    exact_connections(job->nod, job->seg[s], job->seg[s+1], job->tinf,
+                      job->flag, (s == 0) ? -1 : DP_RELATIVE);
+}
+
+/*******************************************************************************
+  Attach segment [lo, hi), solved relative to a virtual predecessor, to the
+  nodes before it, whose best 3'fwd/5'rev is 'seed' (-1 if none).  The
+  relative run adds up its scores in a different order from a single pass,
+  so the two can differ in the last bits.  Its choices are kept only if
+  every one of them was made by more than that difference can be (the
+  'gap' recorded on each node), and every connected node would end up
+  above 0, where a single pass would also connect it.  The choices then
+  match a single pass, and rescoring each connection from its real
+  predecessor in node order gives the same scores bit for bit.  Otherwise
+  the segment is solved again from 'seed'.
+*******************************************************************************/
+void join_segment(struct _node *nod, int lo, int hi, int seed,
+                  struct _training *tinf, int flag) {
+  int i, p;
+  double top = 0.0, tol;
+
+  if(seed != -1) {
+    for(i = lo; i < hi; i++)
+      if(nod[i].traceb != -1 && fabs(nod[i].score) > top)
+        top = fabs(nod[i].score);
+    tol = 2.0*(hi-lo+2)*DBL_EPSILON*(fabs(nod[seed].score)+top);
+    for(i = lo; i < hi; i++)
+      if(nod[i].traceb != -1 && (nod[i].gap <= tol ||
+         nod[seed].score + nod[i].score <= tol)) break;
+    if(i == hi) {
+      for(i = lo; i < hi; i++) {
+        p = nod[i].traceb;
+        nod[i].score = 0;
+        nod[i].traceb = -1;
+        if(p != -1)
+          score_connection(nod, (p == DP_RELATIVE) ? seed : p, i, tinf, flag);
       }
+      return;
     }
-    if(maxfr != -1) {
-      n3 = &(nod[n2->star_ptr[maxfr]]);
-      if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
-                    tinf->bias[1]*n3->gc_score[1] +
-                    tinf->bias[2]*n3->gc_score[2];
-      else if(flag == 1) score = n3->cscore + n3->sscore +
-              intergenic_mod(n3, n2, tinf);
-    }
-    else if(flag == 1) score = intergenic_mod(n1, n2, tinf);
   }
+  for(i = lo; i < hi; i++) { nod[i].score = 0; nod[i].traceb = -1; }
+  exact_connections(nod, lo, hi, tinf, flag, seed);
+}
 
-  /* 5'rev->3'rev */
-  else if(n1->strand == -1 && n1->type != STOP && n2->strand == -1 && n2->type
-          == STOP) {
-    right -= 2;
-    if(left >= right) return;
-    if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+/*******************************************************************************
+  Connect each node in [lo, hi) to every earlier node in that range it can
+  legally follow, without a distance limit.  Most connections only matter
+  near the node:  genes and operons only reach back through the ORF, and
+  opposite strand 3' overlaps only near a stop.  Intergenic connections can
+  come from anywhere, but beyond 3*OPER_DIST (or between strands)
+  intergenic_mod is a constant, so the best of those far predecessors is
+  kept as a running maximum (or, for 3'fwd->3'rev, in a max tree over the
+  3'fwd list so the few overlap windows can be skipped) and only nearby
+  ones are scored one by one.  Ties go to the later node, as in
+  window_connections.
+
+  'seed' is a node before the range that every 5'fwd and 3'rev may also
+  follow at that constant score (-1 for none), or DP_RELATIVE for a virtual
+  one scoring 0 (see exact_segments).
+*******************************************************************************/
+void exact_connections(struct _node *nod, int lo, int hi, struct _training
+                       *tinf, int flag, int seed) {
+  int i, k, f, nw, tsize, seen[4], last_rt[3], win[3][2], *tree, *cls_ndx;
+  int far_ft = -1, far_rs_fwd = -1, far_rs = -1, p_ft = 0, p_rs_fwd = 0;
+  int p_rs = 0, w0, w1, *cls_list[4], cls_ct[4], *fs, *ft, *rs;
+  double far_sc;
+  struct _node *n2, *n3;
+
+  cls_ndx = class_lists(nod, lo, hi, cls_list, cls_ct);
+  fs = cls_list[0]; ft = cls_list[1]; rs = cls_list[2];
+
+  /* Intergenic score beyond OPER_DIST range or across strands */
+  if(flag == 1) far_sc = -0.15 * tinf->st_wt;
+  else far_sc = 0.0;
+
+  for(tsize = 1; tsize < cls_ct[1]; tsize *= 2);
+  tree = (int *)malloc(2*tsize*sizeof(int));
+  if(tree == NULL) {
+    fprintf(stderr, "Malloc failed on dynamic programming tree\n\n");
+    exit(11);
   }
+  for(k = 0; k < 2*tsize; k++) tree[k] = -1;
+  for(k = 0; k < 4; k++) seen[k] = 0;
+  for(k = 0; k < 3; k++) last_rt[k] = -1;
+
+  for(i = lo; i < hi; i++) {
+    n2 = &nod[i];
+    f = node_class(n2);
+    if(seed == DP_RELATIVE && (f == 0 || f == 3)) {
+      n2->score = far_sc;
+      n2->traceb = DP_RELATIVE;
+      n2->ov_mark = -1;
+    }
+    else if(seed == DP_RELATIVE) n2->score = DP_FLOOR;
+    else if(seed != -1 && (f == 0 || f == 3))
+      link_nodes(nod, seed, i, far_sc, -1);
+
+    /* 5'fwd: from 3'fwd (near ones explicitly) and from any 5'rev */
+    if(n2->strand == 1 && n2->type != STOP) {
+      for(; p_ft < seen[1] && nod[ft[p_ft]].ndx < n2->ndx-3*OPER_DIST; p_ft++)
+        far_ft = better_node(nod, far_ft, ft[p_ft]);
+      if(far_ft != -1) link_nodes(nod, far_ft, i, far_sc, -1);
+      for(k = p_ft; k < seen[1]; k++) intergenic_fwd(nod, ft[k], i, tinf, flag);
+      for(; p_rs_fwd < seen[2] && nod[rs[p_rs_fwd]].ndx < n2->ndx; p_rs_fwd++)
+        far_rs_fwd = better_node(nod, far_rs_fwd, rs[p_rs_fwd]);
+      if(far_rs_fwd != -1) link_nodes(nod, far_rs_fwd, i, far_sc, -1);
+    }
+
+    /* 3'fwd: from the starts and other-frame stops inside its ORF */
+    else if(n2->strand == 1) {
+      w0 = first_ndx(nod, fs, seen[0], n2->stop_val+1);
+      for(k = w0; k < seen[0]; k++) gene_fwd(nod, fs[k], i, tinf, flag);
+      w0 = first_ndx(nod, ft, seen[1], n2->stop_val+1);
+      for(k = w0; k < seen[1]; k++) operon_fwd(nod, ft[k], i, tinf, flag);
+    }
+
+    /* 5'rev: from its own stop and from 3'fwds overlapping that stop */
+    else if(n2->type != STOP) {
+      if(last_rt[n2->ndx%3] != -1)
+        gene_rev(nod, last_rt[n2->ndx%3], i, tinf, flag);
+      w0 = first_ndx(nod, ft, seen[1], n2->stop_val-3);
+      w1 = first_ndx(nod, ft, seen[1], n2->stop_val+MAX_OPP_OVLP-5);
+      for(k = w0; k < w1; k++) overlap_fwd_rev(nod, ft[k], i, tinf, flag);
+    }
+
+    /* 3'rev: from other-frame stops whose ORF it sits in, from 5'revs */
+    /* (near ones explicitly), and from 3'fwds.  A 3'fwd close to the  */
+    /* stop of one of this node's overlapping starts is scored         */
+    /* explicitly; every other 3'fwd scores the intergenic constant.    */
+    else {
+      for(f = 0; f < 3; f++)
+        if(last_rt[f] != -1) operon_rev(nod, last_rt[f], i, tinf, flag);
+      for(; p_rs < seen[2] && nod[rs[p_rs]].ndx < n2->ndx-3*OPER_DIST; p_rs++)
+        far_rs = better_node(nod, far_rs, rs[p_rs]);
+      if(far_rs != -1) link_nodes(nod, far_rs, i, far_sc, -1);
+      for(k = p_rs; k < seen[2]; k++) intergenic_rev(nod, rs[k], i, tinf, flag);
+
+      w1 = first_ndx(nod, ft, seen[1], n2->ndx-4);
+      nw = 0;
+      for(f = 0; f < 3; f++) {
+        if(n2->star_ptr[f] == -1) continue;
+        n3 = &nod[n2->star_ptr[f]];
+        win[nw][0] = first_ndx(nod, ft, w1, n3->stop_val-4);
+        win[nw][1] = first_ndx(nod, ft, w1, n3->stop_val+MAX_OPP_OVLP-5);
+        for(k = nw; k > 0 && win[k][0] < win[k-1][0]; k--) {
+          w0 = win[k][0]; win[k][0] = win[k-1][0]; win[k-1][0] = w0;
+          w0 = win[k][1]; win[k][1] = win[k-1][1]; win[k-1][1] = w0;
+        }
+        nw++;
+      }
+      w0 = 0;
+      for(f = 0; f <= nw; f++) {
+        k = tree_best(nod, tree, tsize, w0, (f < nw) ? win[f][0] : w1);
+        if(k != -1) link_nodes(nod, k, i, far_sc, -1);
+        if(f == nw) break;
+        for(k = (w0 > win[f][0]) ? w0 : win[f][0]; k < win[f][1]; k++)
+          intergenic_fwd_rev(nod, ft[k], i, tinf, flag);
+        if(win[f][1] > w0) w0 = win[f][1];
+      }
+    }
 
-  /* 5'rev->5'fwd */
-  else if(n1->strand == -1 && n1->type != STOP && n2->strand == 1 && n2->type
-          != STOP) {
-    if(left >= right) return;
-    if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+    f = node_class(n2);
+    if(f == 1 && n2->traceb != -1) tree_set(nod, tree, tsize, seen[1], i);
+    if(f == 3) last_rt[n2->ndx%3] = i;
+    seen[f]++;
   }
+  free(tree);
+  free(cls_ndx);
+}
 
-  /********************/
-  /* Possible Operons */
-  /********************/
-
-  /* 3'fwd->3'fwd, check for a start just to left of first 3' */
-  else if(n1->strand == 1 && n2->strand == 1 && n1->type == STOP && n2->type ==
-          STOP) {
-    if(n2->stop_val >= n1->ndx) return;
-    if(n1->star_ptr[n2->ndx%3] == -1) return;
-    n3 = &(nod[n1->star_ptr[n2->ndx%3]]);
-    left = n3->ndx; right += 2;
-    if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
-                  tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2];
-    else if(flag == 1) score = n3->cscore + n3->sscore +
-                       intergenic_mod(n1, n3, tinf);
+/* First position in a class list (of length n) at or after node 'min' */
+int first_node(int *list, int n, int min) {
+  int lo = 0, hi = n, mid;
+
+  while(lo < hi) {
+    mid = (lo+hi)/2;
+    if(list[mid] < min) lo = mid+1;
+    else hi = mid;
   }
+  return lo;
+}
 
-  /* 3'rev->3'rev, check for a start just to right of second 3' */
-  else if(n1->strand == -1 && n1->type == STOP && n2->strand == -1 && n2->type
-          == STOP) {
-    if(n1->stop_val <= n2->ndx) return;
-    if(n2->star_ptr[n1->ndx%3] == -1) return;
-    n3 = &(nod[n2->star_ptr[n1->ndx%3]]);
-    left -= 2; right = n3->ndx;
-    if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
-                  tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2];
-    else if(flag == 1) score = n3->cscore + n3->sscore +
-                       intergenic_mod(n3, n2, tinf);
+/* First position in a class list (of length n) with ndx >= 'ndx' */
+int first_ndx(struct _node *nod, int *list, int n, int ndx) {
+  int lo = 0, hi = n, mid;
+
+  while(lo < hi) {
+    mid = (lo+hi)/2;
+    if(nod[list[mid]].ndx < ndx) lo = mid+1;
+    else hi = mid;
   }
+  return lo;
+}
 
-  /***************************************/
-  /* Overlapping Opposite Strand 3' Ends */
-  /***************************************/
-
-  /* 3'for->5'rev */
-  else if(n1->strand == 1 && n1->type == STOP && n2->strand == -1 && n2->type
-          != STOP) {
-    if(n2->stop_val-2 >= n1->ndx+2) return;
-    ovlp = (n1->ndx+2) - (n2->stop_val-2) + 1;
-    if(ovlp >= MAX_OPP_OVLP) return;
-    if((n1->ndx+2 - n2->stop_val-2 + 1) >= (n2->ndx -n1->ndx+3 + 1)) return;
-    if(n1->traceb == -1) bnd = 0;
-    else bnd = nod[n1->traceb].ndx;
-    if((n1->ndx+2 - n2->stop_val-2 + 1) >= (n2->stop_val-3 - bnd + 1)) return;
-    left = n2->stop_val-2;
-    if(flag == 0) scr_mod = tinf->bias[0]*n2->gc_score[0] +
-                  tinf->bias[1]*n2->gc_score[1] + tinf->bias[2]*n2->gc_score[2];
-    else if(flag == 1) score = n2->cscore + n2->sscore - 0.15*tinf->st_wt;
+/*******************************************************************************
+  Of two candidate predecessors (-1 for none), the one with the higher score,
+  the later one on a tie.  Nodes that are edge artifacts (a 3'fwd or 5'rev
+  with no traceback) can't be connected from and never win.  The margin of
+  the comparison is kept in b's 'gap'.
+*******************************************************************************/
+int better_node(struct _node *nod, int a, int b) {
+  if(b == -1 || nod[b].traceb == -1) return a;
+  if(a == -1) return b;
+  if(fabs(nod[b].score - nod[a].score) < nod[b].gap)
+    nod[b].gap = fabs(nod[b].score - nod[a].score);
+  if(nod[b].score > nod[a].score) return b;
+  if(nod[b].score == nod[a].score && b > a) return b;
+  return a;
+}
+
+/*******************************************************************************
+  A max tree over the positions of a class list:  tree_set records node
+  'ndx' at list position 'pos', and tree_best returns the best node recorded
+  at positions [lo, hi).  'size' is the number of leaves (a power of 2).
+*******************************************************************************/
+void tree_set(struct _node *nod, int *tree, int size, int pos, int ndx) {
+  pos += size;
+  tree[pos] = ndx;
+  for(pos /= 2; pos >= 1; pos /= 2)
+    tree[pos] = better_node(nod, tree[2*pos], tree[2*pos+1]);
+}
+
+int tree_best(struct _node *nod, int *tree, int size, int lo, int hi) {
+  int best = -1;
+
+  for(lo += size, hi += size; lo < hi; lo /= 2, hi /= 2) {
+    if(lo & 1) best = better_node(nod, best, tree[lo++]);
+    if(hi & 1) best = better_node(nod, best, tree[--hi]);
   }
+  return best;
+}
 
-  if(flag == 0) score = ((double)(right-left+1-(ovlp*2)))*scr_mod;
+/*******************************************************************************
+  Class of a node for connection purposes: 0 = 5'fwd, 1 = 3'fwd, 2 = 5'rev,
+  3 = 3'rev.
+*******************************************************************************/
+int node_class(struct _node *nod) {
+  return (nod->strand == 1 ? 0 : 2) + (nod->type == STOP ? 1 : 0);
+}
+
+/*******************************************************************************
+  This routine scores the connection between two nodes, the most basic of which
+  is 5'fwd->3'fwd (gene) and 3'rev->5'rev (rev gene).  If the connection ending
+  at n2 is the maximal scoring model, it updates the pointers in the dynamic
+  programming model.  n3 is used to handle overlaps, i.e. cases where 5->3'
+  overlaps 5'->3' on the same strand.  In this case, 3' connects directly to 3',
+  and n3 is used to untangle the 5' end of the second gene.  Each kind of
+  connection has its own routine below; invalid connections (5'fwd->5'fwd,
+  3'rev->5'fwd, etc.) have none.
+*******************************************************************************/
+
+void score_connection(struct _node *nod, int p1, int p2, struct _training *tinf,
+                      int flag) {
+  conn_func conn = connect[node_class(&nod[p1])][node_class(&nod[p2])];
+
+  if(conn != NULL) conn(nod, p1, p2, tinf, flag);
+}
+
+/*******************************************************************************
+  Record the connection p1->p2 if it is the best one into p2 so far.  Ties
+  go to the later p1, so the result does not depend on the order in which
+  predecessors are tried.  The margin of the comparison is kept in p2's
+  'gap' (see join_segment).
+*******************************************************************************/
+void link_nodes(struct _node *nod, int p1, int p2, double score, int maxfr) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  double sc = n1->score + score;
 
-  if(n1->score + score >= n2->score) {
-    n2->score = n1->score + score;
+  if(fabs(sc - n2->score) < n2->gap) n2->gap = fabs(sc - n2->score);
+  if(sc > n2->score || (sc == n2->score && p1 > n2->traceb)) {
+    n2->score = sc;
     n2->traceb = p1;
     n2->ov_mark = maxfr;
   }
+}
+
+/*********/
+/* Genes */
+/*********/
+
+/* 5'fwd->3'fwd */
+void gene_fwd(struct _node *nod, int p1, int p2, struct _training *tinf,
+              int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left = n1->ndx, right = n2->ndx;
+  double score = 0.0, scr_mod = 0.0;
+
+  if(n2->stop_val >= n1->ndx) return;
+  if(n1->ndx % 3 != n2->ndx % 3) return;
+  right += 2;
+  if(flag == 0) scr_mod = tinf->bias[0]*n1->gc_score[0] +
+                tinf->bias[1]*n1->gc_score[1] + tinf->bias[2]*n1->gc_score[2];
+  else if(flag == 1) score = n1->cscore + n1->sscore;
+
+  if(flag == 0) score = ((double)(right-left+1))*scr_mod;
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/* 3'rev->5'rev */
+void gene_rev(struct _node *nod, int p1, int p2, struct _training *tinf,
+              int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left = n1->ndx, right = n2->ndx;
+  double score = 0.0, scr_mod = 0.0;
+
+  if(n1->stop_val <= n2->ndx) return;
+  if(n1->ndx % 3 != n2->ndx % 3) return;
+  left -= 2;
+  if(flag == 0) scr_mod = tinf->bias[0]*n2->gc_score[0] +
+                tinf->bias[1]*n2->gc_score[1] + tinf->bias[2]*n2->gc_score[2];
+  else if(flag == 1) score = n2->cscore + n2->sscore;
+
+  if(flag == 0) score = ((double)(right-left+1))*scr_mod;
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/*******************************************************************************
+  Intergenic Space (Noncoding).  A 3'fwd or 5'rev with no traceback is an
+  edge artifact and can't be connected from.
+*******************************************************************************/
+
+/* 3'fwd->5'fwd */
+void intergenic_fwd(struct _node *nod, int p1, int p2, struct _training *tinf,
+                    int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left = n1->ndx, right = n2->ndx;
+  double score = 0.0;
+
+  if(n1->traceb == -1) return;
+  left += 2;
+  if(left >= right) return;
+  if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/* 3'fwd->3'rev */
+void intergenic_fwd_rev(struct _node *nod, int p1, int p2, struct _training
+                        *tinf, int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]), *n3;
+  int i, left = n1->ndx, right = n2->ndx, ovlp = 0, maxfr = -1;
+  double score = 0.0, scr_mod = 0.0, maxval;
+
+  if(n1->traceb == -1) return;
+  left += 2; right -= 2;
+  if(left >= right) return;
+  /* Overlapping Gene Case 2: Three consecutive overlapping genes f r r */
+  maxfr = -1; maxval = 0.0;
+  for(i = 0; i < 3; i++) {
+    if(n2->star_ptr[i] == -1) continue;
+    n3 = &(nod[n2->star_ptr[i]]);
+    ovlp = left - n3->stop_val + 3;
+    if(ovlp <= 0 || ovlp >= MAX_OPP_OVLP) continue;
+    if(ovlp >= n3->ndx - left) continue;
+    if(ovlp >= n3->stop_val - nod[n1->traceb].ndx - 2) continue;
+    if((flag == 1 && n3->cscore + n3->sscore + intergenic_mod(n3, n2, tinf) >
+        maxval) || (flag == 0 && tinf->bias[0]*n3->gc_score[0] +
+        tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2] >
+        maxval)) {
+      maxfr = i;
+      maxval = n3->cscore + n3->sscore + intergenic_mod(n3, n2, tinf);
+    }
+  }
+  if(maxfr != -1) {
+    n3 = &(nod[n2->star_ptr[maxfr]]);
+    if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
+                  tinf->bias[1]*n3->gc_score[1] +
+                  tinf->bias[2]*n3->gc_score[2];
+    else if(flag == 1) score = n3->cscore + n3->sscore +
+            intergenic_mod(n3, n2, tinf);
+  }
+  else if(flag == 1) score = intergenic_mod(n1, n2, tinf);
 
-  return;
+  if(flag == 0) score = ((double)(right-left+1-(ovlp*2)))*scr_mod;
+  link_nodes(nod, p1, p2, score, maxfr);
+}
+
+/* 5'rev->3'rev */
+void intergenic_rev(struct _node *nod, int p1, int p2, struct _training *tinf,
+                    int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left = n1->ndx, right = n2->ndx;
+  double score = 0.0;
+
+  if(n1->traceb == -1) return;
+  right -= 2;
+  if(left >= right) return;
+  if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/* 5'rev->5'fwd */
+void intergenic_rev_fwd(struct _node *nod, int p1, int p2, struct _training
+                        *tinf, int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left = n1->ndx, right = n2->ndx;
+  double score = 0.0;
+
+  if(n1->traceb == -1) return;
+  if(left >= right) return;
+  if(flag == 1) score = intergenic_mod(n1, n2, tinf);
+
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/********************/
+/* Possible Operons */
+/********************/
+
+/* 3'fwd->3'fwd, check for a start just to left of first 3' */
+void operon_fwd(struct _node *nod, int p1, int p2, struct _training *tinf,
+                int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]), *n3;
+  int left, right = n2->ndx;
+  double score = 0.0, scr_mod = 0.0;
+
+  if(n1->traceb == -1) return;
+  if(n2->stop_val >= n1->ndx) return;
+  if(n1->star_ptr[n2->ndx%3] == -1) return;
+  n3 = &(nod[n1->star_ptr[n2->ndx%3]]);
+  left = n3->ndx; right += 2;
+  if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
+                tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2];
+  else if(flag == 1) score = n3->cscore + n3->sscore +
+                     intergenic_mod(n1, n3, tinf);
+
+  if(flag == 0) score = ((double)(right-left+1))*scr_mod;
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/* 3'rev->3'rev, check for a start just to right of second 3' */
+void operon_rev(struct _node *nod, int p1, int p2, struct _training *tinf,
+                int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]), *n3;
+  int left = n1->ndx, right;
+  double score = 0.0, scr_mod = 0.0;
+
+  if(n1->stop_val <= n2->ndx) return;
+  if(n2->star_ptr[n1->ndx%3] == -1) return;
+  n3 = &(nod[n2->star_ptr[n1->ndx%3]]);
+  left -= 2; right = n3->ndx;
+  if(flag == 0) scr_mod = tinf->bias[0]*n3->gc_score[0] +
+                tinf->bias[1]*n3->gc_score[1] + tinf->bias[2]*n3->gc_score[2];
+  else if(flag == 1) score = n3->cscore + n3->sscore +
+                     intergenic_mod(n3, n2, tinf);
+
+  if(flag == 0) score = ((double)(right-left+1))*scr_mod;
+  link_nodes(nod, p1, p2, score, -1);
+}
+
+/***************************************/
+/* Overlapping Opposite Strand 3' Ends */
+/***************************************/
+
+/* 3'for->5'rev */
+void overlap_fwd_rev(struct _node *nod, int p1, int p2, struct _training
+                     *tinf, int flag) {
+  struct _node *n1 = &(nod[p1]), *n2 = &(nod[p2]);
+  int left, right = n2->ndx, bnd, ovlp;
+  double score = 0.0, scr_mod = 0.0;
+
+  if(n1->traceb == -1) return;
+  if(n2->stop_val-2 >= n1->ndx+2) return;
+  ovlp = (n1->ndx+2) - (n2->stop_val-2) + 1;
+  if(ovlp >= MAX_OPP_OVLP) return;
+  if((n1->ndx+2 - n2->stop_val-2 + 1) >= (n2->ndx -n1->ndx+3 + 1)) return;
+  bnd = nod[n1->traceb].ndx;
+  if((n1->ndx+2 - n2->stop_val-2 + 1) >= (n2->stop_val-3 - bnd + 1)) return;
+  left = n2->stop_val-2;
+  if(flag == 0) scr_mod = tinf->bias[0]*n2->gc_score[0] +
+                tinf->bias[1]*n2->gc_score[1] + tinf->bias[2]*n2->gc_score[2];
+  else if(flag == 1) score = n2->cscore + n2->sscore - 0.15*tinf->st_wt;
+
+  if(flag == 0) score = ((double)(right-left+1-(ovlp*2)))*scr_mod;
+  link_nodes(nod, p1, p2, score, -1);
 }
 
 /*******************************************************************************
@@ -310,26 +760,36 @@ void eliminate_bad_genes(struct _node *nod, int dbeg, struct _training *tinf) {
   path = dbeg;
   while(nod[path].traceb != -1) path = nod[path].traceb;
   while(nod[path].tracef != -1) {
-    if(nod[path].strand == 1 && nod[path].type == STOP)
-      nod[nod[path].tracef].sscore += intergenic_mod(&nod[path],
-                                      &nod[nod[path].tracef], tinf);
-    if(nod[path].strand == -1 && nod[path].type != STOP)
-      nod[path].sscore += intergenic_mod(&nod[path], &nod[nod[path].tracef],
-                          tinf);
+    intergenic_adjust(nod, path, tinf);
     path = nod[path].tracef;
   }
 
   path = dbeg;
   while(nod[path].traceb != -1) path = nod[path].traceb;
   while(nod[path].tracef != -1) {
-    if(nod[path].strand == 1 && nod[path].type != STOP &&
-       nod[path].cscore + nod[path].sscore < 0) {
-      nod[path].elim = 1; nod[nod[path].tracef].elim = 1;
-    }
-    if(nod[path].strand == -1 && nod[path].type == STOP &&
-       nod[nod[path].tracef].cscore + nod[nod[path].tracef].sscore < 0) {
-      nod[path].elim = 1; nod[nod[path].tracef].elim = 1;
-    }
+    mark_bad_gene(nod, path);
     path = nod[path].tracef;
   }
 }
+
+/* Add the intergenic score between 'path' and the next node to its start */
+void intergenic_adjust(struct _node *nod, int path, struct _training *tinf) {
+  if(nod[path].strand == 1 && nod[path].type == STOP)
+    nod[nod[path].tracef].sscore += intergenic_mod(&nod[path],
+                                    &nod[nod[path].tracef], tinf);
+  if(nod[path].strand == -1 && nod[path].type != STOP)
+    nod[path].sscore += intergenic_mod(&nod[path], &nod[nod[path].tracef],
+                        tinf);
+}
+
+/* Mark the gene starting at 'path' (in node order) if it scores below 0 */
+void mark_bad_gene(struct _node *nod, int path) {
+  if(nod[path].strand == 1 && nod[path].type != STOP &&
+     nod[path].cscore + nod[path].sscore < 0) {
+    nod[path].elim = 1; nod[nod[path].tracef].elim = 1;
+  }
+  if(nod[path].strand == -1 && nod[path].type == STOP &&
+     nod[nod[path].tracef].cscore + nod[nod[path].tracef].sscore < 0) {
+    nod[path].elim = 1; nod[nod[path].tracef].elim = 1;
+  }
+}
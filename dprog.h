@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include "sequence.h"
 #include "node.h"
 
@@ -30,8 +31,52 @@
 #define MAX_OPP_OVLP 200
 #define MAX_NODE_DIST 500
 
-int dprog(struct _node *, int, struct _training *, int);
+#define DP_RELATIVE -2
+#define DP_FLOOR -1.0e30
+
+/* Scores one kind of connection between two nodes */
+typedef void (*conn_func)(struct _node *, int, int, struct _training *, int);
+
+/* Independent segments of one exact dynamic programming run */
+struct _dp_job {
+  struct _node *nod;
+  struct _training *tinf;
+  int flag;
+  int *seg;         /* Segment s is nodes seg[s] to seg[s+1]-1 */
+};
+
+int dprog(struct _node *, int, struct _training *, int, int, mask *, int);
+void dprog_fill(struct _node *, int, struct _training *, int, int, mask *,
+                int, int);
+int dprog_trace(struct _node *, int);
+void untangle_path(struct _node *, int, int);
+void window_connections(struct _node *, int, struct _training *, int, int);
+int *class_lists(struct _node *, int, int, int **, int *);
+void exact_segments(struct _node *, int, struct _training *, int, mask *,
+                    int);
+void segment_range(void *, int, int);
+void join_segment(struct _node *, int, int, int, struct _training *, int);
+void exact_connections(struct _node *, int, int, struct _training *, int,
+                       int);
+int first_node(int *, int, int);
+int first_ndx(struct _node *, int *, int, int);
+int better_node(struct _node *, int, int);
+void tree_set(struct _node *, int *, int, int, int);
+int tree_best(struct _node *, int *, int, int, int);
+int node_class(struct _node *);
 void score_connection(struct _node *, int, int, struct _training *, int);
+void link_nodes(struct _node *, int, int, double, int);
+void gene_fwd(struct _node *, int, int, struct _training *, int);
+void gene_rev(struct _node *, int, int, struct _training *, int);
+void intergenic_fwd(struct _node *, int, int, struct _training *, int);
+void intergenic_fwd_rev(struct _node *, int, int, struct _training *, int);
+void intergenic_rev(struct _node *, int, int, struct _training *, int);
+void intergenic_rev_fwd(struct _node *, int, int, struct _training *, int);
+void operon_fwd(struct _node *, int, int, struct _training *, int);
+void operon_rev(struct _node *, int, int, struct _training *, int);
+void overlap_fwd_rev(struct _node *, int, int, struct _training *, int);
 void eliminate_bad_genes(struct _node *, int, struct _training *);
+void intergenic_adjust(struct _node *, int, struct _training *);
+void mark_bad_gene(struct _node *, int);
 
 #endif
@@ -20,6 +20,23 @@
 
 #include "gene.h"
 
+/* Text for the start types and the RBS motif bins in rbs_wt */
+static const char type_string[4][5] = { "ATG", "GTG", "TTG" , "Edge" };
+static const char sd_string[28][16] = {
+  "None", "GGA/GAG/AGG", "3Base/5BMM", "4Base/6BMM", "AGxAG", "AGxAG",
+  "GGA/GAG/AGG", "GGxGG", "GGxGG", "AGxAG", "AGGAG(G)/GGAGG",
+  "AGGA/GGAG/GAGG", "AGGA/GGAG/GAGG", "GGA/GAG/AGG", "GGxGG", "AGGA",
+  "GGAG/GAGG", "AGxAGG/AGGxGG", "AGxAGG/AGGxGG", "AGxAGG/AGGxGG",
+  "AGGAG/GGAGG", "AGGAG", "AGGAG", "GGAGG", "GGAGG", "AGGAGG", "AGGAGG",
+  "AGGAGG"
+};
+static const char sd_spacer[28][8] = {
+  "None", "3-4bp", "13-15bp", "13-15bp", "11-12bp", "3-4bp", "11-12bp",
+  "11-12bp", "3-4bp", "5-10bp", "13-15bp", "3-4bp", "11-12bp", "5-10bp",
+  "5-10bp", "5-10bp", "5-10bp", "11-12bp", "3-4bp", "5-10bp", "11-12bp",
+  "3-4bp", "5-10bp", "3-4bp", "5-10bp", "11-12bp", "3-4bp", "5-10bp"
+};
+
 /* Copies genes from the dynamic programming to a final array */
 
 int add_genes(struct _gene *glist, struct _node *nod, int dbeg) {
@@ -30,25 +47,7 @@ int add_genes(struct _gene *glist, struct _node *nod, int dbeg) {
   while(nod[path].traceb != -1) path = nod[path].traceb;
 
   while(path != -1) {
-    if(nod[path].elim == 1) { path = nod[path].tracef; continue; }
-    if(nod[path].strand == 1 && nod[path].type != STOP) {
-      glist[ctr].begin = nod[path].ndx+1;
-      glist[ctr].start_ndx = path;
-    }
-    if(nod[path].strand == -1 && nod[path].type == STOP) {
-      glist[ctr].begin = nod[path].ndx-1;
-      glist[ctr].stop_ndx = path;
-    }
-    if(nod[path].strand == 1 && nod[path].type == STOP) {
-      glist[ctr].end = nod[path].ndx+3;
-      glist[ctr].stop_ndx = path;
-      ctr++;
-    }
-    if(nod[path].strand == -1 && nod[path].type != STOP) {
-      glist[ctr].end = nod[path].ndx+1;
-      glist[ctr].start_ndx = path;
-      ctr++;
-    }
+    ctr = add_gene_node(glist, ctr, nod, path);
     path = nod[path].tracef;
     if(ctr == MAX_GENES) {
       fprintf(stderr, "warning, max # of genes exceeded, truncating...\n");
@@ -58,6 +57,33 @@ int add_genes(struct _gene *glist, struct _node *nod, int dbeg) {
   return ctr;
 }
 
+/*******************************************************************************
+  Add node 'path' of the final path to gene 'ctr' of the list, and return
+  the number of genes that are complete afterwards.
+*******************************************************************************/
+int add_gene_node(struct _gene *glist, int ctr, struct _node *nod, int path) {
+  if(nod[path].elim == 1) return ctr;
+  if(nod[path].strand == 1 && nod[path].type != STOP) {
+    glist[ctr].begin = nod[path].ndx+1;
+    glist[ctr].start_ndx = path;
+  }
+  if(nod[path].strand == -1 && nod[path].type == STOP) {
+    glist[ctr].begin = nod[path].ndx-1;
+    glist[ctr].stop_ndx = path;
+  }
+  if(nod[path].strand == 1 && nod[path].type == STOP) {
+    glist[ctr].end = nod[path].ndx+3;
+    glist[ctr].stop_ndx = path;
+    ctr++;
+  }
+  if(nod[path].strand == -1 && nod[path].type != STOP) {
+    glist[ctr].end = nod[path].ndx+1;
+    glist[ctr].start_ndx = path;
+    ctr++;
+  }
+  return ctr;
+}
+
 /*******************************************************************************
   This routine attempts to solve the problem of extremely close starts.  If two
   potential starts are 5 amino acids or less away from each other, this routine
@@ -74,192 +100,144 @@ int add_genes(struct _gene *glist, struct _node *nod, int dbeg) {
 *******************************************************************************/
 void tweak_final_starts(struct _gene *genes, int ng, struct _node *nod,
                         int nn, struct _training *tinf) {
-  int i, j, ndx, mndx, maxndx[2];
+  int i;
+
+  for(i = 0; i < ng; i++) tweak_start(genes, ng, i, nod, tinf);
+}
+
+/*******************************************************************************
+  Tweak the start of gene 'i'.  Only genes i-1 and i+1 are looked at, so
+  this can be done as soon as gene i+1 is known (if there is one).
+*******************************************************************************/
+void tweak_start(struct _gene *genes, int ng, int i, struct _node *nod,
+                 struct _training *tinf) {
+  int j, ndx, mndx, maxndx[2];
   double sc, igm, tigm, maxsc[2], maxigm[2];
 
-  for(i = 0; i < ng; i++) {
-    ndx = genes[i].start_ndx;
-    sc = nod[ndx].sscore + nod[ndx].cscore;
-    igm = 0.0;
-    if(i > 0 && nod[ndx].strand == 1 && nod[genes[i-1].start_ndx].strand == 1)
-      igm = intergenic_mod(&nod[genes[i-1].stop_ndx], &nod[ndx], tinf);
-    if(i > 0 && nod[ndx].strand == 1 && nod[genes[i-1].start_ndx].strand == -1)
-      igm = intergenic_mod(&nod[genes[i-1].start_ndx], &nod[ndx], tinf);
-    if(i < ng-1 && nod[ndx].strand == -1 && nod[genes[i+1].start_ndx].strand 
-       == 1)
-      igm = intergenic_mod(&nod[ndx], &nod[genes[i+1].start_ndx], tinf);
-    if(i < ng-1 && nod[ndx].strand == -1 && nod[genes[i+1].start_ndx].strand 
-       == -1)
-      igm = intergenic_mod(&nod[ndx], &nod[genes[i+1].stop_ndx], tinf);
-
-    /* Search upstream and downstream for the #2 and #3 scoring starts */
-    maxndx[0] = -1; maxndx[1] = -1; maxsc[0] = 0; maxsc[1] = 0;
-    maxigm[0] = 0; maxigm[1] = 0;
-    for(j = ndx-100; j < ndx+100; j++) {
-      if(j < 0 || j >= nn || j == ndx) continue;
-      if(nod[j].type == STOP || nod[j].stop_val != nod[ndx].stop_val)
-        continue;
-
-      tigm = 0.0;
-      if(i > 0 && nod[j].strand == 1 && nod[genes[i-1].start_ndx].strand == 1)
-      {
-        if(nod[genes[i-1].stop_ndx].ndx - nod[j].ndx > MAX_SAM_OVLP) continue;
-        tigm = intergenic_mod(&nod[genes[i-1].stop_ndx], &nod[j], tinf);
-      }
-      if(i > 0 && nod[j].strand == 1 && nod[genes[i-1].start_ndx].strand == -1)
-      {
-        if(nod[genes[i-1].start_ndx].ndx - nod[j].ndx >= 0) continue;
-        tigm = intergenic_mod(&nod[genes[i-1].start_ndx], &nod[j], tinf);
-      }
-      if(i < ng-1 && nod[j].strand == -1 && nod[genes[i+1].start_ndx].strand 
-         == 1) {
-        if(nod[j].ndx - nod[genes[i+1].start_ndx].ndx >= 0) continue;
-        tigm = intergenic_mod(&nod[j], &nod[genes[i+1].start_ndx], tinf);
-      }
-      if(i < ng-1 && nod[j].strand == -1 && nod[genes[i+1].start_ndx].strand 
-         == -1) {
-        if(nod[j].ndx - nod[genes[i+1].stop_ndx].ndx > MAX_SAM_OVLP) continue;
-        tigm = intergenic_mod(&nod[j], &nod[genes[i+1].stop_ndx], tinf);
-      }
+  ndx = genes[i].start_ndx;
+  sc = nod[ndx].sscore + nod[ndx].cscore;
+  igm = 0.0;
+  if(i > 0 && nod[ndx].strand == 1 && nod[genes[i-1].start_ndx].strand == 1)
+    igm = intergenic_mod(&nod[genes[i-1].stop_ndx], &nod[ndx], tinf);
+  if(i > 0 && nod[ndx].strand == 1 && nod[genes[i-1].start_ndx].strand == -1)
+    igm = intergenic_mod(&nod[genes[i-1].start_ndx], &nod[ndx], tinf);
+  if(i < ng-1 && nod[ndx].strand == -1 && nod[genes[i+1].start_ndx].strand 
+     == 1)
+    igm = intergenic_mod(&nod[ndx], &nod[genes[i+1].start_ndx], tinf);
+  if(i < ng-1 && nod[ndx].strand == -1 && nod[genes[i+1].start_ndx].strand 
+     == -1)
+    igm = intergenic_mod(&nod[ndx], &nod[genes[i+1].stop_ndx], tinf);
+
+  /* Search upstream and downstream for the #2 and #3 scoring starts */
+  maxndx[0] = -1; maxndx[1] = -1; maxsc[0] = 0; maxsc[1] = 0;
+  maxigm[0] = 0; maxigm[1] = 0;
+  for(j = nod[nod[ndx].stop_ptr].stop_ptr; j != -1 && j < ndx+100;
+      j = nod[j].next_start) {
+    if(j < ndx-100 || j == ndx) continue;
+
+    tigm = 0.0;
+    if(i > 0 && nod[j].strand == 1 && nod[genes[i-1].start_ndx].strand == 1)
+    {
+      if(nod[genes[i-1].stop_ndx].ndx - nod[j].ndx > MAX_SAM_OVLP) continue;
+      tigm = intergenic_mod(&nod[genes[i-1].stop_ndx], &nod[j], tinf);
+    }
+    if(i > 0 && nod[j].strand == 1 && nod[genes[i-1].start_ndx].strand == -1)
+    {
+      if(nod[genes[i-1].start_ndx].ndx - nod[j].ndx >= 0) continue;
+      tigm = intergenic_mod(&nod[genes[i-1].start_ndx], &nod[j], tinf);
+    }
+    if(i < ng-1 && nod[j].strand == -1 && nod[genes[i+1].start_ndx].strand 
+       == 1) {
+      if(nod[j].ndx - nod[genes[i+1].start_ndx].ndx >= 0) continue;
+      tigm = intergenic_mod(&nod[j], &nod[genes[i+1].start_ndx], tinf);
+    }
+    if(i < ng-1 && nod[j].strand == -1 && nod[genes[i+1].start_ndx].strand 
+       == -1) {
+      if(nod[j].ndx - nod[genes[i+1].stop_ndx].ndx > MAX_SAM_OVLP) continue;
+      tigm = intergenic_mod(&nod[j], &nod[genes[i+1].stop_ndx], tinf);
+    }
  
-      if(maxndx[0] == -1) {
-        maxndx[0] = j;
-        maxsc[0] = nod[j].cscore + nod[j].sscore;
-        maxigm[0] = tigm;
-      }
-      else if(nod[j].cscore + nod[j].sscore + tigm > maxsc[0]) {
-        maxndx[1] = maxndx[0];
-        maxsc[1] = maxsc[0];
-        maxigm[1] = maxigm[0];
-        maxndx[0] = j;
-        maxsc[0] = nod[j].cscore + nod[j].sscore;
-        maxigm[0] = tigm;
-      }
-      else if(maxndx[1] == -1 || nod[j].cscore + nod[j].sscore + tigm > 
-              maxsc[1]) { 
-        maxndx[1] = j;
-        maxsc[1] = nod[j].cscore + nod[j].sscore;
-        maxigm[1] = tigm;
-      }
+    if(maxndx[0] == -1) {
+      maxndx[0] = j;
+      maxsc[0] = nod[j].cscore + nod[j].sscore;
+      maxigm[0] = tigm;
     }
+    else if(nod[j].cscore + nod[j].sscore + tigm > maxsc[0]) {
+      maxndx[1] = maxndx[0];
+      maxsc[1] = maxsc[0];
+      maxigm[1] = maxigm[0];
+      maxndx[0] = j;
+      maxsc[0] = nod[j].cscore + nod[j].sscore;
+      maxigm[0] = tigm;
+    }
+    else if(maxndx[1] == -1 || nod[j].cscore + nod[j].sscore + tigm > 
+            maxsc[1]) { 
+      maxndx[1] = j;
+      maxsc[1] = nod[j].cscore + nod[j].sscore;
+      maxigm[1] = tigm;
+    }
+  }
 
-    /* Change the start if it's a TTG with better coding/RBS/upstream score */
-    /* Also change the start if it's <=15bp but has better coding/RBS       */
-    for(j = 0; j < 2; j++) {
-      mndx = maxndx[j];
-      if(mndx == -1) continue;
-
-      /* Start of less common type but with better coding, rbs, and */
-      /* upstream.  Must be 18 or more bases away from original.    */
-      if(nod[mndx].tscore < nod[ndx].tscore && maxsc[j]-nod[mndx].tscore >= 
-         sc-nod[ndx].tscore+tinf->st_wt && nod[mndx].rscore > nod[ndx].rscore
-         && nod[mndx].uscore > nod[ndx].uscore && nod[mndx].cscore > 
-         nod[ndx].cscore && abs(nod[mndx].ndx-nod[ndx].ndx) > 15) {
-        maxsc[j] += nod[ndx].tscore-nod[mndx].tscore;
-      }
-
-      /* Close starts.  Ignore coding and see if start has better rbs */
-      /* and type. */
-      else if(abs(nod[mndx].ndx-nod[ndx].ndx) <= 15 && nod[mndx].rscore+
-              nod[mndx].tscore > nod[ndx].rscore+nod[ndx].tscore &&
-              nod[ndx].edge == 0 && nod[mndx].edge == 0) {
-        if(nod[ndx].cscore > nod[mndx].cscore) 
-          maxsc[j] += nod[ndx].cscore - nod[mndx].cscore;
-        if(nod[ndx].uscore > nod[mndx].uscore) 
-          maxsc[j] += nod[ndx].uscore - nod[mndx].uscore;
-        if(igm > maxigm[j]) maxsc[j] += igm - maxigm[j]; 
-      }
-  
-      else maxsc[j] = -1000.0;
+  /* Change the start if it's a TTG with better coding/RBS/upstream score */
+  /* Also change the start if it's <=15bp but has better coding/RBS       */
+  for(j = 0; j < 2; j++) {
+    mndx = maxndx[j];
+    if(mndx == -1) continue;
+
+    /* Start of less common type but with better coding, rbs, and */
+    /* upstream.  Must be 18 or more bases away from original.    */
+    if(nod[mndx].tscore < nod[ndx].tscore && maxsc[j]-nod[mndx].tscore >= 
+       sc-nod[ndx].tscore+tinf->st_wt && nod[mndx].rscore > nod[ndx].rscore
+       && nod[mndx].uscore > nod[ndx].uscore && nod[mndx].cscore > 
+       nod[ndx].cscore && abs(nod[mndx].ndx-nod[ndx].ndx) > 15) {
+      maxsc[j] += nod[ndx].tscore-nod[mndx].tscore;
     }
 
-    /* Change the gene coordinates to the new maximum. */
-    mndx = -1;
-    for(j = 0; j < 2; j++) {
-      if(maxndx[j] == -1) continue;
-      if(mndx == -1 && maxsc[j]+maxigm[j] > sc+igm)
-        mndx = j;
-      else if(mndx >= 0 && maxsc[j]+maxigm[j] > maxsc[mndx]+maxigm[mndx])
-        mndx = j; 
+    /* Close starts.  Ignore coding and see if start has better rbs */
+    /* and type. */
+    else if(abs(nod[mndx].ndx-nod[ndx].ndx) <= 15 && nod[mndx].rscore+
+            nod[mndx].tscore > nod[ndx].rscore+nod[ndx].tscore &&
+            nod[ndx].edge == 0 && nod[mndx].edge == 0) {
+      if(nod[ndx].cscore > nod[mndx].cscore) 
+        maxsc[j] += nod[ndx].cscore - nod[mndx].cscore;
+      if(nod[ndx].uscore > nod[mndx].uscore) 
+        maxsc[j] += nod[ndx].uscore - nod[mndx].uscore;
+      if(igm > maxigm[j]) maxsc[j] += igm - maxigm[j]; 
     }
-    if(mndx != -1 && nod[maxndx[mndx]].strand == 1) {
-      genes[i].start_ndx = maxndx[mndx];
-      genes[i].begin = nod[maxndx[mndx]].ndx+1;
-    } 
-    else if(mndx != -1 && nod[maxndx[mndx]].strand == -1) {
-      genes[i].start_ndx = maxndx[mndx];
-      genes[i].end = nod[maxndx[mndx]].ndx+1;
-    } 
+
+    else maxsc[j] = -1000.0;
+  }
+
+  /* Change the gene coordinates to the new maximum. */
+  mndx = -1;
+  for(j = 0; j < 2; j++) {
+    if(maxndx[j] == -1) continue;
+    if(mndx == -1 && maxsc[j]+maxigm[j] > sc+igm)
+      mndx = j;
+    else if(mndx >= 0 && maxsc[j]+maxigm[j] > maxsc[mndx]+maxigm[mndx])
+      mndx = j; 
   }
+  if(mndx != -1 && nod[maxndx[mndx]].strand == 1) {
+    genes[i].start_ndx = maxndx[mndx];
+    genes[i].begin = nod[maxndx[mndx]].ndx+1;
+  } 
+  else if(mndx != -1 && nod[maxndx[mndx]].strand == -1) {
+    genes[i].start_ndx = maxndx[mndx];
+    genes[i].end = nod[maxndx[mndx]].ndx+1;
+  } 
 }
 
+/*******************************************************************************
+  Records the numeric data (partial flags, start type, RBS motif, gc content
+  and scores) for each gene.  Text is produced later by print_gene_data and
+  print_score_data when the genes are actually written out, so rerunning this
+  routine for each candidate bin in metagenomic mode costs no formatting.
+*******************************************************************************/
 void record_gene_data(struct _gene *genes, int ng, struct _node *nod,
-                      struct _training *tinf, int sctr) {
-
-  int i, ndx, sndx, partial_left, partial_right, st_type;
-  double rbs1, rbs2, confidence;
-  char sd_string[28][100], sd_spacer[28][20], qt[10];
-  char type_string[4][5] = { "ATG", "GTG", "TTG" , "Edge" };
-
-  /* Initialize RBS string information for default SD */
-  strcpy(sd_string[0], "None");
-  strcpy(sd_spacer[0], "None");
-  strcpy(sd_string[1], "GGA/GAG/AGG");
-  strcpy(sd_spacer[1], "3-4bp");
-  strcpy(sd_string[2], "3Base/5BMM");
-  strcpy(sd_spacer[2], "13-15bp");
-  strcpy(sd_string[3], "4Base/6BMM");
-  strcpy(sd_spacer[3], "13-15bp");
-  strcpy(sd_string[4], "AGxAG");
-  strcpy(sd_spacer[4], "11-12bp");
-  strcpy(sd_string[5], "AGxAG");
-  strcpy(sd_spacer[5], "3-4bp");
-  strcpy(sd_string[6], "GGA/GAG/AGG");
-  strcpy(sd_spacer[6], "11-12bp");
-  strcpy(sd_string[7], "GGxGG");
-  strcpy(sd_spacer[7], "11-12bp");
-  strcpy(sd_string[8], "GGxGG");
-  strcpy(sd_spacer[8], "3-4bp");
-  strcpy(sd_string[9], "AGxAG");
-  strcpy(sd_spacer[9], "5-10bp");
-  strcpy(sd_string[10], "AGGAG(G)/GGAGG");
-  strcpy(sd_spacer[10], "13-15bp");
-  strcpy(sd_string[11], "AGGA/GGAG/GAGG");
-  strcpy(sd_spacer[11], "3-4bp");
-  strcpy(sd_string[12], "AGGA/GGAG/GAGG");
-  strcpy(sd_spacer[12], "11-12bp");
-  strcpy(sd_string[13], "GGA/GAG/AGG");
-  strcpy(sd_spacer[13], "5-10bp");
-  strcpy(sd_string[14], "GGxGG");
-  strcpy(sd_spacer[14], "5-10bp");
-  strcpy(sd_string[15], "AGGA");
-  strcpy(sd_spacer[15], "5-10bp");
-  strcpy(sd_string[16], "GGAG/GAGG");
-  strcpy(sd_spacer[16], "5-10bp");
-  strcpy(sd_string[17], "AGxAGG/AGGxGG");
-  strcpy(sd_spacer[17], "11-12bp");
-  strcpy(sd_string[18], "AGxAGG/AGGxGG");
-  strcpy(sd_spacer[18], "3-4bp");
-  strcpy(sd_string[19], "AGxAGG/AGGxGG");
-  strcpy(sd_spacer[19], "5-10bp");
-  strcpy(sd_string[20], "AGGAG/GGAGG");
-  strcpy(sd_spacer[20], "11-12bp");
-  strcpy(sd_string[21], "AGGAG");
-  strcpy(sd_spacer[21], "3-4bp");
-  strcpy(sd_string[22], "AGGAG");
-  strcpy(sd_spacer[22], "5-10bp");
-  strcpy(sd_string[23], "GGAGG");
-  strcpy(sd_spacer[23], "3-4bp");
-  strcpy(sd_string[24], "GGAGG");
-  strcpy(sd_spacer[24], "5-10bp");
-  strcpy(sd_string[25], "AGGAGG");
-  strcpy(sd_spacer[25], "11-12bp");
-  strcpy(sd_string[26], "AGGAGG");
-  strcpy(sd_spacer[26], "3-4bp");
-  strcpy(sd_string[27], "AGGAGG");
-  strcpy(sd_spacer[27], "5-10bp");
-
-  char buffer[500] = {0};
+                      struct _training *tinf) {
+
+  int i, ndx, sndx;
+  double rbs1, rbs2;
 
   for(i = 0; i < ng; i++) {
     ndx = genes[i].start_ndx;
@@ -268,80 +246,91 @@ void record_gene_data(struct _gene *genes, int ng, struct _node *nod,
     /* Record basic gene data */
     if((nod[ndx].edge == 1 && nod[ndx].strand == 1) ||
        (nod[sndx].edge == 1 && nod[ndx].strand == -1))
-      partial_left = 1;
-    else partial_left = 0;
+      genes[i].partial_left = 1;
+    else genes[i].partial_left = 0;
     if((nod[sndx].edge == 1 && nod[ndx].strand == 1) ||
        (nod[ndx].edge == 1 && nod[ndx].strand == -1))
-      partial_right = 1;
-    else partial_right = 0;
-    if(nod[ndx].edge == 1) st_type = 3;
-    else st_type = nod[ndx].type;
-
-    sprintf(genes[i].gene_data, "ID=%d_%d;partial=%d%d;start_type=%s;", sctr, 
-            i+1, partial_left, partial_right, type_string[st_type]);
+      genes[i].partial_right = 1;
+    else genes[i].partial_right = 0;
+    if(nod[ndx].edge == 1) genes[i].st_type = 3;
+    else genes[i].st_type = nod[ndx].type;
 
     /* Record rbs data */
     rbs1 = tinf->rbs_wt[nod[ndx].rbs[0]]*tinf->st_wt;
     rbs2 = tinf->rbs_wt[nod[ndx].rbs[1]]*tinf->st_wt;
+    genes[i].mot_len = nod[ndx].mot.len;
+    genes[i].mot_ndx = nod[ndx].mot.ndx;
+    genes[i].mot_spacer = nod[ndx].mot.spacer;
     if(tinf->uses_sd == 1) {
-      if(rbs1 > rbs2) {
-        sprintf(buffer, "rbs_motif=%s;rbs_spacer=%s",
-                sd_string[nod[ndx].rbs[0]],
-                sd_spacer[nod[ndx].rbs[0]]);
-        strcat(genes[i].gene_data, buffer);
-      } else {
-        sprintf(buffer, "rbs_motif=%s;rbs_spacer=%s",
-                sd_string[nod[ndx].rbs[1]],
-                sd_spacer[nod[ndx].rbs[1]]);
-        strcat(genes[i].gene_data, buffer);
-      }
+      if(rbs1 > rbs2) genes[i].rbs_ndx = nod[ndx].rbs[0];
+      else genes[i].rbs_ndx = nod[ndx].rbs[1];
     }
     else {
-      mer_text(qt, nod[ndx].mot.len, nod[ndx].mot.ndx);
       if(tinf->no_mot > -0.5 && rbs1 > rbs2 && rbs1 > nod[ndx].mot.score *
-         tinf->st_wt) {
-        sprintf(buffer, "rbs_motif=%s;rbs_spacer=%s",
-                sd_string[nod[ndx].rbs[0]],
-                sd_spacer[nod[ndx].rbs[0]]);
-        strcat(genes[i].gene_data, buffer);
-      } else if(tinf->no_mot > -0.5 && rbs2 >= rbs1 && rbs2 > nod[ndx].mot.score *
-              tinf->st_wt) {
-        sprintf(buffer, "rbs_motif=%s;rbs_spacer=%s",
-                sd_string[nod[ndx].rbs[1]],
-                sd_spacer[nod[ndx].rbs[1]]);
-        strcat(genes[i].gene_data, buffer);
-      } else if(nod[ndx].mot.len == 0) {
-        strcat(genes[i].gene_data, "rbs_motif=None;rbs_spacer=None");
-      } else {
-        sprintf(buffer, "rbs_motif=%s;rbs_spacer=%dbp",
-                qt, nod[ndx].mot.spacer);
-        strcat(genes[i].gene_data, buffer);
-      }
+         tinf->st_wt)
+        genes[i].rbs_ndx = nod[ndx].rbs[0];
+      else if(tinf->no_mot > -0.5 && rbs2 >= rbs1 && rbs2 > nod[ndx].mot.score *
+              tinf->st_wt)
+        genes[i].rbs_ndx = nod[ndx].rbs[1];
+      else genes[i].rbs_ndx = -1;
     }
-    sprintf(buffer, ";gc_cont=%.3f", nod[ndx].gc_cont);
-    strcat(genes[i].gene_data, buffer);
+    genes[i].gc_cont = nod[ndx].gc_cont;
 
     /* Record score data */
-    confidence = calculate_confidence(nod[ndx].cscore + nod[ndx].sscore, 
-                                      tinf->st_wt);
-    sprintf(genes[i].score_data, 
-     "conf=%.2f;score=%.2f;cscore=%.2f;sscore=%.2f;rscore=%.2f;uscore=%.2f;",
-     confidence, nod[ndx].cscore+nod[ndx].sscore,nod[ndx].cscore, 
-     nod[ndx].sscore, nod[ndx].rscore, nod[ndx].uscore);
-
-    sprintf(buffer, "tscore=%.2f;", nod[ndx].tscore);
-    strcat(genes[i].score_data, buffer);
+    genes[i].conf = calculate_confidence(nod[ndx].cscore + nod[ndx].sscore, 
+                                         tinf->st_wt);
+    genes[i].cscore = nod[ndx].cscore;
+    genes[i].sscore = nod[ndx].sscore;
+    genes[i].rscore = nod[ndx].rscore;
+    genes[i].uscore = nod[ndx].uscore;
+    genes[i].tscore = nod[ndx].tscore;
   }
 
 }
 
+/* Write the gene information string (ID, partial, start, RBS, gc) */
+void print_gene_data(FILE *fp, struct _gene *gene, int sctr, int gnum) {
+  char qt[10];
+
+  fprintf(fp, "ID=%d_%d;partial=%d%d;start_type=%s;", sctr, gnum,
+          gene->partial_left, gene->partial_right, type_string[gene->st_type]);
+  if(gene->rbs_ndx != -1)
+    fprintf(fp, "rbs_motif=%s;rbs_spacer=%s", sd_string[gene->rbs_ndx],
+            sd_spacer[gene->rbs_ndx]);
+  else if(gene->mot_len == 0)
+    fprintf(fp, "rbs_motif=None;rbs_spacer=None");
+  else {
+    mer_text(qt, gene->mot_len, gene->mot_ndx);
+    fprintf(fp, "rbs_motif=%s;rbs_spacer=%dbp", qt, gene->mot_spacer);
+  }
+  fprintf(fp, ";gc_cont=%.3f", gene->gc_cont);
+}
+
+/* Write the gene scoring string */
+void print_score_data(FILE *fp, struct _gene *gene) {
+  fprintf(fp,
+    "conf=%.2f;score=%.2f;cscore=%.2f;sscore=%.2f;rscore=%.2f;uscore=%.2f;",
+    gene->conf, gene->cscore+gene->sscore, gene->cscore, gene->sscore,
+    gene->rscore, gene->uscore);
+  fprintf(fp, "tscore=%.2f;", gene->tscore);
+}
+
 /* Print the genes.  'Flag' indicates which format to use. */
 void print_genes(FILE *fp, struct _gene *genes, int ng, struct _node *nod, 
                  int slen, int flag, int sctr, int is_meta, char *mdesc,
                  struct _training *tinf, char *header, char *short_hdr,
                  char *version) {
-  int i, ndx, sndx;
-  char left[50], right[50];
+  print_genes_header(fp, slen, flag, sctr, is_meta, mdesc, tinf, header,
+                     version);
+  print_gene_lines(fp, genes, ng, nod, slen, flag, sctr, short_hdr, version,
+                   1);
+  print_genes_footer(fp, flag);
+}
+
+/* Print the sequence and model information that comes before the genes */
+void print_genes_header(FILE *fp, int slen, int flag, int sctr, int is_meta,
+                        char *mdesc, struct _training *tinf, char *header,
+                        char *version) {
   char seq_data[MAX_LINE*2], run_data[MAX_LINE];
   char buffer[MAX_LINE] = {0};
 
@@ -362,9 +351,6 @@ void print_genes(FILE *fp, struct _gene *genes, int ng, struct _node *nod,
           tinf->gc*100.0, tinf->trans_table, tinf->uses_sd);
   strcat(run_data, buffer);
 
-  strcpy(left, "");
-  strcpy(right, "");
-
   /* Print the gff header once */
   if(flag == 3 && sctr == 1) fprintf(fp, "##gff-version  3\n");
 
@@ -377,7 +363,18 @@ void print_genes(FILE *fp, struct _gene *genes, int ng, struct _node *nod,
     fprintf(fp, "# Sequence Data: %s\n", seq_data);
     fprintf(fp, "# Model Data: %s\n", run_data);
   }
-  
+}
+
+/* Print genes, numbering them from 'gnum' */
+void print_gene_lines(FILE *fp, struct _gene *genes, int ng, struct _node *nod,
+                      int slen, int flag, int sctr, char *short_hdr, char
+                      *version, int gnum) {
+  int i, ndx, sndx;
+  char left[50], right[50];
+
+  strcpy(left, "");
+  strcpy(right, "");
+
   /* Print the genes */
   for(i = 0; i < ng; i++) {
     ndx = genes[i].start_ndx;
@@ -394,20 +391,26 @@ void print_genes(FILE *fp, struct _gene *genes, int ng, struct _node *nod,
       if(flag == 0) {
         fprintf(fp, "     CDS             %s..%s\n", left, right);
         fprintf(fp, "                     ");
-        fprintf(fp, "/note=\"%s;%s\"\n", genes[i].gene_data,
-                genes[i].score_data);
+        fprintf(fp, "/note=\"");
+        print_gene_data(fp, &genes[i], sctr, gnum+i);
+        fprintf(fp, ";");
+        print_score_data(fp, &genes[i]);
+        fprintf(fp, "\"\n");
       }
       if(flag == 1)
-        fprintf(fp, "gene_prodigal=%d|1|f|y|y|3|0|%d|%d|%d|%d|-1|-1|1.0\n", i+1,
-                genes[i].begin, genes[i].end, genes[i].begin, genes[i].end);
-      if(flag == 2) fprintf(fp, ">%d_%d_%d_+\n", i+1, genes[i].begin, 
+        fprintf(fp, "gene_prodigal=%d|1|f|y|y|3|0|%d|%d|%d|%d|-1|-1|1.0\n",
+                gnum+i, genes[i].begin, genes[i].end, genes[i].begin,
+                genes[i].end);
+      if(flag == 2) fprintf(fp, ">%d_%d_%d_+\n", gnum+i, genes[i].begin, 
                             genes[i].end);
       if(flag == 3) {
-        fprintf(fp, "%s\tProdigal_v%s\tCDS\t%d\t%d\t%.1f\t+\t0\t%s;%s", 
+        fprintf(fp, "%s\tProdigal_v%s\tCDS\t%d\t%d\t%.1f\t+\t0\t", 
                 short_hdr, version, genes[i].begin, genes[i].end, 
-                nod[ndx].cscore+nod[ndx].sscore, genes[i].gene_data,
-                genes[i].score_data);
-        fprintf(fp, "\n"); 
+                nod[ndx].cscore+nod[ndx].sscore);
+        print_gene_data(fp, &genes[i], sctr, gnum+i);
+        fprintf(fp, ";");
+        print_score_data(fp, &genes[i]);
+        fprintf(fp, "\n");
       }
     }
     else {
@@ -420,41 +423,49 @@ void print_genes(FILE *fp, struct _gene *genes, int ng, struct _node *nod,
       if(flag == 0) {
         fprintf(fp, "     CDS             complement(%s..%s)\n", left, right);
         fprintf(fp, "                     ");
-        fprintf(fp, "/note=\"%s;%s\"\n", genes[i].gene_data,
-                genes[i].score_data);
+        fprintf(fp, "/note=\"");
+        print_gene_data(fp, &genes[i], sctr, gnum+i);
+        fprintf(fp, ";");
+        print_score_data(fp, &genes[i]);
+        fprintf(fp, "\"\n");
       }
       if(flag == 1)
-        fprintf(fp, "gene_prodigal=%d|1|r|y|y|3|0|%d|%d|%d|%d|-1|-1|1.0\n", i+1,
-               slen+1-genes[i].end, slen+1-genes[i].begin,
+        fprintf(fp, "gene_prodigal=%d|1|r|y|y|3|0|%d|%d|%d|%d|-1|-1|1.0\n",
+               gnum+i, slen+1-genes[i].end, slen+1-genes[i].begin,
                slen+1-genes[i].end, slen+1-genes[i].begin);
-      if(flag == 2) fprintf(fp, ">%d_%d_%d_-\n", i+1, genes[i].begin, 
+      if(flag == 2) fprintf(fp, ">%d_%d_%d_-\n", gnum+i, genes[i].begin, 
                             genes[i].end);
       if(flag == 3) {
-        fprintf(fp, "%s\tProdigal_v%s\tCDS\t%d\t%d\t%.1f\t-\t0\t%s;%s",
+        fprintf(fp, "%s\tProdigal_v%s\tCDS\t%d\t%d\t%.1f\t-\t0\t",
                 short_hdr, version, genes[i].begin, genes[i].end, 
-                nod[ndx].cscore+nod[ndx].sscore, genes[i].gene_data,
-                genes[i].score_data);
-        fprintf(fp, "\n"); 
+                nod[ndx].cscore+nod[ndx].sscore);
+        print_gene_data(fp, &genes[i], sctr, gnum+i);
+        fprintf(fp, ";");
+        print_score_data(fp, &genes[i]);
+        fprintf(fp, "\n");
       }
     }
   }
+}
 
-  /* Footer */
+/* Print whatever comes after the genes */
+void print_genes_footer(FILE *fp, int flag) {
   if(flag == 0) fprintf(fp, "//\n");
-
 }
 
-/* Print the gene translations */
+/* Print the gene translations, numbering the genes from 'gnum' */
 void write_translations(FILE *fh, struct _gene *genes, int ng, struct 
                         _node *nod, unsigned char *seq, unsigned char *rseq, 
                         unsigned char *useq, int slen, struct _training *tinf,
-                        int sctr, char *short_hdr) {
+                        int sctr, char *short_hdr, int gnum) {
   int i, j;
 
   for(i = 0; i < ng; i++) {
     if(nod[genes[i].start_ndx].strand == 1) {
-      fprintf(fh, ">%s_%d # %d # %d # 1 # %s\n", short_hdr, i+1,
-              genes[i].begin, genes[i].end, genes[i].gene_data);
+      fprintf(fh, ">%s_%d # %d # %d # 1 # ", short_hdr, gnum+i,
+              genes[i].begin, genes[i].end);
+      print_gene_data(fh, &genes[i], sctr, gnum+i);
+      fprintf(fh, "\n");
       for(j = genes[i].begin; j < genes[i].end; j+=3) {
         if(is_n(useq, j-1) == 1 || is_n(useq, j) == 1 || is_n(useq, j+1) == 1) 
           fprintf(fh, "X");
@@ -465,8 +476,10 @@ void write_translations(FILE *fh, struct _gene *genes, int ng, struct
       if((j-genes[i].begin)%180 != 0) fprintf(fh, "\n");
     }
     else {
-      fprintf(fh, ">%s_%d # %d # %d # -1 # %s\n", short_hdr, i+1,
-              genes[i].begin, genes[i].end, genes[i].gene_data);
+      fprintf(fh, ">%s_%d # %d # %d # -1 # ", short_hdr, gnum+i,
+              genes[i].begin, genes[i].end);
+      print_gene_data(fh, &genes[i], sctr, gnum+i);
+      fprintf(fh, "\n");
       for(j = slen+1-genes[i].end; j < slen+1-genes[i].begin; j+=3) {
         if(is_n(useq, slen-j) == 1 || is_n(useq, slen-1-j) == 1 ||
            is_n(useq, slen-2-j) == 1)
@@ -480,17 +493,19 @@ void write_translations(FILE *fh, struct _gene *genes, int ng, struct
   }
 }
 
-/* Print the gene nucleotide sequences */
+/* Print the gene nucleotide sequences, numbered from 'gnum' */
 void write_nucleotide_seqs(FILE *fh, struct _gene *genes, int ng, struct 
                            _node *nod, unsigned char *seq, unsigned char *rseq,
                            unsigned char *useq, int slen, struct _training 
-                           *tinf, int sctr, char *short_hdr) {
+                           *tinf, int sctr, char *short_hdr, int gnum) {
   int i, j;
 
   for(i = 0; i < ng; i++) {
     if(nod[genes[i].start_ndx].strand == 1) {
-      fprintf(fh, ">%s_%d # %d # %d # 1 # %s\n", short_hdr, i+1,
-              genes[i].begin, genes[i].end, genes[i].gene_data);
+      fprintf(fh, ">%s_%d # %d # %d # 1 # ", short_hdr, gnum+i,
+              genes[i].begin, genes[i].end);
+      print_gene_data(fh, &genes[i], sctr, gnum+i);
+      fprintf(fh, "\n");
       for(j = genes[i].begin-1; j < genes[i].end; j++) {
         if(is_a(seq, j) == 1) fprintf(fh, "A");
         else if(is_t(seq, j) == 1) fprintf(fh, "T");
@@ -502,8 +517,10 @@ void write_nucleotide_seqs(FILE *fh, struct _gene *genes, int ng, struct
       if((j-genes[i].begin+1)%70 != 0) fprintf(fh, "\n");
     }
     else {
-      fprintf(fh, ">%s_%d # %d # %d # -1 # %s\n", short_hdr, i+1,
-              genes[i].begin, genes[i].end, genes[i].gene_data);
+      fprintf(fh, ">%s_%d # %d # %d # -1 # ", short_hdr, gnum+i,
+              genes[i].begin, genes[i].end);
+      print_gene_data(fh, &genes[i], sctr, gnum+i);
+      fprintf(fh, "\n");
       for(j = slen-genes[i].end; j < slen+1-genes[i].begin; j++) {
         if(is_a(rseq, j) == 1) fprintf(fh, "A");
         else if(is_t(rseq, j) == 1) fprintf(fh, "T");
@@ -33,24 +33,44 @@ struct _gene {
   int end;                 /* Right end of the gene */
   int start_ndx;           /* Index to the start node in the nodes file */
   int stop_ndx;            /* Index to the stop node in the nodes file */
-  char gene_data[500];     /* String containing gene information */
-  char score_data[500];    /* String containing scoring information */
+  int partial_left;        /* 1 if the gene runs off the left edge */
+  int partial_right;       /* 1 if the gene runs off the right edge */
+  int st_type;             /* Start type (ATG, GTG, TTG, or 3 for Edge) */
+  int rbs_ndx;             /* SD motif index, or -1 for an upstream motif */
+  int mot_len;             /* Upstream motif length (0 = None) */
+  int mot_ndx;             /* Upstream motif index */
+  int mot_spacer;          /* Upstream motif spacer */
+  double gc_cont;          /* GC content of the gene */
+  double conf;             /* Confidence score */
+  double cscore;           /* Coding score */
+  double sscore;           /* Start score */
+  double rscore;           /* RBS score */
+  double uscore;           /* Upstream composition score */
+  double tscore;           /* Start codon type score */
 };
 
 int add_genes(struct _gene *, struct _node *, int);
-void record_gene_data(struct _gene *, int, struct _node *, struct _training *,
-                      int);
+int add_gene_node(struct _gene *, int, struct _node *, int);
+void record_gene_data(struct _gene *, int, struct _node *, struct _training *);
 void tweak_final_starts(struct _gene *, int, struct _node *, int, struct
                        _training *);
+void tweak_start(struct _gene *, int, int, struct _node *, struct _training *);
 
+void print_gene_data(FILE *, struct _gene *, int, int);
+void print_score_data(FILE *, struct _gene *);
 void print_genes(FILE *, struct _gene *, int, struct _node *, int, int, int,
                  int, char *, struct _training *, char *, char *, char *);
+void print_genes_header(FILE *, int, int, int, int, char *, struct _training *,
+                        char *, char *);
+void print_gene_lines(FILE *, struct _gene *, int, struct _node *, int, int,
+                      int, char *, char *, int);
+void print_genes_footer(FILE *, int);
 void write_translations(FILE *, struct _gene *, int, struct _node *, 
                         unsigned char *, unsigned char *, unsigned char *, int,
-                        struct _training *, int, char *);
+                        struct _training *, int, char *, int);
 void write_nucleotide_seqs(FILE *, struct _gene *, int, struct _node *, 
                            unsigned char *, unsigned char *, unsigned char *,
-                           int, struct _training *, int, char *);
+                           int, struct _training *, int, char *, int);
 double calculate_confidence(double, double);
 
 #endif
@@ -18,6 +18,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *******************************************************************************/
 
+#include <errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "sequence.h"
@@ -25,6 +26,10 @@
 #include "node.h"
 #include "dprog.h"
 #include "gene.h"
+#include "update.h"
+#include "stream.h"
+#include "trainfile.h"
+#include "contigs.h"
 
 #define VERSION "2.6.3"
 #define DATE "February, 2016"
@@ -39,21 +44,30 @@ int copy_standard_input_to_file(char *, int);
 
 int main(int argc, char *argv[]) {
 
-  int rv, slen, nn, ng, i, ipath, *gc_frame, do_training, output, max_phase;
-  int closed, do_mask, nmask, force_nonsd, user_tt, is_meta, num_seq, quiet;
-  int piped, max_slen, fnum;
-  double max_score, gc, low, high;
-  unsigned char *seq, *rseq, *useq;
+  int rv, slen, nn, i, ipath, *gc_frame, do_training, output, closed;
+  int do_mask, nmask, force_nonsd, user_tt, is_meta, num_seq, quiet, piped;
+  int max_slen, fnum, j, *gc_sum, nthr, exact_dp, win, sample, nctg;
+  int float_wt, cached, compact;
+  double gc, picked;
+  unsigned char *seq, *rseq, *useq, *pick;
   char *train_file, *start_file, *trans_file, *nuc_file; 
-  char *input_file, *output_file, input_copy[MAX_LINE];
+  char *input_file, *output_file, *upd_file, *log_file, input_copy[MAX_LINE];
+  char *cache_dir, *cache_file;
   char cur_header[MAX_LINE], new_header[MAX_LINE], short_header[MAX_LINE];
   FILE *input_ptr, *output_ptr, *start_ptr, *trans_ptr, *nuc_ptr;
+  FILE *out[NUM_OUT];
   struct stat fbuf;
   pid_t pid;
   struct _node *nodes;
-  struct _gene *genes;
   struct _training tinf;
+  struct _motif_table mtab;
   struct _metagenomic_bin meta[NUM_META];
+  struct _update upd;
+  struct _stream strm;
+  struct _finder fd;
+  struct _batch bat;
+  struct _train_ctl tctl;
+  struct _contig_stat *ctg;
   mask mlist[MAX_MASKS];
 
   /* Allocate memory and initialize variables */
@@ -61,36 +75,34 @@ int main(int argc, char *argv[]) {
   rseq = (unsigned char *)malloc(MAX_SEQ/4*sizeof(unsigned char));
   useq = (unsigned char *)malloc(MAX_SEQ/8*sizeof(unsigned char));
   nodes = (struct _node *)malloc(STT_NOD*sizeof(struct _node));
-  genes = (struct _gene *)malloc(MAX_GENES*sizeof(struct _gene));
-  if(seq == NULL || rseq == NULL || nodes == NULL || genes == NULL) {
+  if(seq == NULL || rseq == NULL || useq == NULL || nodes == NULL) {
     fprintf(stderr, "\nError: Malloc failed on sequence/orfs\n\n"); exit(1);
   }
   memset(seq, 0, MAX_SEQ/4*sizeof(unsigned char));
   memset(rseq, 0, MAX_SEQ/4*sizeof(unsigned char));
   memset(useq, 0, MAX_SEQ/8*sizeof(unsigned char));
   memset(nodes, 0, STT_NOD*sizeof(struct _node));
-  memset(genes, 0, MAX_GENES*sizeof(struct _gene));
   memset(&tinf, 0, sizeof(struct _training));
+  init_motif_table(&mtab);
 
   for(i = 0; i < NUM_META; i++) {
     memset(&meta[i], 0, sizeof(struct _metagenomic_bin));
     strcpy(meta[i].desc, "None");
-    meta[i].tinf = (struct _training *)malloc(sizeof(struct _training));
-    if(meta[i].tinf == NULL) {
-      fprintf(stderr, "\nError: Malloc failed on training structure.\n\n"); 
-      exit(1);
-    }
-    memset(meta[i].tinf, 0, sizeof(struct _training));
+    fd.mt_slot[i] = 0;
   }
-  nn = 0; slen = 0; ipath = 0; ng = 0; nmask = 0;
+  fd.nmt = 0;
+  nn = 0; slen = 0; ipath = 0; nmask = 0;
   user_tt = 0; is_meta = 0; num_seq = 0; quiet = 0;
-  max_phase = 0; max_score = -100.0;
   train_file = NULL; do_training = 0;
   start_file = NULL; trans_file = NULL; nuc_file = NULL;
   start_ptr = stdout; trans_ptr = stdout; nuc_ptr = stdout;
-  input_file = NULL; output_file = NULL; piped = 0;
+  input_file = NULL; output_file = NULL; upd_file = NULL; piped = 0;
   input_ptr = stdin; output_ptr = stdout; max_slen = 0;
-  output = 0; closed = 0; do_mask = 0; force_nonsd = 0;
+  output = 0; closed = 0; do_mask = 0; force_nonsd = 0; nthr = 1;
+  exact_dp = 0; win = 0; log_file = NULL; sample = 0; pick = NULL;
+  float_wt = 0; cache_dir = NULL; cache_file = NULL; cached = 0;
+  compact = 0;
+  tctl.strict = 0; tctl.tol = TRAIN_TOL; tctl.log = NULL;
 
   /* Filename for input copy if needed */
   pid = getpid();
@@ -111,17 +123,32 @@ int main(int argc, char *argv[]) {
   for(i = 1; i < argc; i++) {
     if(i == argc-1 && (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "-T") == 0
        || strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "-A") == 0 ||
+       strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-B") == 0 ||
        strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-g") == 0 ||
        strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "-F") == 0 ||
        strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-S") == 0 ||
        strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "-I") == 0 ||
+       strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-J") == 0 ||
+       strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "-K") == 0 ||
+       strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "-L") == 0 ||
        strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-O") == 0 ||
-       strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "-P") == 0))
-      usage("-a/-f/-g/-i/-o/-p/-s options require parameters.");
+       strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "-P") == 0 ||
+       strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "-U") == 0 ||
+       strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "-W") == 0))
+      usage("-a/-b/-f/-g/-i/-j/-k/-l/-o/-p/-s/-u/-w options require "
+            "parameters.");
     else if(strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-C") == 0)
       closed = 1;
     else if(strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "-Q") == 0)
       quiet = 1;
+    else if(strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-E") == 0)
+      exact_dp = 1;
+    else if(strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "-R") == 0)
+      compact = 1;
+    else if(strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "-X") == 0)
+      tctl.strict = 1;
+    else if(strcmp(argv[i], "-z") == 0 || strcmp(argv[i], "-Z") == 0)
+      float_wt = 1;
     else if(strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "-M") == 0)
       do_mask = 1;
     else if(strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-N") == 0)
@@ -132,6 +159,12 @@ int main(int argc, char *argv[]) {
       trans_file = argv[i+1];
       i++;
     }
+    else if(strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-B") == 0) {
+      sample = atoi(argv[i+1]);
+      if(sample < MIN_SINGLE_GENOME || sample > MAX_SEQ)
+        usage("Invalid training sample size specified.");
+      i++;
+    }
     else if(strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-d") == 0) {
       nuc_file = argv[i+1];
       i++;
@@ -140,6 +173,20 @@ int main(int argc, char *argv[]) {
       input_file = argv[i+1];
       i++;
     }
+    else if(strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-J") == 0) {
+      nthr = atoi(argv[i+1]);
+      if(nthr < 1 || nthr > MAX_THREADS)
+        usage("Invalid number of threads specified.");
+      i++;
+    }
+    else if(strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "-K") == 0) {
+      cache_dir = argv[i+1];
+      i++;
+    }
+    else if(strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "-L") == 0) {
+      log_file = argv[i+1];
+      i++;
+    }
     else if(strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-O") == 0) {
       output_file = argv[i+1];
       i++;
@@ -152,6 +199,15 @@ int main(int argc, char *argv[]) {
       train_file = argv[i+1];
       i++;
     }
+    else if(strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "-U") == 0) {
+      upd_file = argv[i+1];
+      i++;
+    }
+    else if(strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "-W") == 0) {
+      win = atoi(argv[i+1]);
+      if(win < MIN_WINDOW) usage("Invalid window size specified.");
+      i++;
+    }
     else if(strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-G") == 0) {
       tinf.trans_table = atoi(argv[i+1]);
       if(tinf.trans_table < 1 || tinf.trans_table > 25 || tinf.trans_table == 7
@@ -188,6 +244,12 @@ int main(int argc, char *argv[]) {
     else usage("Unknown option.");
   }
 
+  /* Start the worker threads used for node scoring */
+  if(start_threads(nthr) != 0) {
+    fprintf(stderr, "\nError: could not start %d threads.\n\n", nthr);
+    exit(19);
+  }
+
   /* Print header */
   if(quiet == 0) {
     fprintf(stderr, "-------------------------------------\n");
@@ -204,7 +266,8 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, " training file.\n");
       exit(2);
     } 
-    rv = read_training_file(train_file, &tinf);
+    rv = map_training_file(train_file, &tinf);
+    if(rv == 2) rv = read_training_file(train_file, &tinf);
     if(rv == 1) do_training = 1;
     else {
       if(force_nonsd == 1) { 
@@ -217,8 +280,11 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "\n\nWarning: user-specified translation table does");
         fprintf(stderr, "not match the one in the specified training file! \n\n");
       }
-      if(rv == -1) { 
-        fprintf(stderr, "\n\nError: training file did not read correctly!\n"); 
+      if(rv < 0) { 
+        fprintf(stderr, "\n\nError: training file did not read correctly");
+        if(rv == -2) fprintf(stderr, " (file is truncated)");
+        else if(rv == -3) fprintf(stderr, " (checksum does not match)");
+        fprintf(stderr, "!\n");
         exit(4); 
       }
       if(quiet == 0) {
@@ -228,6 +294,64 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  /* Incremental updates are only kept for single genomes */
+  if(upd_file != NULL && is_meta == 1) {
+    fprintf(stderr, "\nError: cannot use an update state file with");
+    fprintf(stderr, " metagenomic sequence.\n");
+    exit(20);
+  }
+
+  /* Training samples are only drawn for single genome training */
+  if(sample > 0 && is_meta == 1) {
+    fprintf(stderr, "\nError: cannot sample the training sequence (-b) with");
+    fprintf(stderr, " metagenomic sequence.\n");
+    exit(24);
+  }
+  if(sample > 0 && do_training == 0 && train_file != NULL) {
+    fprintf(stderr, "\nError: cannot sample the training sequence (-b) when");
+    fprintf(stderr, " reading a training file.\n");
+    exit(24);
+  }
+
+  /* The training cache holds single genome training only */
+  if(cache_dir != NULL && is_meta == 1) {
+    fprintf(stderr, "\nError: cannot use a training cache (-k) with");
+    fprintf(stderr, " metagenomic sequence.\n");
+    exit(25);
+  }
+  if(cache_dir != NULL && do_training == 0 && train_file != NULL) {
+    fprintf(stderr, "\nError: cannot use a training cache (-k) when reading");
+    fprintf(stderr, " a training file.\n");
+    exit(25);
+  }
+  if(cache_dir != NULL && mkdir(cache_dir, 0755) == -1 && errno != EEXIST) {
+    fprintf(stderr, "\nError: can't create training cache directory %s.\n\n",
+            cache_dir);
+    exit(25);
+  }
+
+  /* Windowed gene finding is a single genome, fast dprog only option */
+  if(win > 0 && is_meta == 1) {
+    fprintf(stderr, "\nError: cannot use windows (-w) with metagenomic");
+    fprintf(stderr, " sequence.\n");
+    exit(22);
+  }
+  if(win > 0 && exact_dp == 1) {
+    fprintf(stderr, "\nError: cannot use windows (-w) with exact dynamic");
+    fprintf(stderr, " programming (-e).\n");
+    exit(22);
+  }
+  if(win > 0 && upd_file != NULL) {
+    fprintf(stderr, "\nError: cannot use windows (-w) with an update state");
+    fprintf(stderr, " file (-u).\n");
+    exit(22);
+  }
+  if(win > 0 && start_file != NULL) {
+    fprintf(stderr, "\nError: cannot use windows (-w) with a start file");
+    fprintf(stderr, " (-s).\n");
+    exit(22);
+  }
+
   /* Determine where standard input is coming from and react accordingly */
   if(is_meta == 0 && train_file == NULL && input_file == NULL) {
     fnum = fileno(stdin);
@@ -285,6 +409,16 @@ int main(int argc, char *argv[]) {
       exit(16);
     }
   }
+  if(log_file != NULL) {
+    tctl.log = fopen(log_file, "w");
+    if(tctl.log == NULL) {
+      fprintf(stderr, "\nError: can't open training log file %s.\n\n",
+              log_file);
+      exit(23);
+    }
+    fprintf(tctl.log, "#trainer\tround\tstage\tstarts\tmotif_delta");
+    fprintf(tctl.log, "\ttype_delta\tseconds\n");
+  }
 
   /***************************************************************************
     Single Genome Training:  Read in the sequence(s) and perform the
@@ -296,8 +430,34 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "Request:  Single Genome, Phase:  Training\n");
       fprintf(stderr, "Reading in the sequence(s) to train..."); 
     }
+
+    /* Draw a stratified sample of the sequences if there are too many */
+    if(sample > 0) {
+      nctg = scan_seq_contigs(input_ptr, &ctg);
+      if(nctg == -1) {
+        fprintf(stderr, "\nError: could not rewind input file.\n");
+        exit(13);
+      }
+      pick = (unsigned char *)malloc((nctg+1)*sizeof(unsigned char));
+      if(pick == NULL) {
+        fprintf(stderr, "Malloc failed on training sample\n\n");
+        exit(11);
+      }
+      for(i = 0, picked = 0.0; i < nctg; i++) picked += ctg[i].len;
+      if(picked > sample) {
+        picked = sample_contigs(ctg, nctg, sample, pick);
+        for(i = 0, j = 0; i < nctg; i++) j += pick[i];
+        if(quiet == 0) {
+          fprintf(stderr, "sampled %d of %d sequences (%.0f bp)...", j, nctg,
+                  picked);
+        }
+      }
+      else { free(pick); pick = NULL; }
+      free(ctg);
+    }
     slen = read_seq_training(input_ptr, seq, useq, &(tinf.gc), do_mask, mlist,
-                             &nmask);
+                             &nmask, pick);
+    if(pick != NULL) free(pick);
     if(slen == 0) {
       fprintf(stderr, "\n\nSequence read failed (file must be Fasta, ");
       fprintf(stderr, "Genbank, or EMBL format).\n\n");
@@ -321,96 +481,131 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "%d bp seq created, %.2f pct GC\n", slen, tinf.gc*100.0);
     }
 
-    /***********************************************************************
-      Find all the potential starts and stops, sort them, and create a 
-      comprehensive list of nodes for dynamic programming.
-    ***********************************************************************/
-    if(quiet == 0) {
-      fprintf(stderr, "Locating all potential starts and stops..."); 
+    /* Look for a model already trained on this sequence and these options */
+    if(cache_dir != NULL) {
+      cache_file = training_cache_file(cache_dir, seq, useq, slen, &tinf,
+                                       closed, do_mask, force_nonsd,
+                                       tctl.strict, exact_dp);
+      if(map_training_file(cache_file, &tinf) == 0) {
+        cached = 1;
+        if(quiet == 0) {
+          fprintf(stderr, "Read training data from cache file %s\n",
+                  cache_file);
+        }
+      }
     }
-    if(slen > max_slen && slen > STT_NOD*8) {
-      nodes = (struct _node *)realloc(nodes, (int)(slen/8)*sizeof(struct _node));
-      if(nodes == NULL) {
-        fprintf(stderr, "Realloc failed on nodes\n\n");
+
+    if(cached == 0) {
+      /***********************************************************************
+        Find all the potential starts and stops, sort them, and create a 
+        comprehensive list of nodes for dynamic programming.
+      ***********************************************************************/
+      if(quiet == 0) {
+        fprintf(stderr, "Locating all potential starts and stops..."); 
+      }
+      if(slen > max_slen && slen > STT_NOD*8) {
+        nodes = (struct _node *)realloc(nodes, (int)(slen/8)*
+                                        sizeof(struct _node));
+        if(nodes == NULL) {
+          fprintf(stderr, "Realloc failed on nodes\n\n");
+          exit(11);
+        }
+        max_slen = slen;
+      }
+      nn = add_nodes(seq, rseq, slen, nodes, closed, mlist, nmask, &tinf);
+      qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
+      link_orfs(nodes, nn);
+      if(quiet == 0) {
+        fprintf(stderr, "%d nodes\n", nn); 
+      }
+
+      /***********************************************************************
+        Scan all the ORFS looking for a potential GC bias in a particular
+        codon position.  This information will be used to acquire a good
+        initial set of genes.
+      ***********************************************************************/
+      if(quiet == 0) {
+        fprintf(stderr, "Looking for GC bias in different frames...");
+      }
+      gc_sum = calc_gc_frame_sums(seq, slen);
+      if(gc_sum == NULL) {
+        fprintf(stderr, "Malloc failed on gc frame counts\n\n");
         exit(11);
       }
-      max_slen = slen;
-    }
-    nn = add_nodes(seq, rseq, slen, nodes, closed, mlist, nmask, &tinf);
-    qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
-    if(quiet == 0) {
-      fprintf(stderr, "%d nodes\n", nn); 
-    }
+      gc_frame = calc_most_gc_frame(seq, gc_sum, slen);
+      if(gc_frame == NULL) {
+        fprintf(stderr, "Malloc failed on gc frame plot\n\n");
+        exit(11);
+      }
+      record_gc_bias(gc_frame, nodes, nn, &tinf);
+      if(quiet == 0) {
+        fprintf(stderr, "frame bias scores: %.2f %.2f %.2f\n", tinf.bias[0],
+                tinf.bias[1], tinf.bias[2]); 
+      }
+      free(gc_frame);
+      free(gc_sum);
 
-    /***********************************************************************
-      Scan all the ORFS looking for a potential GC bias in a particular
-      codon position.  This information will be used to acquire a good
-      initial set of genes.
-    ***********************************************************************/
-    if(quiet == 0) {
-      fprintf(stderr, "Looking for GC bias in different frames...");
-    }
-    gc_frame = calc_most_gc_frame(seq, slen);
-    if(gc_frame == NULL) {
-      fprintf(stderr, "Malloc failed on gc frame plot\n\n");
-      exit(11);
-    }
-    record_gc_bias(gc_frame, nodes, nn, &tinf);
-    if(quiet == 0) {
-      fprintf(stderr, "frame bias scores: %.2f %.2f %.2f\n", tinf.bias[0],
-              tinf.bias[1], tinf.bias[2]); 
-    }
-    free(gc_frame);
+      /***********************************************************************
+        Do an initial dynamic programming routine with just the GC frame
+        bias used as a scoring function.  This will get an initial set of 
+        genes to train on. 
+      ***********************************************************************/
+      if(quiet == 0) {
+        fprintf(stderr, "Building initial set of genes to train from...");
+      }
+      record_overlapping_starts(nodes, nn, &tinf, 0);
+      ipath = dprog(nodes, nn, &tinf, 0, exact_dp, mlist, nmask);
+      if(quiet == 0) {
+        fprintf(stderr, "done!\n"); 
+      }
 
-    /***********************************************************************
-      Do an initial dynamic programming routine with just the GC frame
-      bias used as a scoring function.  This will get an initial set of 
-      genes to train on. 
-    ***********************************************************************/
-    if(quiet == 0) {
-      fprintf(stderr, "Building initial set of genes to train from...");
-    }
-    record_overlapping_starts(nodes, nn, &tinf, 0);
-    ipath = dprog(nodes, nn, &tinf, 0);
-    if(quiet == 0) {
-      fprintf(stderr, "done!\n"); 
-    }
+      /***********************************************************************
+        Gather dicodon statistics for the training set.  Score the entire set
+        of nodes.                               
+      ***********************************************************************/
+      if(quiet == 0) {
+        fprintf(stderr, "Creating coding model and scoring nodes...");
+      }
+      calc_dicodon_gene(&tinf, seq, rseq, slen, nodes, ipath);
+      raw_coding_score(seq, rseq, slen, nodes, nn, &tinf);
+      if(quiet == 0) {
+        fprintf(stderr, "done!\n"); 
+      }
 
-    /***********************************************************************
-      Gather dicodon statistics for the training set.  Score the entire set
-      of nodes.                               
-    ***********************************************************************/
-    if(quiet == 0) {
-      fprintf(stderr, "Creating coding model and scoring nodes...");
-    }
-    calc_dicodon_gene(&tinf, seq, rseq, slen, nodes, ipath);
-    raw_coding_score(seq, rseq, slen, nodes, nn, &tinf);
-    if(quiet == 0) {
-      fprintf(stderr, "done!\n"); 
-    }
+      /***********************************************************************
+        Determine if this organism uses Shine-Dalgarno or not and score the 
+        nodes appropriately.
+      ***********************************************************************/
+      if(quiet == 0) {
+        fprintf(stderr, "Examining upstream regions and training starts...");
+      }
+      rbs_score(seq, rseq, slen, nodes, nn, &tinf);
+      train_starts_sd(seq, rseq, slen, nodes, nn, &tinf, &tctl);
+      determine_sd_usage(&tinf);
+      if(force_nonsd == 1) tinf.uses_sd = 0;
+      if(tinf.uses_sd == 0)
+        train_starts_nonsd(seq, rseq, slen, nodes, nn, &tinf, &tctl);
+      if(quiet == 0) {
+        fprintf(stderr, "done!\n"); 
+      }
 
-    /***********************************************************************
-      Determine if this organism uses Shine-Dalgarno or not and score the 
-      nodes appropriately.
-    ***********************************************************************/
-    if(quiet == 0) {
-      fprintf(stderr, "Examining upstream regions and training starts...");
-    }
-    rbs_score(seq, rseq, slen, nodes, nn, &tinf);
-    train_starts_sd(seq, rseq, slen, nodes, nn, &tinf);
-    determine_sd_usage(&tinf);
-    if(force_nonsd == 1) tinf.uses_sd = 0;
-    if(tinf.uses_sd == 0) train_starts_nonsd(seq, rseq, slen, nodes, nn, &tinf);
-    if(quiet == 0) {
-      fprintf(stderr, "done!\n"); 
+      /* Keep the model for later runs on the same sequence.  Runs sharing */
+      /* the directory may write the same file at once; each writes its    */
+      /* own temporary file and renames it (write_training_binary).        */
+      if(cache_file != NULL &&
+         write_training_binary(cache_file, &tinf, 0) != 0) {
+        fprintf(stderr, "\nWarning: could not write training cache file");
+        fprintf(stderr, " %s.\n\n", cache_file);
+      }
     }
+    if(cache_file != NULL) free(cache_file);
 
     /* If training specified, write the training file and exit. */
     if(do_training == 1) {
       if(quiet == 0) {
         fprintf(stderr, "Writing data to training file %s...", train_file);
       }
-      rv = write_training_file(train_file, &tinf);
+      rv = write_training_binary(train_file, &tinf, float_wt);
       if(rv != 0) { 
         fprintf(stderr, "\nError: could not write training file!\n"); 
         exit(12); 
@@ -443,12 +638,46 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "Initializing training files...");
     }
     initialize_metagenomic_bins(meta);
+
+    /* Bins with the same translation table share a node list */
+    for(i = 0; i < NUM_META; i++) {
+      for(j = 0; j < i; j++)
+        if(meta[j].trans_table == meta[i].trans_table) break;
+      if(j < i) fd.mt_slot[i] = fd.mt_slot[j];
+      else fd.mt_slot[i] = fd.nmt++;
+    }
     if(quiet == 0) {
       fprintf(stderr, "done!\n");
       fprintf(stderr, "-------------------------------------\n");
     }
   }
 
+  /* Open the incremental update state (if specified) */
+  if(upd_file != NULL && open_update_state(&upd, upd_file, &tinf, closed,
+     exact_dp) != 0) {
+    fprintf(stderr, "\nError: can't write update state file %s.\n\n",
+            upd_file);
+    exit(21);
+  }
+
+  /* Motif table of the single genome model (non-SD scoring) */
+  if(is_meta == 0) build_motif_table(&mtab, &tinf);
+
+  /* Windowed gene finding prints the genes itself */
+  if(win > 0)
+    init_stream(&strm, win, output_ptr, output, trans_ptr == stdout ? NULL :
+                trans_ptr, nuc_ptr == stdout ? NULL : nuc_ptr);
+
+  /* Otherwise the genes are found by batches of sequences (contigs.c) */
+  fd.is_meta = is_meta; fd.closed = closed; fd.exact_dp = exact_dp;
+  fd.output = output; fd.compact = compact; fd.version = VERSION;
+  fd.tinf = &tinf; fd.mt = &mtab; fd.meta = meta;
+  fd.upd = (upd_file == NULL) ? NULL : &upd;
+  out[OUT_GENES] = output_ptr;
+  out[OUT_STARTS] = (start_ptr == stdout) ? NULL : start_ptr;
+  out[OUT_TRANS] = (trans_ptr == stdout) ? NULL : trans_ptr;
+  out[OUT_NUCS] = (nuc_ptr == stdout) ? NULL : nuc_ptr;
+
   /* Print out header for gene finding phase */
   if(quiet == 0) {
     if(is_meta == 1) 
@@ -457,161 +686,86 @@ int main(int argc, char *argv[]) {
   }
 
   /* Read and process each sequence in the file in succession */
+  if(win == 0) init_batch(&bat, &fd, out, quiet);
   sprintf(cur_header, "Prodigal_Seq_1");
   sprintf(new_header, "Prodigal_Seq_2");
   while((slen = next_seq_multi(input_ptr, seq, useq, &num_seq, &gc, 
          do_mask, mlist, &nmask, cur_header, new_header)) != -1) {
-    rcom_seq(seq, rseq, useq, slen);
     if(slen == 0) {
       fprintf(stderr, "\nSequence read failed (file must be Fasta, ");
       fprintf(stderr, "Genbank, or EMBL format).\n\n");
       exit(14);
     }
 
-    if(quiet == 0) {
-      fprintf(stderr, "Finding genes in sequence #%d (%d bp)...", num_seq, slen);
-    }
-
-    /* Reallocate memory if this is the biggest sequence we've seen */
-    if(slen > max_slen && slen > STT_NOD*8) {
-      nodes = (struct _node *)realloc(nodes, (int)(slen/8)*sizeof(struct _node));
-      if(nodes == NULL) {
-        fprintf(stderr, "Realloc failed on nodes\n\n");
-        exit(11);
-      }
-      max_slen = slen;
-    }
-
-    /* Calculate short header for this sequence */
-    calc_short_header(cur_header, short_header, num_seq);
-
-    if(is_meta == 0) { /* Single Genome Version */
-
-      /***********************************************************************
-        Find all the potential starts and stops, sort them, and create a 
-        comprehensive list of nodes for dynamic programming.
-      ***********************************************************************/
-      nn = add_nodes(seq, rseq, slen, nodes, closed, mlist, nmask, &tinf);
-      qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
-
-      /***********************************************************************
-        Second dynamic programming, using the dicodon statistics as the
-        scoring function.                                
-      ***********************************************************************/
-      score_nodes(seq, rseq, slen, nodes, nn, &tinf, closed, is_meta);
-      if(start_ptr != stdout) 
-        write_start_file(start_ptr, nodes, nn, &tinf, num_seq, slen, 0, NULL,
-                         VERSION, cur_header);
-      record_overlapping_starts(nodes, nn, &tinf, 1);
-      ipath = dprog(nodes, nn, &tinf, 1);
-      eliminate_bad_genes(nodes, ipath, &tinf);
-      ng = add_genes(genes, nodes, ipath);
-      tweak_final_starts(genes, ng, nodes, nn, &tinf);
-      record_gene_data(genes, ng, nodes, &tinf, num_seq);
+    if(win > 0) { /* Single Genome, Windowed */
+      rcom_seq(seq, rseq, useq, slen);
       if(quiet == 0) {
-        fprintf(stderr, "done!\n"); 
+        fprintf(stderr, "Finding genes in sequence #%d (%d bp)...", num_seq,
+                slen);
       }
 
-      /* Output the genes */
-      print_genes(output_ptr, genes, ng, nodes, slen, output, num_seq, 0, NULL,
-                  &tinf, cur_header, short_header, VERSION);
-      fflush(output_ptr);
-      if(trans_ptr != stdout)
-        write_translations(trans_ptr, genes, ng, nodes, seq, rseq, useq, slen,
-                              &tinf, num_seq, short_header);
-      if(nuc_ptr != stdout)
-        write_nucleotide_seqs(nuc_ptr, genes, ng, nodes, seq, rseq, useq, slen,
-                              &tinf, num_seq, short_header);
-    }
-
-    else { /* Metagenomic Version */
-
-      low = 0.88495*gc - 0.0102337;
-      if(low > 0.65) low = 0.65;
-      high = 0.86596*gc + .1131991;
-      if(high < 0.35) high = 0.35;
-
-      max_score = -100.0;
-      for(i = 0; i < NUM_META; i++) { 
-        if(i == 0 || meta[i].tinf->trans_table != 
-           meta[i-1].tinf->trans_table) {
-          memset(nodes, 0, nn*sizeof(struct _node));
-          nn = add_nodes(seq, rseq, slen, nodes, closed, mlist, nmask, 
-                         meta[i].tinf);
-          qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
-        }
-        if(meta[i].tinf->gc < low || meta[i].tinf->gc > high) continue;  
-        reset_node_scores(nodes, nn);
-        score_nodes(seq, rseq, slen, nodes, nn, meta[i].tinf, closed, is_meta);
-        record_overlapping_starts(nodes, nn, meta[i].tinf, 1);
-        ipath = dprog(nodes, nn, meta[i].tinf, 1);
-        if(nodes[ipath].score > max_score) {
-          max_phase = i;
-          max_score = nodes[ipath].score;
-          eliminate_bad_genes(nodes, ipath, meta[i].tinf);
-          ng = add_genes(genes, nodes, ipath);
-          tweak_final_starts(genes, ng, nodes, nn, meta[i].tinf);
-          record_gene_data(genes, ng, nodes, meta[i].tinf, num_seq);
-        }
-      }    
-
-      /* Recover the nodes for the best of the runs */
-      memset(nodes, 0, nn*sizeof(struct _node));
-      nn = add_nodes(seq, rseq, slen, nodes, closed, mlist, nmask,
-                       meta[max_phase].tinf);
-      qsort(nodes, nn, sizeof(struct _node), &compare_nodes);
-      score_nodes(seq, rseq, slen, nodes, nn, meta[max_phase].tinf, closed,
-                  is_meta);
-      if(start_ptr != stdout) 
-        write_start_file(start_ptr, nodes, nn, meta[max_phase].tinf, 
-                         num_seq, slen, 1, meta[max_phase].desc, VERSION,
-                         cur_header);
-
+      /* Running GC counts shared by every scoring pass on this sequence */
+      gc_sum = calc_gc_frame_sums(seq, slen);
+      if(gc_sum == NULL) {
+        fprintf(stderr, "Malloc failed on gc frame counts\n\n");
+        exit(11);
+      }
+      calc_short_header(cur_header, short_header, num_seq);
+      stream_genes(&strm, seq, rseq, useq, slen, gc_sum, mlist, nmask,
+                   &tinf, &mtab, closed, num_seq, cur_header, short_header,
+                   VERSION);
       if(quiet == 0) {
         fprintf(stderr, "done!\n"); 
       }
-
-      /* Output the genes */
-      print_genes(output_ptr, genes, ng, nodes, slen, output, num_seq, 1,
-                  meta[max_phase].desc, meta[max_phase].tinf, cur_header, 
-                  short_header, VERSION);
       fflush(output_ptr);
-      if(trans_ptr != stdout)
-        write_translations(trans_ptr, genes, ng, nodes, seq, rseq, useq, slen,
-                           meta[max_phase].tinf, num_seq, short_header);
-      if(nuc_ptr != stdout)
-        write_nucleotide_seqs(nuc_ptr, genes, ng, nodes, seq, rseq, useq, slen,
-                              meta[max_phase].tinf, num_seq, short_header);
+      free(gc_sum);
     }
 
+    /* Otherwise the sequence is copied into a batch, whose genes are */
+    /* found (on all the threads) and written out once it fills up    */
+    else if(add_contig(&bat, seq, useq, slen, gc, mlist, nmask, num_seq,
+                       cur_header) == 1) run_batch(&bat);
+
     /* Reset all the sequence/dynamic programming variables */
     memset(seq, 0, (slen/4+1)*sizeof(unsigned char));
     memset(rseq, 0, (slen/4+1)*sizeof(unsigned char));
     memset(useq, 0, (slen/8+1)*sizeof(unsigned char));
-    memset(nodes, 0, nn*sizeof(struct _node));
-    nn = 0; slen = 0; ipath = 0; nmask = 0;
+    slen = 0; nmask = 0;
     strcpy(cur_header, new_header);
     sprintf(new_header, "Prodigal_Seq_%d\n", num_seq+1);
   }
+  if(win == 0) run_batch(&bat);
 
   if(num_seq == 0) {
     fprintf(stderr, "\nError:  no input sequences to analyze.\n\n");
     exit(18);
   }
+  if(upd_file != NULL && close_update_state(&upd) != 0) {
+    fprintf(stderr, "\nError: can't write update state file %s.\n\n",
+            upd_file);
+    exit(21);
+  }
 
   /* Free all memory */
   if(seq != NULL) free(seq);
   if(rseq != NULL) free(rseq);
   if(useq != NULL) free(useq);
   if(nodes != NULL) free(nodes);
-  if(genes != NULL) free(genes);
+  if(win > 0) free_stream(&strm);
+  if(win == 0) free_batch(&bat);
+  free_motif_table(&mtab);
   for(i = 0; i < NUM_META; i++) if(meta[i].tinf != NULL) free(meta[i].tinf);
+  for(i = 0; i < NUM_META; i++) if(meta[i].mt != NULL) {
+    free_motif_table(meta[i].mt);
+    free(meta[i].mt);
+  }
 
   /* Close all the filehandles and exit */
   if(input_ptr != stdin) fclose(input_ptr);
   if(output_ptr != stdout) fclose(output_ptr);
   if(start_ptr != stdout) fclose(start_ptr);
   if(trans_ptr != stdout) fclose(trans_ptr);
+  if(tctl.log != NULL) fclose(tctl.log);
 
   /* Remove tmp file */
   if(piped == 1 && remove(input_copy) != 0) {
@@ -619,6 +773,7 @@ int main(int argc, char *argv[]) {
     exit(18);
   }
 
+  stop_threads();
   exit(0);
 }
 
@@ -629,29 +784,51 @@ void version() {
 
 void usage(char *msg) {
   fprintf(stderr, "\n%s\n", msg);
-  fprintf(stderr, "\nUsage:  prodigal [-a trans_file] [-c] [-d nuc_file]");
-  fprintf(stderr, " [-f output_type]\n");
-  fprintf(stderr, "                 [-g tr_table] [-h] [-i input_file] [-m]");
-  fprintf(stderr, " [-n] [-o output_file]\n");
-  fprintf(stderr, "                 [-p mode] [-q] [-s start_file]");
-  fprintf(stderr, " [-t training_file] [-v]\n");
+  fprintf(stderr, "\nUsage:  prodigal [-a trans_file] [-b sample_size] [-c]");
+  fprintf(stderr, " [-d nuc_file] [-e]\n");
+  fprintf(stderr, "                 [-f output_type] [-g tr_table] [-h]");
+  fprintf(stderr, " [-i input_file]\n");
+  fprintf(stderr, "                 [-j threads] [-k cache_dir] [-l log_file]");
+  fprintf(stderr, " [-m] [-n]\n");
+  fprintf(stderr, "                 [-o output_file] [-p mode] [-q] [-r]");
+  fprintf(stderr, " [-s start_file]\n");
+  fprintf(stderr, "                 [-t training_file] [-u state_file] [-v]");
+  fprintf(stderr, " [-w window]\n");
+  fprintf(stderr, "                 [-x] [-z]\n");
   fprintf(stderr, "\nDo 'prodigal -h' for more information.\n\n");
   exit(15);
 }
 
 void help() {
-  fprintf(stderr, "\nUsage:  prodigal [-a trans_file] [-c] [-d nuc_file]");
-  fprintf(stderr, " [-f output_type]\n");
-  fprintf(stderr, "                 [-g tr_table] [-h] [-i input_file] [-m]");
-  fprintf(stderr, " [-n] [-o output_file]\n");
-  fprintf(stderr, "                 [-p mode] [-q] [-s start_file]");
-  fprintf(stderr, " [-t training_file] [-v]\n");
+  fprintf(stderr, "\nUsage:  prodigal [-a trans_file] [-b sample_size] [-c]");
+  fprintf(stderr, " [-d nuc_file] [-e]\n");
+  fprintf(stderr, "                 [-f output_type] [-g tr_table] [-h]");
+  fprintf(stderr, " [-i input_file]\n");
+  fprintf(stderr, "                 [-j threads] [-k cache_dir] [-l log_file]");
+  fprintf(stderr, " [-m] [-n]\n");
+  fprintf(stderr, "                 [-o output_file] [-p mode] [-q] [-r]");
+  fprintf(stderr, " [-s start_file]\n");
+  fprintf(stderr, "                 [-t training_file] [-u state_file] [-v]");
+  fprintf(stderr, " [-w window]\n");
+  fprintf(stderr, "                 [-x] [-z]\n");
   fprintf(stderr, "\n         -a:  Write protein translations to the selected ");
   fprintf(stderr, "file.\n");
+  fprintf(stderr, "         -b:  Train on a sample of about this many bases,");
+  fprintf(stderr, " drawn evenly across\n");
+  fprintf(stderr, "              the input's sequences by length and GC,");
+  fprintf(stderr, " instead of all of it.\n");
   fprintf(stderr, "         -c:  Closed ends.  Do not allow genes to run off ");
   fprintf(stderr, "edges.\n");
   fprintf(stderr, "         -d:  Write nucleotide sequences of genes to the ");
   fprintf(stderr, "selected file.\n");
+  fprintf(stderr, "         -e:  Exact dynamic programming:  consider every");
+  fprintf(stderr, " earlier node as a\n");
+  fprintf(stderr, "              predecessor instead of a fixed window");
+  fprintf(stderr, " (experimental).\n");
+  fprintf(stderr, "              With -m, pieces between masked gaps are");
+  fprintf(stderr, " run on separate threads;\n");
+  fprintf(stderr, "              a sequence without masked gaps is run");
+  fprintf(stderr, " on one thread.\n");
   fprintf(stderr, "         -f:  Select output format (gbk, gff, or sco).  ");
   fprintf(stderr, "Default is gbk.\n");
   fprintf(stderr, "         -g:  Specify a translation table to use (default");
@@ -659,6 +836,19 @@ void help() {
   fprintf(stderr, "         -h:  Print help menu and exit.\n");
   fprintf(stderr, "         -i:  Specify FASTA/Genbank input file (default ");
   fprintf(stderr, "reads from stdin).\n");
+  fprintf(stderr, "         -j:  Number of threads to use for training and");
+  fprintf(stderr, " scoring (default 1).\n");
+  fprintf(stderr, "              Several sequences, or the metagenomic bins");
+  fprintf(stderr, " of a long one, are\n");
+  fprintf(stderr, "              then worked on at once; the output is the");
+  fprintf(stderr, " same as with one\n");
+  fprintf(stderr, "              thread.\n");
+  fprintf(stderr, "         -k:  Keep trained models in this directory, and");
+  fprintf(stderr, " skip training when\n");
+  fprintf(stderr, "              the same sequence is trained with the same");
+  fprintf(stderr, " options again.\n");
+  fprintf(stderr, "         -l:  Write statistics for each round of start");
+  fprintf(stderr, " training to this file.\n");
   fprintf(stderr, "         -m:  Treat runs of N as masked sequence; don't");
   fprintf(stderr, " build genes across them.\n");
   fprintf(stderr, "         -n:  Bypass Shine-Dalgarno trainer and force");
@@ -668,12 +858,34 @@ void help() {
   fprintf(stderr, "         -p:  Select procedure (single or meta).  Default");
   fprintf(stderr, " is single.\n");
   fprintf(stderr, "         -q:  Run quietly (suppress normal stderr output).\n");
+  fprintf(stderr, "         -r:  Score metagenomic bins with single precision");
+  fprintf(stderr, " coding tables\n");
+  fprintf(stderr, "              (faster; scores stay within 2.4e-7 per");
+  fprintf(stderr, " codon of exact).\n");
   fprintf(stderr, "         -s:  Write all potential genes (with scores) to");
   fprintf(stderr, " the selected file.\n");
   fprintf(stderr, "         -t:  Write a training file (if none exists); ");
   fprintf(stderr, "otherwise, read and use\n");
   fprintf(stderr, "              the specified training file.\n");
-  fprintf(stderr, "         -v:  Print version number and exit.\n\n");
+  fprintf(stderr, "         -u:  Save the scored genes to this state file;");
+  fprintf(stderr, " when the next run\n");
+  fprintf(stderr, "              finds the same sequence, only slightly");
+  fprintf(stderr, " edited, rescore just\n");
+  fprintf(stderr, "              the edited part (single mode, fixed");
+  fprintf(stderr, " training file).\n");
+  fprintf(stderr, "         -v:  Print version number and exit.\n");
+  fprintf(stderr, "         -w:  Find genes a window of this many bases at a");
+  fprintf(stderr, " time (at least\n");
+  fprintf(stderr, "              10000), holding only a few windows' nodes");
+  fprintf(stderr, " at once (single\n");
+  fprintf(stderr, "              mode; training, if any, still reads the");
+  fprintf(stderr, " whole sequence).\n");
+  fprintf(stderr, "         -x:  Strict training:  always run every round of");
+  fprintf(stderr, " start training instead\n");
+  fprintf(stderr, "              of stopping once the weights settle.\n");
+  fprintf(stderr, "         -z:  Store the weights in a new training file as");
+  fprintf(stderr, " floats (half the\n");
+  fprintf(stderr, "              size, slightly less precise).\n\n");
   exit(0);
 }
 
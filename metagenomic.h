@@ -32,6 +32,7 @@
 #define NUM_META 50
 #define SAMPLE_LEN 120
 #define MAX_SAMPLE 200
+#define META_GC_TOL 0.0001  /* Rounding of the GC contents in meta_info */
 
 struct _metagenomic_bin {
   int index;                    /* Index used for sorting */
@@ -39,10 +40,19 @@ struct _metagenomic_bin {
   char desc[500];               /* Text description of this bin */
   double weight;                /* Current weight/score of this bin */
   double gc;                    /* GC distance from target sequence */
-  struct _training *tinf;       /* Pointer to the training file for this bin */
+  struct _training *tinf;       /* Pointer to the training file for this bin,
+                                   NULL until load_meta_bin builds it */
+  double model_gc;              /* GC content of the bin's model */
+  int trans_table;              /* Its translation table */
+  int uses_sd;                  /* 1 if it uses SD motifs (-1 until built) */
+  struct _motif_table *mt;      /* Motif table of a non-SD bin, built along
+                                   with tinf (NULL otherwise) */
 };
 
 void initialize_metagenomic_bins(struct _metagenomic_bin *);
+struct _training *load_meta_bin(struct _metagenomic_bin *, int);
+int gc_bins(struct _metagenomic_bin *, double, unsigned char *);
+void initialize_metagenome(int, struct _training *);
 double score_edges(unsigned char *, unsigned char *, int, 
                    struct _training *tinf);
 double score_sample(unsigned char *, unsigned char *, int, int, int, struct
@@ -18,6 +18,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *******************************************************************************/
 
+#include <sys/time.h>
 #include "node.h"
 
 /*******************************************************************************
@@ -28,147 +29,144 @@
 int add_nodes(unsigned char *seq, unsigned char *rseq, int slen, struct _node
               *nodes, int closed, mask *mlist, int nm, struct _training
               *tinf) {
-  int i, nn = 0, last[3], saw_start[3], min_dist[3];
+  return add_node_range(seq, rseq, slen, nodes, closed, mlist, nm, tinf, 0,
+                        slen);
+}
+
+/*******************************************************************************
+  Adds the nodes whose position lies in [lo, hi), exactly as add_nodes would
+  have made them.  The scan of each strand picks up the nearest stops past
+  the end of the range first, and runs on before its beginning as far as it
+  has to to finish the ORFs whose stops are in the range.
+*******************************************************************************/
+int add_node_range(unsigned char *seq, unsigned char *rseq, int slen, struct
+                   _node *nodes, int closed, mask *mlist, int nm, struct
+                   _training *tinf, int lo, int hi) {
+  int nn;
+
+  nn = add_strand_nodes(seq, slen, 1, nodes, 0, closed, mlist, nm, tinf, lo,
+                        hi);
+  return add_strand_nodes(rseq, slen, -1, nodes, nn, closed, mlist, nm, tinf,
+                          slen-hi, slen-lo);
+}
+
+/*******************************************************************************
+  Nodes of one strand ('wseq' is seq or rseq) at strand positions [a, b),
+  appended to the list after its first 'nn' entries.  Returns the new count.
+*******************************************************************************/
+int add_strand_nodes(unsigned char *wseq, int slen, int strand, struct _node
+                     *nodes, int nn, int closed, mask *mlist, int nm, struct
+                     _training *tinf, int a, int b) {
+  int i, fr, type, last[3], saw_start[3], min_dist[3], found[3];
+  int ndx, sv, left, right;
   int slmod = 0;
 
-  /* Forward strand nodes */
   slmod = slen%3;
   for(i = 0; i < 3; i++) {
     last[(i+slmod)%3] = slen+i; 
     saw_start[i%3] = 0;
     min_dist[i%3] = MIN_EDGE_GENE;
+    found[i%3] = 0;
     if(closed == 0) while(last[(i+slmod)%3]+2 > slen-1) last[(i+slmod)%3]-=3;
   }
-  for(i = slen-3; i >= 0; i--) {
-    if(is_stop(seq, i, tinf)==1) {
-      if(saw_start[i%3] == 1) {
-        if(is_stop(seq, last[i%3], tinf) == 0) nodes[nn].edge = 1;
-        nodes[nn].ndx = last[i%3]; 
+  for(i = b; i <= slen-3 && found[0]+found[1]+found[2] < 3; i++) {
+    if(found[i%3] == 1 || is_stop(wseq, i, tinf) == 0) continue;
+    last[i%3] = i;
+    min_dist[i%3] = MIN_GENE;
+    found[i%3] = 1;
+  }
+
+  for(i = (b-1 < slen-3 ? b-1 : slen-3); i >= 0; i--) {
+    if(i < a) {
+      for(fr = 0; fr < 3; fr++) if(last[fr] >= a && last[fr] < b) break;
+      if(fr == 3) break;
+    }
+    fr = i%3;
+    if(is_stop(wseq, i, tinf)==1) {
+      if(saw_start[fr] == 1 && last[fr] >= a && last[fr] < b) {
+        if(is_stop(wseq, last[fr], tinf) == 0) nodes[nn].edge = 1;
+        nodes[nn].ndx = (strand == 1) ? last[fr] : slen-last[fr]-1; 
         nodes[nn].type = STOP;
-        nodes[nn].strand = 1; 
-        nodes[nn++].stop_val = i;
+        nodes[nn].strand = strand; 
+        nodes[nn++].stop_val = (strand == 1) ? i : slen-i-1;
       }
-      min_dist[i%3] = MIN_GENE;
-      last[i%3]=i; 
-      saw_start[i%3] = 0;
+      min_dist[fr] = MIN_GENE;
+      last[fr]=i; 
+      saw_start[fr] = 0;
       continue;
     }
-    if(last[i%3] >= slen) continue;
-     
-    if(is_start(seq, i, tinf) == 1 && is_atg(seq, i)==1 && ((last[i%3]-i+3)
-            >= min_dist[i%3]) && cross_mask(i, last[i%3], mlist, nm) == 0) {
-      nodes[nn].ndx = i; 
+    if(last[fr] >= slen) continue;
+
+    if(strand == 1) { ndx = i; sv = last[fr]; left = ndx; right = sv; }
+    else { ndx = slen-i-1; sv = slen-last[fr]-1; left = sv; right = ndx; }
+    if(is_start(wseq, i, tinf) == 1 && is_atg(wseq, i) == 1) type = ATG;
+    else if(is_start(wseq, i, tinf) == 1 && is_gtg(wseq, i) == 1) type = GTG;
+    else if(is_start(wseq, i, tinf) == 1 && is_ttg(wseq, i) == 1) type = TTG;
+    else type = -1;
+    if(type != -1 && ((last[fr]-i+3) >= min_dist[fr]) &&
+       cross_mask(left, right, mlist, nm) == 0) {
+      saw_start[fr] = 1;
+      if(i < a) continue;
+      nodes[nn].ndx = ndx; 
+      nodes[nn].type = type; 
+      nodes[nn].stop_val = sv; 
+      nodes[nn++].strand = strand;
+    }
+    else if(i <= 2 && closed == 0 && ((last[fr]-i) > MIN_EDGE_GENE) &&
+            cross_mask(left, right, mlist, nm) == 0) {
+      saw_start[fr] = 1;
+      if(i < a) continue;
+      nodes[nn].ndx = ndx; 
       nodes[nn].type = ATG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = last[i%3]; 
-      nodes[nn++].strand = 1;
-    }
-    else if(is_start(seq, i, tinf) == 1 && is_gtg(seq, i)==1 && ((last[i%3]-i+3)
-            >= min_dist[i%3]) && cross_mask(i, last[i%3], mlist, nm) == 0) {
-      nodes[nn].ndx = i; 
-      nodes[nn].type = GTG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = last[i%3]; 
-      nodes[nn++].strand = 1;
-    }
-    else if(is_start(seq, i, tinf) == 1 && is_ttg(seq, i)==1 && ((last[i%3]-i+3)
-            >= min_dist[i%3]) && cross_mask(i, last[i%3], mlist, nm) == 0) {
-      nodes[nn].ndx = i; 
-      nodes[nn].type = TTG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = last[i%3]; 
-      nodes[nn++].strand = 1;
-    }
-    else if(i <= 2 && closed == 0 && ((last[i%3]-i) > MIN_EDGE_GENE) &&
-            cross_mask(i, last[i%3], mlist, nm) == 0) {
-      nodes[nn].ndx = i; 
-      nodes[nn].type = ATG; 
-      saw_start[i%3] = 1;
       nodes[nn].edge = 1; 
-      nodes[nn].stop_val = last[i%3];
-      nodes[nn++].strand = 1;
+      nodes[nn].stop_val = sv;
+      nodes[nn++].strand = strand;
     }
   }
   for(i = 0; i < 3; i++) {
-    if(saw_start[i%3] == 1) {
-      if(is_stop(seq, last[i%3], tinf) == 0) nodes[nn].edge = 1;
-      nodes[nn].ndx = last[i%3]; 
+    if(saw_start[i%3] == 1 && last[i%3] >= a && last[i%3] < b) {
+      if(is_stop(wseq, last[i%3], tinf) == 0) nodes[nn].edge = 1;
+      nodes[nn].ndx = (strand == 1) ? last[i%3] : slen-last[i%3]-1; 
       nodes[nn].type = STOP;
-      nodes[nn].strand = 1; 
-      nodes[nn++].stop_val = i-6;
+      nodes[nn].strand = strand; 
+      nodes[nn++].stop_val = (strand == 1) ? i-6 : slen-i+5;
     }
   }
+  return nn;
+}
 
-  /* Reverse strand nodes */
-  for(i = 0; i < 3; i++) {
-    last[(i+slmod)%3] = slen+i; 
-    saw_start[i%3] = 0;
-    min_dist[i%3] = MIN_EDGE_GENE;
-    if(closed == 0) while(last[(i+slmod)%3]+2 > slen-1) last[(i+slmod)%3]-=3;
-  }
-  for(i = slen-3; i >= 0; i--) {
-    if(is_stop(rseq, i, tinf)==1) {
-      if(saw_start[i%3] == 1) {
-        if(is_stop(rseq, last[i%3], tinf) == 0) nodes[nn].edge = 1;
-        nodes[nn].ndx = slen-last[i%3]-1; 
-        nodes[nn].type = STOP;
-        nodes[nn].strand = -1; 
-        nodes[nn++].stop_val = slen-i-1;
-      }
-      min_dist[i%3] = MIN_GENE;
-      last[i%3]=i; 
-      saw_start[i%3] = 0;
-      continue;
-    }
-    if(last[i%3] >= slen) continue;
+/*******************************************************************************
+  Build the ORF table on a sorted list of nodes.  Each start gets the index
+  of its stop node in 'stop_ptr', and each stop heads a list of its starts
+  in node order, running from its 'stop_ptr' through 'next_start'.  A
+  forward ORF's starts come before its stop in the list of nodes and a
+  reverse ORF's after it, and no other stop in the same frame lies between
+  them, so the nearest stop in the frame is always the right one.  This
+  must be redone whenever the nodes are sorted.
+*******************************************************************************/
+void link_orfs(struct _node *nod, int nn) {
+  int i, fr, last[3];
 
-    if(is_start(rseq, i, tinf) == 1 && is_atg(rseq, i)==1 && ((last[i%3]-i+3)
-       >= min_dist[i%3]) && cross_mask(slen-last[i%3]-1, slen-i-1, mlist, nm) ==
-       0) {
-      nodes[nn].ndx = slen - i - 1; 
-      nodes[nn].type = ATG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = slen-last[i%3]-1; 
-      nodes[nn++].strand = -1;
-    }
-    else if(is_start(rseq, i, tinf) == 1 && is_gtg(rseq, i)==1 && 
-            ((last[i%3]-i+3) >= min_dist[i%3]) && cross_mask(slen-last[i%3]-1,
-            slen-i-1, mlist, nm) == 0) {
-      nodes[nn].ndx = slen - i - 1; 
-      nodes[nn].type = GTG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = slen-last[i%3]-1; 
-      nodes[nn++].strand = -1;
-    }
-    else if(is_start(rseq, i, tinf) == 1 && is_ttg(rseq, i)==1 && 
-            ((last[i%3]-i+3) >= min_dist[i%3]) && cross_mask(slen-last[i%3]-1,
-            slen-i-1, mlist, nm) == 0) {
-      nodes[nn].ndx = slen - i - 1; 
-      nodes[nn].type = TTG; 
-      saw_start[i%3] = 1;
-      nodes[nn].stop_val = slen-last[i%3]-1; 
-      nodes[nn++].strand = -1;
-    }
-    else if(i <= 2 && closed == 0 && ((last[i%3]-i) > MIN_EDGE_GENE) &&
-            cross_mask(slen-last[i%3]-1, slen-i-1, mlist, nm) == 0) {
-      nodes[nn].ndx = slen - i - 1; 
-      nodes[nn].type = ATG; 
-      saw_start[i%3] = 1;
-      nodes[nn].edge = 1; 
-      nodes[nn].stop_val = slen-last[i%3]-1;
-      nodes[nn++].strand = -1;
+  for(fr = 0; fr < 3; fr++) last[fr] = -1;
+  for(i = 0; i < nn; i++) {
+    nod[i].next_start = -1;
+    if(nod[i].type == STOP) {
+      nod[i].stop_ptr = -1;
+      if(nod[i].strand == -1) last[nod[i].ndx%3] = i;
     }
+    else if(nod[i].strand == -1) nod[i].stop_ptr = last[nod[i].ndx%3];
   }
-  for(i = 0; i < 3; i++) {
-    if(saw_start[i%3] == 1) {
-      if(is_stop(rseq, last[i%3], tinf) == 0) nodes[nn].edge = 1;
-      nodes[nn].ndx = slen - last[i%3] - 1; 
-      nodes[nn].type = STOP;
-      nodes[nn].strand = -1; 
-      nodes[nn++].stop_val = slen-i+5;
+  for(fr = 0; fr < 3; fr++) last[fr] = -1;
+  for(i = nn-1; i >= 0; i--) {
+    if(nod[i].type == STOP) {
+      if(nod[i].strand == 1) last[nod[i].ndx%3] = i;
+      continue;
     }
+    if(nod[i].strand == 1) nod[i].stop_ptr = last[nod[i].ndx%3];
+    if(nod[i].stop_ptr == -1) continue;
+    nod[i].next_start = nod[nod[i].stop_ptr].stop_ptr;
+    nod[nod[i].stop_ptr].stop_ptr = i;
   }
-  return nn;
 }
 
 /* Simple routine to zero out the node scores */
@@ -196,6 +194,32 @@ void reset_node_scores(struct _node *nod, int nn) {
   }
 }
 
+/*******************************************************************************
+  With open ends, score_nodes turns starts at the first or last three bases
+  into edge nodes, which is the only change it makes to the node positions
+  and types.  These two routines save and restore the edge flags of the
+  END_NODES nodes at each end of a sorted list, so the same list can be
+  rescored from scratch without calling add_nodes again.
+*******************************************************************************/
+void save_end_edges(struct _node *nod, int nn, int *edges) {
+  int i;
+
+  edges[0] = 0; edges[1] = 0;
+  for(i = 0; i < END_NODES && i < nn; i++) {
+    if(nod[i].edge == 1) edges[0] |= (1 << i);
+    if(nod[nn-1-i].edge == 1) edges[1] |= (1 << i);
+  }
+}
+
+void restore_end_edges(struct _node *nod, int nn, int *edges) {
+  int i;
+
+  for(i = 0; i < END_NODES && i < nn; i++) {
+    nod[i].edge = (edges[0] >> i) & 1;
+    nod[nn-1-i].edge = (edges[1] >> i) & 1;
+  }
+}
+
 /*******************************************************************************
   Since dynamic programming can't go 'backwards', we have to record
   information about overlapping genes in order to build the models.  So, for
@@ -207,10 +231,16 @@ void reset_node_scores(struct _node *nod, int nn) {
 
 void record_overlapping_starts(struct _node *nod, int nn, struct _training
                                *tinf, int flag) {
+  record_overlapping_range(nod, nn, tinf, flag, 0, nn);
+}
+
+/* Record the overlapping starts of nodes [lo, hi) only */
+void record_overlapping_range(struct _node *nod, int nn, struct _training
+                              *tinf, int flag, int lo, int hi) {
   int i, j;
   double max_sc;
 
-  for(i = 0; i < nn; i++) {
+  for(i = lo; i < hi; i++) {
     for(j = 0; j < 3; j++) nod[i].star_ptr[j] = -1;
     if(nod[i].type != STOP || nod[i].edge == 1) continue;
     if(nod[i].strand == 1) {
@@ -262,48 +292,14 @@ void record_overlapping_starts(struct _node *nod, int nn, struct _training
 
 void record_gc_bias(int *gc, struct _node *nod, int nn, struct _training
                     *tinf) {
-  int i, j, ctr[3][3], last[3], frmod, fr, mfr, len;
+  int i, len;
   double tot = 0.0;
+  struct _score_job job;
 
   if(nn == 0) return;
-  for(i = 0; i < 3; i++) for(j = 0; j < 3; j++) ctr[i][j] = 0;
-  for(i = nn-1; i >= 0; i--) {
-    fr = (nod[i].ndx)%3; frmod = 3 - fr;
-    if(nod[i].strand == 1 && nod[i].type == STOP) {
-      for(j = 0; j < 3; j++) ctr[fr][j] = 0;
-      last[fr] = nod[i].ndx;
-      ctr[fr][(gc[nod[i].ndx] + frmod)%3] = 1;
-    }
-    else if(nod[i].strand == 1) {
-      for(j = last[fr]-3; j >= nod[i].ndx; j-=3) ctr[fr][(gc[j] + frmod)%3] ++;
-      mfr = max_fr(ctr[fr][0], ctr[fr][1], ctr[fr][2]);
-      nod[i].gc_bias = mfr;
-      for(j = 0; j < 3; j++) {
-        nod[i].gc_score[j] = (3.0*ctr[fr][j]);
-        nod[i].gc_score[j] /= (1.0*(nod[i].stop_val - nod[i].ndx + 3));
-      }
-      last[fr] = nod[i].ndx;
-    }
-  }
-  for(i = 0; i < nn; i++) {
-    fr = (nod[i].ndx)%3; frmod = fr;
-    if(nod[i].strand == -1 && nod[i].type == STOP) {
-      for(j = 0; j < 3; j++) ctr[fr][j] = 0;
-      last[fr] = nod[i].ndx;
-      ctr[fr][((3-gc[nod[i].ndx]) + frmod)%3] = 1;
-    }
-    else if(nod[i].strand == -1) {
-      for(j = last[fr]+3; j <= nod[i].ndx; j+=3)
-        ctr[fr][((3-gc[j]) + frmod)%3]++;
-      mfr = max_fr(ctr[fr][0], ctr[fr][1], ctr[fr][2]);
-      nod[i].gc_bias = mfr;
-      for(j = 0; j < 3; j++) {
-        nod[i].gc_score[j] = (3.0*ctr[fr][j]);
-        nod[i].gc_score[j] /= (1.0*(nod[i].ndx - nod[i].stop_val + 3));
-      }
-      last[fr] = nod[i].ndx;
-    }
-  }
+  job.nod = nod; job.nn = nn; job.gc = gc;
+  if(nn < MIN_PAR_ITEMS) gc_bias_range(&job, 0, 6);
+  else parallel_tasks(6, gc_bias_range, &job);
 
   for(i = 0; i < 3; i++) tinf->bias[i] = 0.0;
   for(i = 0; i < nn; i++) {
@@ -316,6 +312,65 @@ void record_gc_bias(int *gc, struct _node *nod, int nn, struct _training
   for(i = 0; i < 3; i++) tinf->bias[i] *= (3.0/tot);
 }
 
+/*******************************************************************************
+  The ORFs of each strand and frame are walked on their own, so the passes
+  over nodes split into six tasks:  0-2 are the forward frames and 3-5 the
+  reverse ones.  This does the GC frame counts of tasks [lo, hi).
+*******************************************************************************/
+void gc_bias_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  struct _node *nod = job->nod;
+  int i, j, t, ctr[3], last = 0, frmod, fr, mfr, nn = job->nn, *gc = job->gc;
+
+  for(t = lo; t < hi; t++) {
+    fr = t%3;
+    for(j = 0; j < 3; j++) ctr[j] = 0;
+    if(t < 3) {
+      frmod = 3 - fr;
+      for(i = nn-1; i >= 0; i--) {
+        if(nod[i].strand != 1 || (nod[i].ndx)%3 != fr) continue;
+        if(nod[i].type == STOP) {
+          for(j = 0; j < 3; j++) ctr[j] = 0;
+          last = nod[i].ndx;
+          ctr[(gc[nod[i].ndx] + frmod)%3] = 1;
+        }
+        else {
+          for(j = last-3; j >= nod[i].ndx; j-=3) ctr[(gc[j] + frmod)%3]++;
+          mfr = max_fr(ctr[0], ctr[1], ctr[2]);
+          nod[i].gc_bias = mfr;
+          for(j = 0; j < 3; j++) {
+            nod[i].gc_score[j] = (3.0*ctr[j]);
+            nod[i].gc_score[j] /= (1.0*(nod[i].stop_val - nod[i].ndx + 3));
+          }
+          last = nod[i].ndx;
+        }
+      }
+    }
+    else {
+      frmod = fr;
+      for(i = 0; i < nn; i++) {
+        if(nod[i].strand != -1 || (nod[i].ndx)%3 != fr) continue;
+        if(nod[i].type == STOP) {
+          for(j = 0; j < 3; j++) ctr[j] = 0;
+          last = nod[i].ndx;
+          ctr[((3-gc[nod[i].ndx]) + frmod)%3] = 1;
+        }
+        else {
+          for(j = last+3; j <= nod[i].ndx; j+=3)
+            ctr[((3-gc[j]) + frmod)%3]++;
+          mfr = max_fr(ctr[0], ctr[1], ctr[2]);
+          nod[i].gc_bias = mfr;
+          for(j = 0; j < 3; j++) {
+            nod[i].gc_score[j] = (3.0*ctr[j]);
+            nod[i].gc_score[j] /= (1.0*(nod[i].ndx - nod[i].stop_val + 3));
+          }
+          last = nod[i].ndx;
+        }
+      }
+    }
+  }
+}
+
 /*******************************************************************************
   Simple routine that calculates the dicodon frequency in genes and in the
   background, and then stores the log likelihood of each 6-mer relative to the
@@ -373,37 +428,236 @@ void calc_dicodon_gene(struct _training *tinf, unsigned char *seq, unsigned
 *******************************************************************************/
 
 void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
-                 struct _node *nod, int nn, struct _training *tinf,
-                 int closed, int is_meta) {
-  int i, j;
-  double negf, posf, rbs1, rbs2, sd_score, edge_gene, min_meta_len;
+                 int *gc_sum, struct _node_feats *feat, struct _node *nod,
+                 int nn, struct _training *tinf, struct _motif_table *mt, int
+                 closed, int is_meta) {
+  score_node_slice(seq, rseq, slen, gc_sum, feat, nod, nn, tinf, mt, closed,
+                   is_meta, 0, nn);
+}
+
+/*******************************************************************************
+  Score the nodes 'nod', which are nodes 'base' on of the 'total' in the
+  whole sequence.  Only the starts within 500 nodes of either end of the
+  sequence are scored any differently for where they are, so a run of
+  whole ORFs gets the same scores here as in the full list.  'mt' is the
+  motif table built from tinf, and is only needed for non-SD models.
+*******************************************************************************/
+void score_node_slice(unsigned char *seq, unsigned char *rseq, int slen,
+                      int *gc_sum, struct _node_feats *feat, struct _node
+                      *nod, int nn, struct _training *tinf, struct
+                      _motif_table *mt, int closed, int is_meta, int base,
+                      int total) {
+  int i;
+  struct _score_job job;
+
+  job.seq = seq; job.rseq = rseq; job.slen = slen;
+  job.nod = nod; job.nn = nn; job.tinf = tinf; job.mt = mt; job.feat = feat;
+  job.ups = NULL; job.closed = closed; job.is_meta = is_meta;
+  job.base = base; job.total = total;
 
   /* Step 1: Calculate raw coding potential for every start-stop pair. */
-  calc_orf_gc(seq, rseq, slen, nod, nn, tinf);
-  raw_coding_score(seq, rseq, slen, nod, nn, tinf);
+  if(feat == NULL) calc_orf_gc(gc_sum, nod, nn);
+  if(feat != NULL && feat->bin >= 0) {
+    for(i = 0; i < nn; i++) {
+      if(nod[i].type == STOP) continue;
+      nod[i].cscore = feat->raw[i*feat->nbins+feat->bin];
+    }
+    finish_coding_score(nod, nn, tinf);
+  }
+  else raw_coding_score(seq, rseq, slen, nod, nn, tinf);
 
   /* Step 2: Calculate raw RBS Scores for every start node. */
-  if(tinf->uses_sd == 1) rbs_score(seq, rseq, slen, nod, nn, tinf);
-  else {
-    for(i = 0; i < nn; i++) {
-      if(nod[i].type == STOP || nod[i].edge == 1) continue;
-      find_best_upstream_motif(tinf, seq, rseq, slen, &nod[i], 2);
+  if(feat != NULL) {
+    if(tinf->uses_sd == 1) parallel_for(nn, cached_rbs_range, &job);
+    else {
+      job.ups = feat->ups;
+      parallel_for(nn, upstream_motif_range, &job);
     }
   }
+  else if(tinf->uses_sd == 1) rbs_score(seq, rseq, slen, nod, nn, tinf);
+  else {
+    job.ups = (unsigned short *)malloc(nn*UPS_MERS*sizeof(unsigned short));
+    if(job.ups == NULL) {
+      fprintf(stderr, "Malloc failed on upstream motif indices\n\n");
+      exit(11);
+    }
+    calc_upstream_mers(seq, rseq, slen, nod, nn, job.ups);
+    parallel_for(nn, upstream_motif_range, &job);
+    free(job.ups);
+    job.ups = NULL;
+  }
 
   /* Step 3: Score the start nodes */
-  for(i = 0; i < nn; i++) {
+  parallel_for(nn, score_start_range, &job);
+
+  /* Convert starts at base 1 and slen to edge genes if closed = 0 */
+  for(i = 0; i < nn; i++)
+    if(becomes_edge(&nod[i], slen, closed) == 1) nod[i].edge = 1;
+}
+
+/*******************************************************************************
+  When one set of nodes is scored many times over with different training
+  data (the metagenomic bins), everything score_nodes looks at that does not
+  depend on the weights is gathered here once: GC content, whether each
+  gene has a stop codon, the SD motifs upstream of each start, and the
+  upstream bases used for the motif and composition scores.  The nodes'
+  edge flags may change afterwards; the features cover every start.
+*******************************************************************************/
+void calc_node_feats(unsigned char *seq, unsigned char *rseq, int slen,
+                     int *gc_sum, struct _node *nod, int nn, struct _training
+                     *tinf, struct _node_feats *feat) {
+  struct _score_job job;
+
+  alloc_node_feats(feat, nn);
+  feat->bin = -1;
+  calc_orf_gc(gc_sum, nod, nn);
+  calc_upstream_mers(seq, rseq, slen, nod, nn, feat->ups);
+
+  job.seq = seq; job.rseq = rseq; job.slen = slen;
+  job.nod = nod; job.nn = nn; job.tinf = tinf; job.mt = NULL;
+  job.feat = feat; job.ups = NULL; job.closed = 0; job.is_meta = 0;
+  parallel_for(nn, node_feat_range, &job);
+}
+
+/* Make room in 'feat' for the features of 'nn' nodes. */
+void alloc_node_feats(struct _node_feats *feat, int nn) {
+  if(nn > feat->cap) {
+    if(feat->open != NULL) free(feat->open);
+    if(feat->sd != NULL) free(feat->sd);
+    if(feat->ups != NULL) free(feat->ups);
+    if(feat->ucomp != NULL) free(feat->ucomp);
+    feat->open = (unsigned char *)malloc(nn*sizeof(unsigned char));
+    feat->sd = (unsigned int *)malloc(nn*SD_POS*2*sizeof(unsigned int));
+    feat->ups = (unsigned short *)malloc(nn*UPS_MERS*sizeof(unsigned short));
+    feat->ucomp = (unsigned char *)malloc(nn*UPS_BASES*sizeof(unsigned char));
+    if(feat->open == NULL || feat->sd == NULL || feat->ups == NULL ||
+       feat->ucomp == NULL) {
+      fprintf(stderr, "Malloc failed on node features\n\n");
+      exit(11);
+    }
+    feat->cap = nn;
+  }
+}
+
+/* Gather the stop codon, SD motif and upstream base features for [lo, hi). */
+void node_feat_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  unsigned char *seq = job->seq, *rseq = job->rseq, *wseq, *uc;
+  int i, j, k, start, count, slen = job->slen;
+  unsigned int *sd;
+  struct _node *nod = job->nod;
+  struct _node_feats *feat = job->feat;
+
+  for(i = lo; i < hi; i++) {
+    if(nod[i].type == STOP) continue;
+    if(nod[i].strand == 1) {
+      wseq = seq; start = nod[i].ndx;
+      feat->open[i] = (is_stop(seq, nod[i].stop_val, job->tinf) == 0);
+    }
+    else {
+      wseq = rseq; start = slen-1-nod[i].ndx;
+      feat->open[i] = (is_stop(rseq, slen-1-nod[i].stop_val, job->tinf) == 0);
+    }
+
+    /* Same windows as rbs_score */
+    sd = &feat->sd[i*SD_POS*2];
+    for(k = 0; k < SD_POS; k++) {
+      j = start-20+k;
+      if((nod[i].strand == 1 && j < 0) || (nod[i].strand == -1 && j > slen-1))
+        { sd[2*k] = 0; sd[2*k+1] = 0; continue; }
+      sd[2*k] = sd_exact_motifs(wseq, j, start);
+      sd[2*k+1] = sd_mm_motifs(wseq, j, start);
+    }
+
+    /* Same positions as score_upstream_composition */
+    uc = &feat->ucomp[i*UPS_BASES];
+    count = 0;
+    for(j = 1; j < 45; j++) {
+      if(j > 2 && j < 15) continue;
+      if(start-j < 0) uc[count++] = NO_BASE;
+      else uc[count++] = mer_ndx(1, wseq, start-j);
+    }
+  }
+}
+
+void free_node_feats(struct _node_feats *feat) {
+  if(feat->dc != NULL) free(feat->dc);
+  if(feat->cdc != NULL) free(feat->cdc);
+  if(feat->raw != NULL) free(feat->raw);
+  if(feat->open != NULL) free(feat->open);
+  if(feat->sd != NULL) free(feat->sd);
+  if(feat->ups != NULL) free(feat->ups);
+  if(feat->ucomp != NULL) free(feat->ucomp);
+  memset(feat, 0, sizeof(struct _node_feats));
+}
+
+/* RBS scores for starts [lo, hi) from their stored SD motif sets. */
+void cached_rbs_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  int i, k, cur_sc[2];
+  unsigned int *sd;
+  struct _node *nod = job->nod;
+  double *rwt = job->tinf->rbs_wt;
+
+  for(i = lo; i < hi; i++) {
+    if(nod[i].type == STOP || nod[i].edge == 1) continue;
+    nod[i].rbs[0] = 0;
+    nod[i].rbs[1] = 0;
+    sd = &job->feat->sd[i*SD_POS*2];
+    for(k = 0; k < SD_POS; k++) {
+      if(sd[2*k] != 0) {
+        cur_sc[0] = best_rbs_motif(sd[2*k], rwt);
+        if(cur_sc[0] > nod[i].rbs[0]) nod[i].rbs[0] = cur_sc[0];
+      }
+      if(sd[2*k+1] != 0) {
+        cur_sc[1] = best_rbs_motif(sd[2*k+1], rwt);
+        if(cur_sc[1] > nod[i].rbs[1]) nod[i].rbs[1] = cur_sc[1];
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+  Returns 1 if score_nodes will turn this start into an edge node, i.e. it
+  sits within the first or last codon of an open-ended sequence.
+*******************************************************************************/
+int becomes_edge(struct _node *nod, int slen, int closed) {
+  if(closed == 1 || nod->type == STOP || nod->edge == 1) return 0;
+  if(nod->ndx <= 2 && nod->strand == 1) return 1;
+  if(nod->ndx >= slen-3 && nod->strand == -1) return 1;
+  return 0;
+}
+
+/*******************************************************************************
+  Score start nodes [lo, hi).  Each node writes only its own scores, so the
+  range can be handled by any thread.  Starts are converted to edge nodes
+  afterwards by score_nodes; until then, a forward start checking the nodes
+  before it treats those that will be converted as edges already, exactly as
+  a single pass in node order would.
+*******************************************************************************/
+void score_start_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  unsigned char *seq = job->seq, *rseq = job->rseq;
+  int i, j, edge, slen = job->slen;
+  int closed = job->closed, is_meta = job->is_meta;
+  double negf, posf, rbs1, rbs2, sd_score, edge_gene, min_meta_len;
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
+
+  for(i = lo; i < hi; i++) {
     if(nod[i].type == STOP) continue;
+    edge = nod[i].edge;
 
     /* Does this gene run off the edge? */
     edge_gene = 0;
-    if(nod[i].edge == 1) edge_gene++;
-    if((nod[i].strand == 1 && is_stop(seq, nod[i].stop_val,
+    if(edge == 1) edge_gene++;
+    if(job->feat != NULL) edge_gene += job->feat->open[i];
+    else if((nod[i].strand == 1 && is_stop(seq, nod[i].stop_val,
        tinf) == 0) || (nod[i].strand == -1 && is_stop(rseq, slen-1-
        nod[i].stop_val, tinf) == 0)) edge_gene++;
 
     /* Edge Nodes : stops with no starts, give a small bonus */
-    if(nod[i].edge == 1) {
+    if(edge == 1) {
       nod[i].tscore = EDGE_BONUS*tinf->st_wt/edge_gene;
       nod[i].uscore = 0.0;
       nod[i].rscore = 0.0;
@@ -426,7 +680,9 @@ void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
       }
 
       /* Upstream Score */
-      if(nod[i].strand == 1) 
+      if(job->feat != NULL)
+        score_upstream_bases(&job->feat->ucomp[i*UPS_BASES], &nod[i], tinf);
+      else if(nod[i].strand == 1) 
         score_upstream_composition(seq, slen, &nod[i], tinf);
       else score_upstream_composition(rseq, slen, &nod[i], tinf);
 
@@ -438,16 +694,17 @@ void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
         nod[i].uscore += EDGE_UPS*tinf->st_wt; 
       else if(closed == 0 && nod[i].ndx >= slen-3 && nod[i].strand == -1)
         nod[i].uscore += EDGE_UPS*tinf->st_wt; 
-      else if(i < 500 && nod[i].strand == 1) {
-        for(j = i-1; j >= 0; j--)
-          if(nod[j].edge == 1 && nod[i].stop_val == nod[j].stop_val) {
+      else if(job->base+i < 500 && nod[i].strand == 1 &&
+              nod[i].stop_ptr != -1) {
+        for(j = nod[nod[i].stop_ptr].stop_ptr; j < i; j = nod[j].next_start)
+          if(nod[j].edge == 1 || becomes_edge(&nod[j], slen, closed) == 1) {
             nod[i].uscore += EDGE_UPS*tinf->st_wt; 
             break;
           }
       }
-      else if(i >= nn-500 && nod[i].strand == -1) {
-        for(j = i+1; j < nn; j++)
-          if(nod[j].edge == 1 && nod[i].stop_val == nod[j].stop_val) {
+      else if(job->base+i >= job->total-500 && nod[i].strand == -1) {
+        for(j = nod[i].next_start; j != -1; j = nod[j].next_start)
+          if(nod[j].edge == 1) {
             nod[i].uscore += EDGE_UPS*tinf->st_wt; 
             break;
           }
@@ -455,18 +712,18 @@ void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
 
     }
 
-    /* Convert starts at base 1 and slen to edge genes if closed = 0 */
+    /* Starts at base 1 and slen become edge genes if closed = 0 */
     if(((nod[i].ndx <= 2 && nod[i].strand == 1) || (nod[i].ndx >= slen-3 &&
-       nod[i].strand == -1)) && nod[i].edge == 0 && closed == 0) {
+       nod[i].strand == -1)) && edge == 0 && closed == 0) {
       edge_gene++;
-      nod[i].edge = 1;
+      edge = 1;
       nod[i].tscore = 0.0;
       nod[i].uscore = EDGE_BONUS*tinf->st_wt/edge_gene;
       nod[i].rscore = 0.0;
     }
 
     /* Penalize starts with no stop codon */
-    if(nod[i].edge == 0 && edge_gene == 1) 
+    if(edge == 0 && edge_gene == 1) 
       nod[i].uscore -= 0.5*EDGE_BONUS*tinf->st_wt;
 
     /* Penalize non-edge genes < 250bp */
@@ -500,11 +757,11 @@ void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
     /* of coding than normal.                                     */
     /**************************************************************/
     if(nod[i].cscore < 0.0) {
-      if(edge_gene > 0 && nod[i].edge == 0) {
+      if(edge_gene > 0 && edge == 0) {
         if(is_meta == 0 || slen > 1500) nod[i].sscore -= tinf->st_wt;
         else nod[i].sscore -= (10.31 - 0.004*slen);
       }
-      else if(is_meta == 1 && slen < 3000 && nod[i].edge == 1) {
+      else if(is_meta == 1 && slen < 3000 && edge == 1) {
         min_meta_len = sqrt(slen)*5.0;
         if(abs(nod[i].ndx-nod[i].stop_val) >= min_meta_len) {
           if(nod[i].cscore >= 0) nod[i].cscore = -1.0;
@@ -520,44 +777,24 @@ void score_nodes(unsigned char *seq, unsigned char *rseq, int slen,
   }
 }
 
-/* Calculate the GC Content for each start-stop pair */
-void calc_orf_gc(unsigned char *seq, unsigned char *rseq, int slen, struct
-                 _node *nod, int nn, struct _training *tinf) {
-  int i, j, last[3], fr;
-  double gc[3], gsize = 0.0;
+/*******************************************************************************
+  Calculate the GC Content for each start-stop pair from the running frame
+  counts built by calc_gc_frame_sums.  Reverse strand genes have always been
+  measured as the stop codon plus the stretch from three bases past the stop
+  up to two bases past the start, and this keeps that.
+*******************************************************************************/
+void calc_orf_gc(int *gc_sum, struct _node *nod, int nn) {
+  int i, gc;
+  double gsize = 0.0;
 
-  /* Go through each start-stop pair and calculate the %GC of the gene */
-  for(i = 0; i < 3; i++) gc[i] = 0.0;
-  for(i = nn-1; i >= 0; i--) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == 1 && nod[i].type == STOP) {
-      last[fr] = nod[i].ndx;
-      gc[fr] = is_gc(seq, nod[i].ndx) + is_gc(seq, nod[i].ndx+1) +
-               is_gc(seq, nod[i].ndx+2);
-    }
-    else if(nod[i].strand == 1) {
-      for(j = last[fr]-3; j >= nod[i].ndx; j-=3)
-        gc[fr] += is_gc(seq, j) + is_gc(seq, j+1) + is_gc(seq, j+2);
-      gsize = (float)(abs(nod[i].stop_val-nod[i].ndx)+3.0);
-      nod[i].gc_cont = gc[fr]/gsize;
-      last[fr] = nod[i].ndx;
-    }
-  }
-  for(i = 0; i < 3; i++) gc[i] = 0.0;
   for(i = 0; i < nn; i++) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == -1 && nod[i].type == STOP) {
-      last[fr] = nod[i].ndx;
-      gc[fr] = is_gc(seq, nod[i].ndx) + is_gc(seq, nod[i].ndx-1) +
-               is_gc(seq, nod[i].ndx-2);
-    }
-    else if(nod[i].strand == -1) {
-      for(j = last[fr]+3; j <= nod[i].ndx; j+=3)
-        gc[fr] += is_gc(seq, j) + is_gc(seq, j+1) + is_gc(seq, j+2);
-      gsize = (float)(abs(nod[i].stop_val-nod[i].ndx)+3.0);
-      nod[i].gc_cont = gc[fr]/gsize;
-      last[fr] = nod[i].ndx;
-    }
+    if(nod[i].type == STOP) continue;
+    if(nod[i].strand == 1)
+      gc = gc_count(gc_sum, nod[i].ndx, nod[i].stop_val+3);
+    else gc = gc_count(gc_sum, nod[i].stop_val-2, nod[i].stop_val+1) +
+              gc_count(gc_sum, nod[i].stop_val+3, nod[i].ndx+3);
+    gsize = (float)(abs(nod[i].stop_val-nod[i].ndx)+3.0);
+    nod[i].gc_cont = gc/gsize;
   }
 }
 
@@ -565,114 +802,259 @@ void calc_orf_gc(unsigned char *seq, unsigned char *rseq, int slen, struct
   Score each candidate's coding.  We also sharpen coding/noncoding thresholds
   to prevent choosing interior starts when there is strong coding continuing
   upstream.
+
+  The hexamer at each codon shares its second codon with the hexamer one
+  codon downstream, so the walk from each stop keeps a rolling index per
+  frame and only reads one new codon per step.
 *******************************************************************************/
 
 void raw_coding_score(unsigned char *seq, unsigned char *rseq, int slen, struct
                       _node *nod, int nn, struct _training *tinf) {
-  int i, j, last[3], fr;
-  double score[3], lfac, no_stop, gsize = 0.0;
+  coding_sums(seq, rseq, slen, nod, nn, tinf, NULL);
+  finish_coding_score(nod, nn, tinf);
+}
 
-  if(tinf->trans_table != 11) { /* TGA or TAG is not a stop */
-    no_stop = ((1-tinf->gc)*(1-tinf->gc)*tinf->gc)/8.0;
-    no_stop += ((1-tinf->gc)*(1-tinf->gc)*(1-tinf->gc))/8.0;
-    no_stop = (1 - no_stop);
+/*******************************************************************************
+  Initial Pass: Score coding potential (start->stop), leaving the raw
+  hexamer sums in each start's cscore.  If 'redo' is not NULL, only the
+  ORFs whose stop node has redo set to 1 are walked.
+*******************************************************************************/
+void coding_sums(unsigned char *seq, unsigned char *rseq, int slen, struct
+                 _node *nod, int nn, struct _training *tinf, unsigned char
+                 *redo) {
+  struct _score_job job;
+
+  job.seq = seq; job.rseq = rseq; job.slen = slen;
+  job.nod = nod; job.nn = nn; job.tinf = tinf; job.redo = redo;
+  if(nn < MIN_PAR_ITEMS) coding_sum_range(&job, 0, 6);
+  else parallel_tasks(6, coding_sum_range, &job);
+}
+
+/* Hexamer sums for strand/frame tasks [lo, hi) (see gc_bias_range) */
+void coding_sum_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  unsigned char *seq = job->seq, *rseq = job->rseq, *redo = job->redo;
+  int i, j, t, last = 0, hex = 0, walk, fr, nn = job->nn, slen = job->slen;
+  double score;
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
+
+  for(t = lo; t < hi; t++) {
+    fr = t%3; score = 0.0; walk = 0;
+    if(t < 3) {
+      for(i = nn-1; i >= 0; i--) {
+        if(nod[i].strand != 1 || (nod[i].ndx)%3 != fr) continue;
+        if(nod[i].type == STOP) {
+          walk = (redo == NULL || redo[i] == 1);
+          last = nod[i].ndx;
+          hex = mer_ndx(3, seq, nod[i].ndx);
+          score = 0.0;
+        }
+        else if(walk == 1) {
+          for(j = last-3; j >= nod[i].ndx; j-=3) {
+            hex = ((hex & 63) << 6) | mer_ndx(3, seq, j);
+            score += tinf->gene_dc[hex];
+          }
+          nod[i].cscore = score;
+          last = nod[i].ndx;
+        }
+      }
+    }
+    else {
+      for(i = 0; i < nn; i++) {
+        if(nod[i].strand != -1 || (nod[i].ndx)%3 != fr) continue;
+        if(nod[i].type == STOP) {
+          walk = (redo == NULL || redo[i] == 1);
+          last = nod[i].ndx;
+          hex = mer_ndx(3, rseq, slen-nod[i].ndx-1);
+          score = 0.0;
+        }
+        else if(walk == 1) {
+          for(j = last+3; j <= nod[i].ndx; j+=3) {
+            hex = ((hex & 63) << 6) | mer_ndx(3, rseq, slen-j-1);
+            score += tinf->gene_dc[hex];
+          }
+          nod[i].cscore = score;
+          last = nod[i].ndx;
+        }
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+  The metagenomic bins that share a translation table all walk the same
+  hexamers of the same genes, just with different weights.  This performs
+  the initial pass of raw_coding_score for 'nb' bins at once: the weights
+  are laid out hexamer by hexamer with the bins side by side, so each
+  hexamer read from the sequence updates every bin's running sum in one
+  contiguous (vectorizable) loop.  Each bin's sums are built up in the same
+  order as raw_coding_score would, so the results are identical.
+
+  If 'compact' is 1, the weights are held as floats instead, halving the
+  table so that more bins' worth of it stays in cache.  The sums are still
+  kept in doubles, so the only error is the rounding of each weight:  the
+  weights lie within +/-5.0, where a float is off by at most 2^-22 (about
+  2.4e-7), so a start's raw sum is within 2.4e-7 per codon of the exact one
+  (under 0.001 for a 4000 codon gene).
+*******************************************************************************/
+void batch_coding_scores(unsigned char *seq, unsigned char *rseq, int slen,
+                         struct _node *nod, int nn, struct _training **tinf,
+                         int nb, struct _node_feats *feat, int compact) {
+  int i, j, b, last[3], hex[3], fr;
+  double *acc, *sc, *wt;
+  float *cwt;
+
+  if(nn == 0) return;
+  if(nb > feat->dc_cap || (compact == 1) != (feat->cdc != NULL)) {
+    if(feat->dc != NULL) free(feat->dc);
+    if(feat->cdc != NULL) free(feat->cdc);
+    feat->dc = NULL; feat->cdc = NULL;
+    if(compact == 1) feat->cdc = (float *)malloc(4096*nb*sizeof(float));
+    else feat->dc = (double *)malloc(4096*nb*sizeof(double));
+    feat->dc_cap = nb;
+  }
+  if(nn*nb > feat->raw_cap) {
+    if(feat->raw != NULL) free(feat->raw);
+    feat->raw = (double *)malloc(nn*nb*sizeof(double));
+    feat->raw_cap = nn*nb;
+  }
+  acc = (double *)malloc(3*nb*sizeof(double));
+  if((feat->dc == NULL && feat->cdc == NULL) || feat->raw == NULL ||
+     acc == NULL) {
+    fprintf(stderr, "Malloc failed on coding score batch\n\n");
+    exit(11);
+  }
+  if(compact == 1) {
+    for(i = 0; i < 4096; i++) for(b = 0; b < nb; b++)
+      feat->cdc[i*nb+b] = (float)tinf[b]->gene_dc[i];
   }
   else {
-    no_stop = ((1-tinf->gc)*(1-tinf->gc)*tinf->gc)/4.0;
-    no_stop += ((1-tinf->gc)*(1-tinf->gc)*(1-tinf->gc))/8.0;
-    no_stop = (1 - no_stop);
+    for(i = 0; i < 4096; i++)
+      for(b = 0; b < nb; b++) feat->dc[i*nb+b] = tinf[b]->gene_dc[i];
   }
+  feat->nbins = nb;
 
-  /* Initial Pass: Score coding potential (start->stop) */
-  for(i = 0; i < 3; i++) score[i] = 0.0;
   for(i = nn-1; i >= 0; i--) {
     fr = (nod[i].ndx)%3;
+    sc = &acc[fr*nb];
     if(nod[i].strand == 1 && nod[i].type == STOP) {
       last[fr] = nod[i].ndx;
-      score[fr] = 0.0;
+      hex[fr] = mer_ndx(3, seq, nod[i].ndx);
+      for(b = 0; b < nb; b++) sc[b] = 0.0;
     }
     else if(nod[i].strand == 1) {
-      for(j = last[fr]-3; j >= nod[i].ndx; j-=3)
-        score[fr] += tinf->gene_dc[mer_ndx(6, seq, j)];
-      nod[i].cscore = score[fr];
+      for(j = last[fr]-3; j >= nod[i].ndx; j-=3) {
+        hex[fr] = ((hex[fr] & 63) << 6) | mer_ndx(3, seq, j);
+        if(compact == 1) {
+          cwt = &feat->cdc[hex[fr]*nb];
+          for(b = 0; b < nb; b++) sc[b] += cwt[b];
+        }
+        else {
+          wt = &feat->dc[hex[fr]*nb];
+          for(b = 0; b < nb; b++) sc[b] += wt[b];
+        }
+      }
+      memcpy(&feat->raw[i*nb], sc, nb*sizeof(double));
       last[fr] = nod[i].ndx;
     }
   }
-  for(i = 0; i < 3; i++) score[i] = 0.0;
   for(i = 0; i < nn; i++) {
     fr = (nod[i].ndx)%3;
+    sc = &acc[fr*nb];
     if(nod[i].strand == -1 && nod[i].type == STOP) {
       last[fr] = nod[i].ndx;
-      score[fr] = 0.0;
+      hex[fr] = mer_ndx(3, rseq, slen-nod[i].ndx-1);
+      for(b = 0; b < nb; b++) sc[b] = 0.0;
     }
     else if(nod[i].strand == -1) {
-      for(j = last[fr]+3; j <= nod[i].ndx; j+=3)
-        score[fr] += tinf->gene_dc[mer_ndx(6, rseq, slen-j-1)];
-      nod[i].cscore = score[fr];
+      for(j = last[fr]+3; j <= nod[i].ndx; j+=3) {
+        hex[fr] = ((hex[fr] & 63) << 6) | mer_ndx(3, rseq, slen-j-1);
+        if(compact == 1) {
+          cwt = &feat->cdc[hex[fr]*nb];
+          for(b = 0; b < nb; b++) sc[b] += cwt[b];
+        }
+        else {
+          wt = &feat->dc[hex[fr]*nb];
+          for(b = 0; b < nb; b++) sc[b] += wt[b];
+        }
+      }
+      memcpy(&feat->raw[i*nb], sc, nb*sizeof(double));
       last[fr] = nod[i].ndx;
     }
   }
+  free(acc);
+}
 
-  /* Second Pass: Penalize start nodes with ascending coding to their left */
-  for(i = 0; i < 3; i++) score[i] = -10000.0;
-  for(i = 0; i < nn; i++) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == 1 && nod[i].type == STOP) score[fr] = -10000.0;
-    else if(nod[i].strand == 1) {
-      if(nod[i].cscore > score[fr]) score[fr] = nod[i].cscore;
-      else nod[i].cscore -= (score[fr] - nod[i].cscore);
-    }
+/*******************************************************************************
+  Once the raw hexamer sums are in each start's cscore, penalize starts with
+  better coding upstream and add the length factor.
+*******************************************************************************/
+void finish_coding_score(struct _node *nod, int nn, struct _training *tinf) {
+  struct _score_job job;
+
+  job.nod = nod; job.nn = nn; job.tinf = tinf;
+  if(nn < MIN_PAR_ITEMS) finish_coding_range(&job, 0, 6);
+  else parallel_tasks(6, finish_coding_range, &job);
+}
+
+/* Both passes for strand/frame tasks [lo, hi) (see gc_bias_range) */
+void finish_coding_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
+  int i, t, fr, nn = job->nn, beg, end, step, strand;
+  double score, lfac, no_stop, gsize = 0.0;
+
+  if(tinf->trans_table != 11) { /* TGA or TAG is not a stop */
+    no_stop = ((1-tinf->gc)*(1-tinf->gc)*tinf->gc)/8.0;
+    no_stop += ((1-tinf->gc)*(1-tinf->gc)*(1-tinf->gc))/8.0;
+    no_stop = (1 - no_stop);
   }
-  for(i = 0; i < 3; i++) score[i] = -10000.0;
-  for(i = nn-1; i >= 0; i--) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == -1 && nod[i].type == STOP) score[fr] = -10000.0;
-    else if(nod[i].strand == -1) {
-      if(nod[i].cscore > score[fr]) score[fr] = nod[i].cscore;
-      else nod[i].cscore -= (score[fr] - nod[i].cscore);
-    }
+  else {
+    no_stop = ((1-tinf->gc)*(1-tinf->gc)*tinf->gc)/4.0;
+    no_stop += ((1-tinf->gc)*(1-tinf->gc)*(1-tinf->gc))/8.0;
+    no_stop = (1 - no_stop);
   }
 
-  /* Third Pass: Add length-based factor to the score      */
-  /* Penalize start nodes based on length to their left    */
-  for(i = 0; i < nn; i++) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == 1 && nod[i].type == STOP) score[fr] = -10000.0;
-    else if(nod[i].strand == 1) {
-      gsize = ((float)(abs(nod[i].stop_val-nod[i].ndx)+3.0))/3.0;
-      if(gsize > 1000.0) {
-        lfac = log((1-pow(no_stop, 1000.0))/pow(no_stop, 1000.0));
-        lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
-        lfac *= (gsize - 80) / 920.0;
-      }
+  for(t = lo; t < hi; t++) {
+    fr = t%3;
+    if(t < 3) { strand = 1; beg = 0; end = nn; step = 1; }
+    else { strand = -1; beg = nn-1; end = -1; step = -1; }
+
+    /* Second Pass: Penalize start nodes with ascending coding to their left */
+    score = -10000.0;
+    for(i = beg; i != end; i += step) {
+      if(nod[i].strand != strand || (nod[i].ndx)%3 != fr) continue;
+      if(nod[i].type == STOP) score = -10000.0;
       else {
-        lfac = log((1-pow(no_stop, gsize))/pow(no_stop, gsize));
-        lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
+        if(nod[i].cscore > score) score = nod[i].cscore;
+        else nod[i].cscore -= (score - nod[i].cscore);
       }
-      if(lfac > score[fr]) score[fr] = lfac;
-      else lfac -= dmax(dmin(score[fr] - lfac, lfac), 0);
-      if(lfac > 3.0 && nod[i].cscore < 0.5*lfac) nod[i].cscore = 0.5*lfac;
-      nod[i].cscore += lfac;
     }
-  }
-  for(i = nn-1; i >= 0; i--) {
-    fr = (nod[i].ndx)%3;
-    if(nod[i].strand == -1 && nod[i].type == STOP) score[fr] = -10000.0;
-    else if(nod[i].strand == -1) {
-      gsize = ((float)(abs(nod[i].stop_val-nod[i].ndx)+3.0))/3.0;
-      if(gsize > 1000.0) {
-        lfac = log((1-pow(no_stop, 1000.0))/pow(no_stop, 1000.0));
-        lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
-        lfac *= (gsize - 80) / 920.0;
-      }
+
+    /* Third Pass: Add length-based factor to the score      */
+    /* Penalize start nodes based on length to their left    */
+    score = -10000.0;
+    for(i = beg; i != end; i += step) {
+      if(nod[i].strand != strand || (nod[i].ndx)%3 != fr) continue;
+      if(nod[i].type == STOP) score = -10000.0;
       else {
-        lfac = log((1-pow(no_stop, gsize))/pow(no_stop, gsize));
-        lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
+        gsize = ((float)(abs(nod[i].stop_val-nod[i].ndx)+3.0))/3.0;
+        if(gsize > 1000.0) {
+          lfac = log((1-pow(no_stop, 1000.0))/pow(no_stop, 1000.0));
+          lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
+          lfac *= (gsize - 80) / 920.0;
+        }
+        else {
+          lfac = log((1-pow(no_stop, gsize))/pow(no_stop, gsize));
+          lfac -= log((1-pow(no_stop, 80))/pow(no_stop, 80));
+        }
+        if(lfac > score) score = lfac;
+        else lfac -= dmax(dmin(score - lfac, lfac), 0);
+        if(lfac > 3.0 && nod[i].cscore < 0.5*lfac) nod[i].cscore = 0.5*lfac;
+        nod[i].cscore += lfac;
       }
-      if(lfac > score[fr]) score[fr] = lfac;
-      else lfac -= dmax(dmin(score[fr] - lfac, lfac), 0);
-      if(lfac > 3.0 && nod[i].cscore < 0.5*lfac) nod[i].cscore = 0.5*lfac;
-      nod[i].cscore += lfac;
     }
   }
 }
@@ -699,11 +1081,24 @@ void determine_sd_usage(struct _training *tinf) {
 *******************************************************************************/
 void rbs_score(unsigned char *seq, unsigned char *rseq, int slen, struct _node
                *nod, int nn, struct _training *tinf) {
-  int i, j;
+  struct _score_job job;
+
+  job.seq = seq; job.rseq = rseq; job.slen = slen;
+  job.nod = nod; job.nn = nn; job.tinf = tinf; job.mt = NULL;
+  job.ups = NULL; job.closed = 0; job.is_meta = 0;
+  parallel_for(nn, rbs_score_range, &job);
+}
+
+/* Scan starts [lo, hi) looking for RBS's.  Each node is independent. */
+void rbs_score_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  unsigned char *seq = job->seq, *rseq = job->rseq;
+  int i, j, slen = job->slen;
   int cur_sc[2];
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
 
-  /* Scan all starts looking for RBS's */
-  for(i = 0; i < nn; i++) {
+  for(i = lo; i < hi; i++) {
     if(nod[i].type == STOP || nod[i].edge == 1) continue;
     nod[i].rbs[0] = 0;
     nod[i].rbs[1] = 0;
@@ -737,15 +1132,17 @@ void rbs_score(unsigned char *seq, unsigned char *rseq, int slen, struct _node
   for Shine-Dalgarno motifs only.
 *******************************************************************************/
 void train_starts_sd(unsigned char *seq, unsigned char *rseq, int slen,
-                  struct _node *nod, int nn, struct _training *tinf) {
-  int i, j, fr, rbs[3], type[3], bndx[3], max_rb;
-  double sum, wt, rbg[28], rreal[28], best[3], sthresh = 35.0;
-  double tbg[3], treal[3];
+                     struct _node *nod, int nn, struct _training *tinf,
+                     struct _train_ctl *ctl) {
+  int i, j, k, b, last = SD_ITER-1;
+  double sum, rbg[28], rreal[28], sthresh = 35.0, thresh0, t0;
+  double tbg[3], treal[3], old_rbs[28], old_type[3], drbs, dtype;
+  struct _train_job job;
 
-  wt = tinf->st_wt;
   for(j = 0; j < 3; j++) tinf->type_wt[j] = 0.0;
   for(j = 0; j < 28; j++) tinf->rbs_wt[j] = 0.0;
   for(i = 0; i < 32; i++) for(j = 0; j < 4; j++) tinf->ups_comp[i][j] = 0.0;
+  init_train_job(&job, nod, nn, tinf, NULL, 28);
 
   /* Build the background of random types */
   for(i = 0; i < 3; i++) tbg[i] = 0.0;
@@ -757,24 +1154,21 @@ void train_starts_sd(unsigned char *seq, unsigned char *rseq, int slen,
   for(i = 0; i < 3; i++) sum += tbg[i];
   for(i = 0; i < 3; i++) tbg[i] /= sum;
 
-  /* Iterate 10 times through the list of nodes                         */
+  /* Iterate up to 10 times through the list of nodes                  */
   /* Converge upon optimal weights for ATG vs GTG vs TTG and RBS motifs */
-  /* (convergence typically takes 4-5 iterations, but we run a few     */
-  /* extra to be safe)                                                  */
-  for(i = 0; i < 10; i++) {
+  /* (convergence typically takes 4-5 iterations, so unless the run is  */
+  /* strict, we stop a round after the weights settle)                  */
+  for(i = 0; i <= last; i++) {
+    t0 = train_clock();
+    memcpy(old_rbs, tinf->rbs_wt, 28*sizeof(double));
+    memcpy(old_type, tinf->type_wt, 3*sizeof(double));
+    thresh0 = sthresh;
 
     /* Recalculate the RBS motif background */
-    for(j = 0; j < 28; j++) rbg[j] = 0.0;
-    for(j = 0; j < nn; j++) {
-      if(nod[j].type == STOP || nod[j].edge == 1) continue;
-      if(tinf->rbs_wt[nod[j].rbs[0]] > tinf->rbs_wt[nod[j].rbs[1]]+1.0 ||
-         nod[j].rbs[1] == 0)
-        max_rb = nod[j].rbs[0];
-      else if(tinf->rbs_wt[nod[j].rbs[0]] < tinf->rbs_wt[nod[j].rbs[1]]-1.0 ||
-        nod[j].rbs[0] == 0)
-        max_rb = nod[j].rbs[1];
-      else max_rb = (int)dmax(nod[j].rbs[0], nod[j].rbs[1]);
-      rbg[max_rb] += 1.0;
+    parallel_tasks(job.nslice, sd_background_range, &job);
+    for(j = 0; j < 28; j++) {
+      rbg[j] = 0.0;
+      for(k = 0; k < job.nslice; k++) rbg[j] += job.bg[k*28+j];
     }
     sum = 0.0;
     for(j = 0; j < 28; j++) sum += rbg[j];
@@ -783,74 +1177,25 @@ void train_starts_sd(unsigned char *seq, unsigned char *rseq, int slen,
     for(j = 0; j < 28; j++) rreal[j] = 0.0;
     for(j = 0; j < 3; j++) treal[j] = 0.0;
 
-    /* Forward strand pass */
-    for(j = 0; j < 3; j++) {
-      best[j] = 0.0; bndx[j] = -1; rbs[j] = 0; type[j] = 0;
-    }
+    /* Pick the best start of each ORF, then count the forward strand */
+    /* ORFs followed by the reverse ones.                             */
+    job.sthresh = sthresh;
+    parallel_for(nn, sd_pick_range, &job);
     for(j = 0; j < nn; j++) {
-      if(nod[j].type != STOP && nod[j].edge == 1) continue;
-      fr = (nod[j].ndx)%3;
-      if(nod[j].type == STOP && nod[j].strand == 1) {
-        if(best[fr] >= sthresh && nod[bndx[fr]].ndx%3 == fr) {
-          rreal[rbs[fr]] += 1.0;
-          treal[type[fr]] += 1.0;
-          if(i == 9) count_upstream_composition(seq, slen, 1,
-                      nod[bndx[fr]].ndx, tinf);          
-        }
-        best[fr] = 0.0; bndx[fr] = -1; rbs[fr] = 0; type[fr] = 0;
-      }
-      else if(nod[j].strand == 1) {
-        if(tinf->rbs_wt[nod[j].rbs[0]] > tinf->rbs_wt[nod[j].rbs[1]]+1.0 ||
-           nod[j].rbs[1] == 0)
-          max_rb = nod[j].rbs[0];
-        else if(tinf->rbs_wt[nod[j].rbs[0]] < tinf->rbs_wt[nod[j].rbs[1]]-1.0 ||
-                nod[j].rbs[0] == 0)
-          max_rb = nod[j].rbs[1];
-        else max_rb = (int)dmax(nod[j].rbs[0], nod[j].rbs[1]);
-        if(nod[j].cscore + wt*tinf->rbs_wt[max_rb] +
-           wt*tinf->type_wt[nod[j].type] >= best[fr]) {
-          best[fr] = nod[j].cscore + wt*tinf->rbs_wt[max_rb];
-          best[fr] += wt*tinf->type_wt[nod[j].type];
-          bndx[fr] = j;
-          type[fr] = nod[j].type;
-          rbs[fr] = max_rb;
-        }
-      }
-    }
-
-    /* Reverse strand pass */
-    for(j = 0; j < 3; j++) {
-      best[j] = 0.0; bndx[j] = -1; rbs[j] = 0; type[j] = 0;
+      if(nod[j].type != STOP || nod[j].strand != 1) continue;
+      if((b = job.pick[j]) == -1) continue;
+      rreal[max_rbs_motif(&nod[b], tinf->rbs_wt)] += 1.0;
+      treal[nod[b].type] += 1.0;
+      if(i == last)
+        count_upstream_composition(seq, slen, 1, nod[b].ndx, tinf);
     }
     for(j = nn-1; j >= 0; j--) {
-      if(nod[j].type != STOP && nod[j].edge == 1) continue;
-      fr = (nod[j].ndx)%3;
-      if(nod[j].type == STOP && nod[j].strand == -1) {
-        if(best[fr] >= sthresh && nod[bndx[fr]].ndx%3 == fr) {
-          rreal[rbs[fr]] += 1.0;
-          treal[type[fr]] += 1.0;
-          if(i == 9) count_upstream_composition(rseq, slen, -1,
-                      nod[bndx[fr]].ndx, tinf);          
-        }
-        best[fr] = 0.0; bndx[fr] = -1; rbs[fr] = 0; type[fr] = 0;
-      }
-      else if(nod[j].strand == -1) {
-        if(tinf->rbs_wt[nod[j].rbs[0]] > tinf->rbs_wt[nod[j].rbs[1]]+1.0 ||
-           nod[j].rbs[1] == 0)
-          max_rb = nod[j].rbs[0];
-        else if(tinf->rbs_wt[nod[j].rbs[0]] < tinf->rbs_wt[nod[j].rbs[1]]-1.0 ||
-           nod[j].rbs[0] == 0)
-          max_rb = nod[j].rbs[1];
-        else max_rb = (int)dmax(nod[j].rbs[0], nod[j].rbs[1]);
-        if(nod[j].cscore + wt*tinf->rbs_wt[max_rb] +
-           wt*tinf->type_wt[nod[j].type] >= best[fr]) {
-          best[fr] = nod[j].cscore + wt*tinf->rbs_wt[max_rb];
-          best[fr] += wt*tinf->type_wt[nod[j].type];
-          bndx[fr] = j;
-          type[fr] = nod[j].type;
-          rbs[fr] = max_rb;
-        }
-      }
+      if(nod[j].type != STOP || nod[j].strand != -1) continue;
+      if((b = job.pick[j]) == -1) continue;
+      rreal[max_rbs_motif(&nod[b], tinf->rbs_wt)] += 1.0;
+      treal[nod[b].type] += 1.0;
+      if(i == last)
+        count_upstream_composition(rseq, slen, -1, nod[b].ndx, tinf);
     }
 
     sum = 0.0;
@@ -878,7 +1223,14 @@ void train_starts_sd(unsigned char *seq, unsigned char *rseq, int slen,
       }
     }
     if(sum <= (double)nn/2000.0) sthresh /= 2.0;
+
+    drbs = max_change(old_rbs, tinf->rbs_wt, 28);
+    dtype = max_change(old_type, tinf->type_wt, 3);
+    log_train_iter(ctl, "sd", i+1, 0, sum, drbs, dtype, train_clock()-t0);
+    if(i < last-1 && train_converged(ctl, i+1, SD_MIN_ITER, dmax(drbs, dtype),
+       sthresh != thresh0) == 1) last = i+1;
   }
+  free_train_job(&job);
 
 /* Convert upstream base composition to a log score */
 for(i = 0; i < 32; i++) {
@@ -936,14 +1288,41 @@ exit(0); */
   algorithm, it allows for any popular motif to be discovered.
 *******************************************************************************/
 void train_starts_nonsd(unsigned char *seq, unsigned char *rseq, int slen,
-                  struct _node *nod, int nn, struct _training *tinf) {
-  int i, j, k, l, fr, bndx[3], mgood[4][4][4096], stage;
-  double sum, ngenes, wt = tinf->st_wt, best[3], sthresh = 35.0;
-  double tbg[3], treal[3];
-  double mbg[4][4][4096], mreal[4][4][4096], zbg, zreal;
+                        struct _node *nod, int nn, struct _training *tinf,
+                        struct _train_ctl *ctl) {
+  int i, j, e, t, b, stage = 0, it = 0, last = 0, conv = 0, nwt = -1;
+  int max_it[3] = { 4, 8, 8 }, min_it[3] = NONSD_MIN_ITER, *wt_used;
+  double sum, ngenes, sthresh = 35.0, thresh0, t0, old, w, dmot, dtype;
+  double tbg[3], treal[3], old_type[3], *wt = &tinf->mot_wt[0][0][0];
+  unsigned char good[64];
+  unsigned short *ups;
+  struct _motif_counts mbg, mreal;
+  struct _motif_table mtab;
+  struct _train_job job;
 
   for(i = 0; i < 32; i++) for(j = 0; j < 4; j++) tinf->ups_comp[i][j] = 0.0;
 
+  /* The upstream motif indices never change between iterations */
+  ups = (unsigned short *)malloc(nn*UPS_MERS*sizeof(unsigned short));
+  if(ups == NULL) {
+    fprintf(stderr, "Malloc failed on upstream motif indices\n\n");
+    exit(11);
+  }
+  calc_upstream_mers(seq, rseq, slen, nod, nn, ups);
+  init_train_job(&job, nod, nn, tinf, ups, 0);
+  init_motif_table(&mtab);
+  job.mt = &mtab;
+
+  /* Motif counts, and the weights last set to something other than -4.0 */
+  /* (-1 until every other weight is known to be -4.0)                  */
+  alloc_motif_counts(&mbg);
+  alloc_motif_counts(&mreal);
+  wt_used = (int *)malloc(MOTIF_ENTRIES*sizeof(int));
+  if(wt_used == NULL) {
+    fprintf(stderr, "Malloc failed on motif weight list\n\n");
+    exit(11);
+  }
+
   /* Build the background of random types */
   for(i = 0; i < 3; i++) tinf->type_wt[i] = 0.0;
   for(i = 0; i < 3; i++) tbg[i] = 0.0;
@@ -955,126 +1334,116 @@ void train_starts_nonsd(unsigned char *seq, unsigned char *rseq, int slen,
   for(i = 0; i < 3; i++) sum += tbg[i];
   for(i = 0; i < 3; i++) tbg[i] /= sum;
 
-  /* Iterate 20 times through the list of nodes                         */
-  /* Converge upon optimal weights for ATG vs GTG vs TTG and RBS motifs */
-  /* (convergence typically takes 4-5 iterations, but we run a few      */
-  /* extra to be safe)                                                  */
-  for(i = 0; i < 20; i++) {
-
-    /* Determine which stage of motif finding we're in */
-    if(i < 4) stage = 0;
-    else if(i < 12) stage = 1;
-    else stage = 2;
+  /* Iterate up to 20 times through the list of nodes, in three stages */
+  /* of 4, 8 and 8.  Converge upon optimal weights for ATG vs GTG vs    */
+  /* TTG and RBS motifs (convergence typically takes 4-5 iterations,    */
+  /* so unless the run is strict, each stage ends once its weights      */
+  /* settle, and the last a round after that)                           */
+  for(i = 0; last == 0; i++) {
+    last = (conv == 1 || (stage == 2 && it == max_it[2]-1));
+    t0 = train_clock();
+    memcpy(old_type, tinf->type_wt, 3*sizeof(double));
+    thresh0 = sthresh;
 
     /* Recalculate the upstream motif background and set 'real' counts to 0 */
-    for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-      mbg[j][k][l] = 0.0;
-    zbg = 0.0;
-    for(j = 0; j < nn; j++) {
-      if(nod[j].type == STOP || nod[j].edge == 1) continue;
-      find_best_upstream_motif(tinf, seq, rseq, slen, &nod[j], stage);
-      update_motif_counts(mbg, &zbg, seq, rseq, slen, &(nod[j]), stage);
-    }
+    build_motif_table(&mtab, tinf);
+    job.stage = stage;
+    parallel_tasks(job.nslice, motif_background_range, &job);
+    clear_motif_counts(&mbg);
+    for(t = 0; t < job.nslice; t++) merge_motif_counts(&mbg, &job.mc[t]);
     sum = 0.0;
-    for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-      sum += mbg[j][k][l];
-    sum += zbg;
-    for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-      mbg[j][k][l] /= sum;
-    zbg /= sum;
+    for(j = 0; j < mbg.nused; j++) sum += mbg.cnt[mbg.used[j]];
+    sum += mbg.zero;
+    for(j = 0; j < mbg.nused; j++) mbg.cnt[mbg.used[j]] /= sum;
+    mbg.zero /= sum;
 
     /* Reset counts of 'real' motifs/types to 0 */
-    for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-      mreal[j][k][l] = 0.0;
-    zreal = 0.0;
+    clear_motif_counts(&mreal);
     for(j = 0; j < 3; j++) treal[j] = 0.0;
     ngenes = 0.0;
 
-    /* Forward strand pass */
-    for(j = 0; j < 3; j++) { best[j] = 0.0; bndx[j] = -1; }
+    /* Pick the best start of each ORF, then count the forward strand */
+    /* ORFs followed by the reverse ones.                             */
+    job.sthresh = sthresh;
+    parallel_for(nn, motif_pick_range, &job);
     for(j = 0; j < nn; j++) {
-      if(nod[j].type != STOP && nod[j].edge == 1) continue;
-      fr = (nod[j].ndx)%3;
-      if(nod[j].type == STOP && nod[j].strand == 1) {
-        if(best[fr] >= sthresh) {
-          ngenes += 1.0;
-          treal[nod[bndx[fr]].type] += 1.0;
-          update_motif_counts(mreal, &zreal, seq, rseq, slen, &(nod[bndx[fr]]),
-                              stage);
-          if(i == 19) count_upstream_composition(seq, slen, 1,
-                      nod[bndx[fr]].ndx, tinf);          
-        }
-        best[fr] = 0.0; bndx[fr] = -1;
-      }
-      else if(nod[j].strand == 1) {
-        if(nod[j].cscore + wt*nod[j].mot.score + wt*tinf->type_wt[nod[j].type]
-           >= best[fr]) {
-          best[fr] = nod[j].cscore + wt*nod[j].mot.score;
-          best[fr] += wt*tinf->type_wt[nod[j].type];
-          bndx[fr] = j;
-        }
-      }
+      if(nod[j].type != STOP || nod[j].strand != 1) continue;
+      if((b = job.pick[j]) == -1) continue;
+      ngenes += 1.0;
+      treal[nod[b].type] += 1.0;
+      update_motif_counts(&mreal, &ups[b*UPS_MERS], &(nod[b]), stage);
+      if(last == 1)
+        count_upstream_composition(seq, slen, 1, nod[b].ndx, tinf);
     }
-
-    /* Reverse strand pass */
-    for(j = 0; j < 3; j++) { best[j] = 0.0; bndx[j] = -1; }
     for(j = nn-1; j >= 0; j--) {
-      if(nod[j].type != STOP && nod[j].edge == 1) continue;
-      fr = (nod[j].ndx)%3;
-      if(nod[j].type == STOP && nod[j].strand == -1) {
-        if(best[fr] >= sthresh) {
-          ngenes += 1.0;
-          treal[nod[bndx[fr]].type] += 1.0;
-          update_motif_counts(mreal, &zreal, seq, rseq, slen, &(nod[bndx[fr]]),
-                              stage);
-          if(i == 19) count_upstream_composition(rseq, slen, -1,
-                      nod[bndx[fr]].ndx, tinf);          
-        }
-        best[fr] = 0.0; bndx[fr] = -1;
-      }
-      else if(nod[j].strand == -1) {
-        if(nod[j].cscore + wt*nod[j].mot.score + wt*tinf->type_wt[nod[j].type]
-           >= best[fr]) {
-          best[fr] = nod[j].cscore + wt*nod[j].mot.score;
-          best[fr] += wt*tinf->type_wt[nod[j].type];
-          bndx[fr] = j;
-        }
-      }
-    }
-
-    /* Update the log likelihood weights for type and RBS motifs */
-    if(stage < 2) build_coverage_map(mreal, mgood, ngenes, stage);
+      if(nod[j].type != STOP || nod[j].strand != -1) continue;
+      if((b = job.pick[j]) == -1) continue;
+      ngenes += 1.0;
+      treal[nod[b].type] += 1.0;
+      update_motif_counts(&mreal, &ups[b*UPS_MERS], &(nod[b]), stage);
+      if(last == 1)
+        count_upstream_composition(rseq, slen, -1, nod[b].ndx, tinf);
+    }
+
+    /* Update the log likelihood weights for type and RBS motifs.  Only */
+    /* the motifs counted get a weight above -4.0.  They are taken in    */
+    /* index order, so the no-motif sums round as in a pass over all.    */
+    if(stage < 2) build_coverage_map(&mreal, good, ngenes);
     sum = 0.0;
-    for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-      sum += mreal[j][k][l];
-    sum += zreal;
+    for(j = 0; j < mreal.nused; j++) sum += mreal.cnt[mreal.used[j]];
+    sum += mreal.zero;
+    dmot = 0.0; old = tinf->no_mot;
     if(sum == 0.0) {
-      for(j = 0; j < 4; j++) for(k = 0; k < 4; k++) for(l = 0; l < 4096; l++)
-        tinf->mot_wt[j][k][l] = 0.0;
+      for(e = 0; e < MOTIF_ENTRIES; e++) {
+        dmot = dmax(dmot, fabs(wt[e]));
+        wt[e] = 0.0;
+      }
       tinf->no_mot = 0.0;
+      nwt = -1;
     }
     else {
-      for(j = 0; j < 4; j++) for(k = 0; k < 4; k++)
-      for(l = 0; l < 4096; l++) {{{
-        if(mgood[j][k][l] == 0) {
-          zreal += mreal[j][k][l];
-          zbg += mreal[j][k][l];
-          mreal[j][k][l] = 0.0;
-          mbg[j][k][l] = 0.0;
+      qsort(mreal.used, mreal.nused, sizeof(int), &compare_ints);
+      for(j = 0; j < mreal.nused; j++) {
+        e = mreal.used[j];
+        if(motif_coverage(good, e) == 0) {
+          mreal.zero += mreal.cnt[e];
+          mbg.zero += mreal.cnt[e];
+          mreal.cnt[e] = 0.0;
+          mbg.cnt[e] = 0.0;
+        }
+        mreal.cnt[e] /= sum;
+        if(mbg.cnt[e] != 0) w = log(mreal.cnt[e]/mbg.cnt[e]);
+        else w = -4.0;
+        if(w > 4.0) w = 4.0;
+        if(w < -4.0) w = -4.0;
+        dmot = dmax(dmot, fabs(w - wt[e]));
+        wt[e] = w;
+      }
+      if(nwt == -1) {
+        for(e = 0; e < MOTIF_ENTRIES; e++) {
+          if(mreal.cnt[e] != 0.0) continue;
+          dmot = dmax(dmot, fabs(wt[e] + 4.0));
+          wt[e] = -4.0;
+        }
+      }
+      else {
+        for(j = 0; j < nwt; j++) {
+          e = wt_used[j];
+          if(mreal.cnt[e] != 0.0) continue;
+          dmot = dmax(dmot, fabs(wt[e] + 4.0));
+          wt[e] = -4.0;
         }
-        mreal[j][k][l] /= sum;
-        if(mbg[j][k][l] != 0)
-          tinf->mot_wt[j][k][l] = log(mreal[j][k][l]/mbg[j][k][l]);
-        else tinf->mot_wt[j][k][l] = -4.0;
-        if(tinf->mot_wt[j][k][l] > 4.0) tinf->mot_wt[j][k][l] = 4.0;
-        if(tinf->mot_wt[j][k][l] < -4.0) tinf->mot_wt[j][k][l] = -4.0;
-      }}}
-    }
-    zreal /= sum;
-    if(zbg != 0) tinf->no_mot = log(zreal/zbg);
+      }
+      nwt = 0;
+      for(j = 0; j < mreal.nused; j++)
+        if(wt[mreal.used[j]] != -4.0) wt_used[nwt++] = mreal.used[j];
+    }
+    mreal.zero /= sum;
+    if(mbg.zero != 0) tinf->no_mot = log(mreal.zero/mbg.zero);
     else tinf->no_mot = -4.0;
     if(tinf->no_mot > 4.0) tinf->no_mot = 4.0;
     if(tinf->no_mot < -4.0) tinf->no_mot = -4.0;
+    dmot = dmax(dmot, fabs(tinf->no_mot - old));
     sum = 0.0;
     for(j = 0; j < 3; j++) sum += treal[j];
     if(sum == 0.0) for(j = 0; j < 3; j++) tinf->type_wt[j] = 0.0;
@@ -1088,7 +1457,26 @@ void train_starts_nonsd(unsigned char *seq, unsigned char *rseq, int slen,
       }
     }
     if(sum <= (double)nn/2000.0) sthresh /= 2.0;
+
+    /* Move on to the next stage once this one is done */
+    dtype = max_change(old_type, tinf->type_wt, 3);
+    log_train_iter(ctl, "nonsd", i+1, stage, ngenes, dmot, dtype,
+                   train_clock()-t0);
+    it++;
+    conv = train_converged(ctl, it, min_it[stage], dmax(dmot, dtype),
+                           sthresh != thresh0);
+    if(stage < 2 && (it == max_it[stage] || conv == 1)) {
+      stage++;
+      it = 0;
+      conv = 0;
+    }
   }
+  free_train_job(&job);
+  free_motif_table(&mtab);
+  free_motif_counts(&mbg);
+  free_motif_counts(&mreal);
+  free(wt_used);
+  free(ups);
 
 /* Convert upstream base composition to a log score */
 for(i = 0; i < 32; i++) {
@@ -1134,8 +1522,9 @@ for(j = 0; j < 4096; j++) {
     mer_text(qt, k+3, j);
     printf("%s\t", qt);
     for(l = 0; l < 4; l++) {
-      printf("Dist %d Counts %.2f BG %.2f Val %.2f\t", l, mreal[k][l][j],
-             mbg[k][l][j], tinf->mot_wt[k][l][j]);
+      printf("Dist %d Counts %.2f BG %.2f Val %.2f\t", l,
+             mreal.cnt[(k*4+l)*4096+j], mbg.cnt[(k*4+l)*4096+j],
+             tinf->mot_wt[k][l][j]);
     }
     printf("\n");
   }
@@ -1145,6 +1534,190 @@ exit(0);
 
 }
 
+/*******************************************************************************
+  The start trainers stop iterating once no weight moves by more than the
+  tolerance in a round, they have run the minimum number of rounds, and
+  the score threshold for counting a start has held still.  Strict runs
+  always do the full count.
+*******************************************************************************/
+int train_converged(struct _train_ctl *ctl, int iter, int min_iter, double
+                    delta, int moved) {
+  if(ctl->strict == 1 || iter < min_iter || moved == 1) return 0;
+  return (delta < ctl->tol);
+}
+
+/* Largest change between two sets of weights */
+double max_change(double *old, double *cur, int n) {
+  int i;
+  double d = 0.0;
+
+  for(i = 0; i < n; i++) d = dmax(d, fabs(cur[i] - old[i]));
+  return d;
+}
+
+/*******************************************************************************
+  One line per round to the training log (if any):  trainer, round, motif
+  stage, starts counted, largest change in the motif and start type
+  weights, and seconds taken.
+*******************************************************************************/
+void log_train_iter(struct _train_ctl *ctl, char *name, int iter, int stage,
+                    double ngenes, double dmot, double dtype, double secs) {
+  if(ctl->log == NULL) return;
+  fprintf(ctl->log, "%s\t%d\t%d\t%.0f\t%.6f\t%.6f\t%.4f\n", name, iter,
+          stage, ngenes, dmot, dtype, secs);
+}
+
+/* Wall clock time in seconds */
+double train_clock() {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/*******************************************************************************
+  Shared state for the parallel passes of the start trainers.  The
+  background counts are split into one slice of nodes per thread, each
+  with its own histogram of 'hsize' entries, and summed once all are done;
+  being whole counts, the sums come out the same in any order.  'ups' is
+  only used by the non-SD trainer, whose slices keep sparse motif counts
+  rather than a histogram ('hsize' is 0).
+*******************************************************************************/
+void init_train_job(struct _train_job *job, struct _node *nod, int nn, struct
+                    _training *tinf, unsigned short *ups, int hsize) {
+  int t;
+
+  job->nod = nod; job->nn = nn; job->tinf = tinf; job->mt = NULL;
+  job->ups = ups;
+  job->stage = 0; job->sthresh = 0.0; job->hsize = hsize;
+  job->nslice = num_threads();
+  job->bg = NULL; job->mc = NULL;
+  if(hsize > 0) job->bg = (double *)malloc(job->nslice*hsize*sizeof(double));
+  if(ups != NULL) job->mc = (struct _motif_counts *)
+                  malloc(job->nslice*sizeof(struct _motif_counts));
+  job->pick = (int *)malloc(nn*sizeof(int));
+  if((hsize > 0 && job->bg == NULL) || (ups != NULL && job->mc == NULL) ||
+     job->pick == NULL) {
+    fprintf(stderr, "Malloc failed on start training counts\n\n");
+    exit(11);
+  }
+  if(ups != NULL) for(t = 0; t < job->nslice; t++)
+    alloc_motif_counts(&job->mc[t]);
+}
+
+void free_train_job(struct _train_job *job) {
+  int t;
+
+  if(job->mc != NULL) for(t = 0; t < job->nslice; t++)
+    free_motif_counts(&job->mc[t]);
+  free(job->bg);
+  free(job->mc);
+  free(job->pick);
+}
+
+/* Count the RBS motif background of node slices [lo, hi) */
+void sd_background_range(void *arg, int lo, int hi) {
+  struct _train_job *job = (struct _train_job *)arg;
+  struct _node *nod = job->nod;
+  int i, t;
+  double *rbg;
+
+  for(t = lo; t < hi; t++) {
+    rbg = &job->bg[t*job->hsize];
+    for(i = 0; i < job->hsize; i++) rbg[i] = 0.0;
+    for(i = (int)((long)job->nn*t/job->nslice);
+        i < (int)((long)job->nn*(t+1)/job->nslice); i++) {
+      if(nod[i].type == STOP || nod[i].edge == 1) continue;
+      rbg[max_rbs_motif(&nod[i], job->tinf->rbs_wt)] += 1.0;
+    }
+  }
+}
+
+/* Find the best motifs and count the motif background of slices [lo, hi) */
+void motif_background_range(void *arg, int lo, int hi) {
+  struct _train_job *job = (struct _train_job *)arg;
+  struct _node *nod = job->nod;
+  int i, t;
+
+  for(t = lo; t < hi; t++) {
+    clear_motif_counts(&job->mc[t]);
+    for(i = (int)((long)job->nn*t/job->nslice);
+        i < (int)((long)job->nn*(t+1)/job->nslice); i++) {
+      if(nod[i].type == STOP || nod[i].edge == 1) continue;
+      find_best_upstream_motif(job->tinf, job->mt, &job->ups[i*UPS_MERS],
+                               &nod[i], job->stage);
+      update_motif_counts(&job->mc[t], &job->ups[i*UPS_MERS], &nod[i],
+                          job->stage);
+    }
+  }
+}
+
+/*******************************************************************************
+  The RBS motif a start is scored with:  the better of its exact and
+  mismatched matches, unless the two weights are within 1.0 of each other,
+  in which case the longer one.
+*******************************************************************************/
+int max_rbs_motif(struct _node *nod, double *rbs_wt) {
+  if(rbs_wt[nod->rbs[0]] > rbs_wt[nod->rbs[1]]+1.0 || nod->rbs[1] == 0)
+    return nod->rbs[0];
+  if(rbs_wt[nod->rbs[0]] < rbs_wt[nod->rbs[1]]-1.0 || nod->rbs[0] == 0)
+    return nod->rbs[1];
+  return (int)dmax(nod->rbs[0], nod->rbs[1]);
+}
+
+/*******************************************************************************
+  For each stop in [lo, hi), pick the highest scoring start of its ORF,
+  leaving -1 if it doesn't reach the threshold.  Ties go to the start the
+  old strand passes would have kept:  the last one on the forward strand
+  (walking up to the stop) and the first one on the reverse strand
+  (walking down to it).  Each ORF is independent.
+*******************************************************************************/
+void sd_pick_range(void *arg, int lo, int hi) {
+  struct _train_job *job = (struct _train_job *)arg;
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
+  int i, j, bndx;
+  double sc, best, wt = tinf->st_wt;
+
+  for(i = lo; i < hi; i++) {
+    if(nod[i].type != STOP) continue;
+    best = 0.0; bndx = -1;
+    for(j = nod[i].stop_ptr; j != -1; j = nod[j].next_start) {
+      if(nod[j].edge == 1) continue;
+      sc = nod[j].cscore + wt*tinf->rbs_wt[max_rbs_motif(&nod[j],
+           tinf->rbs_wt)] + wt*tinf->type_wt[nod[j].type];
+      if(sc > best || (sc == best && (nod[i].strand == 1 || bndx == -1))) {
+        best = sc;
+        bndx = j;
+      }
+    }
+    job->pick[i] = (best >= job->sthresh) ? bndx : -1;
+  }
+}
+
+/* As sd_pick_range, but scoring starts by their best upstream motif */
+void motif_pick_range(void *arg, int lo, int hi) {
+  struct _train_job *job = (struct _train_job *)arg;
+  struct _node *nod = job->nod;
+  struct _training *tinf = job->tinf;
+  int i, j, bndx;
+  double sc, best, wt = tinf->st_wt;
+
+  for(i = lo; i < hi; i++) {
+    if(nod[i].type != STOP) continue;
+    best = 0.0; bndx = -1;
+    for(j = nod[i].stop_ptr; j != -1; j = nod[j].next_start) {
+      if(nod[j].edge == 1) continue;
+      sc = nod[j].cscore + wt*nod[j].mot.score + wt*tinf->type_wt[nod[j].type];
+      if(sc > best || (sc == best && (nod[i].strand == 1 || bndx == -1))) {
+        best = sc;
+        bndx = j;
+      }
+    }
+    job->pick[i] = (best >= job->sthresh) ? bndx : -1;
+  }
+}
+
 /*******************************************************************************
   For a given start, record the base composition of the upstream region at
   positions -1 and -2 and -15 to -44.  This will be used to supplement the
@@ -1184,34 +1757,79 @@ void score_upstream_composition(unsigned char *seq, int slen, struct _node *nod,
   }
 }
 
+/* As above, from the bases stored by calc_node_feats. */
+void score_upstream_bases(unsigned char *uc, struct _node *nod,
+                          struct _training *tinf) {
+  int i;
+
+  nod->uscore = 0.0;
+  for(i = 0; i < UPS_BASES && uc[i] != NO_BASE; i++)
+    nod->uscore += 0.4*tinf->st_wt*tinf->ups_comp[i][uc[i]];
+}
+
+/*******************************************************************************
+  The 3-6bp motifs searched for upstream of a start all begin between 21 and
+  6bp before it, and a shorter motif's index is just the low bits of the 6bp
+  index at the same position.  This routine stores the 6bp index at each of
+  those UPS_MERS positions for every start, once per set of nodes, so the
+  motif search and counting below never touch the sequence.  Positions
+  before the beginning of the sequence are set to NO_MER.
+*******************************************************************************/
+void calc_upstream_mers(unsigned char *seq, unsigned char *rseq, int slen,
+                        struct _node *nod, int nn, unsigned short *ups) {
+  int i, j, start;
+  unsigned char *wseq;
+
+  for(i = 0; i < nn; i++) {
+    if(nod[i].type == STOP) continue;
+    if(nod[i].strand == 1) { wseq = seq; start = nod[i].ndx; }
+    else { wseq = rseq; start = slen-1-nod[i].ndx; }
+    for(j = 0; j < UPS_MERS; j++) {
+      if(start-UPS_START+j < 0) ups[i*UPS_MERS+j] = NO_MER;
+      else ups[i*UPS_MERS+j] = mer_ndx(6, wseq, start-UPS_START+j);
+    }
+  }
+}
+
+/* Find the best upstream motif (final stage) for nodes [lo, hi). */
+void upstream_motif_range(void *arg, int lo, int hi) {
+  struct _score_job *job = (struct _score_job *)arg;
+  int i;
+
+  for(i = lo; i < hi; i++) {
+    if(job->nod[i].type == STOP || job->nod[i].edge == 1) continue;
+    find_best_upstream_motif(job->tinf, job->mt, &job->ups[i*UPS_MERS],
+                             &job->nod[i], 2);
+  }
+}
+
 /*******************************************************************************
   Given the weights for various motifs/distances from the training file,
   return the highest scoring mer/spacer combination of 3-6bp motifs with a
   spacer ranging from 3bp to 15bp.  In the final stage of start training, only
-  good scoring motifs are returned.
+  good scoring motifs are returned.  'ups' points to this node's entries from
+  calc_upstream_mers, in which the start sits at position UPS_START.  The
+  weights are read from 'mt', the motif table of tinf's mot_wt.
 *******************************************************************************/
-void find_best_upstream_motif(struct _training *tinf, unsigned char *seq,
-                              unsigned char *rseq, int slen, struct _node *nod,
+void find_best_upstream_motif(struct _training *tinf, struct _motif_table
+                              *mt, unsigned short *ups, struct _node *nod,
                               int stage) {
-  int i, j, start, spacer, spacendx, index;
+  int i, j, spacer, spacendx, index, start = UPS_START;
   int max_spacer = 0, max_spacendx = 0, max_len = 0, max_ndx = 0;
   double max_sc = -100.0, score = 0.0;
-  unsigned char *wseq;
 
   if(nod->type == STOP || nod->edge == 1) return;
-  if(nod->strand == 1) { wseq = seq; start = nod->ndx; }
-  else { wseq = rseq; start = slen-1-nod->ndx; }
 
   for(i = 3; i >= 0; i--) {
-    for(j = start-18-i; j <= start-6-i; j++) { 
-      if(j < 0) continue;
+    for(j = start-18-i; j <= start-6-i; j++) {
+      if(ups[j] == NO_MER) continue;
       spacer = start-j-i-3;
       if(j <= start-16-i) spacendx = 3;
       else if(j <= start-14-i) spacendx = 2;
       else if(j >= start-7-i) spacendx = 1;
       else spacendx = 0;
-      index = mer_ndx(i+3, wseq, j);
-      score = tinf->mot_wt[i][spacendx][index];
+      index = ups[j] & ((1 << (2*i+6)) - 1);
+      score = motif_weight(mt, (i*4+spacendx)*4096+index);
       if(score > max_sc) {
         max_sc = score;
         max_spacendx = spacendx;
@@ -1238,6 +1856,111 @@ void find_best_upstream_motif(struct _training *tinf, unsigned char *seq,
   }
 }
 
+/*******************************************************************************
+  All but a few hundred of the 4x4x4096 motif weights of a model are
+  usually at the -4.0 floor.  The motif table keeps a bit per entry saying
+  whether its weight is above the floor, and the weights of just those in
+  entry order, so the motif search reads a 16KB bitset (and a short array
+  of weights) rather than the 512KB mot_wt.  A table must be rebuilt
+  whenever the weights change.
+*******************************************************************************/
+void init_motif_table(struct _motif_table *mt) {
+  memset(mt->bits, 0, sizeof(mt->bits));
+  memset(mt->rank, 0, sizeof(mt->rank));
+  mt->wt = NULL;
+  mt->nwt = 0;
+}
+
+void free_motif_table(struct _motif_table *mt) {
+  free(mt->wt);
+  mt->wt = NULL;
+  mt->nwt = 0;
+}
+
+void build_motif_table(struct _motif_table *mt, struct _training *tinf) {
+  int e, n = 0;
+  double *wt = &tinf->mot_wt[0][0][0];
+
+  for(e = 0; e < MOTIF_ENTRIES; e++) if(wt[e] != -4.0) n++;
+  free(mt->wt);
+  mt->wt = (double *)malloc((n > 0 ? n : 1)*sizeof(double));
+  if(mt->wt == NULL) {
+    fprintf(stderr, "Malloc failed on motif table\n\n");
+    exit(11);
+  }
+  memset(mt->bits, 0, sizeof(mt->bits));
+  mt->nwt = 0;
+  for(e = 0; e < MOTIF_ENTRIES; e++) {
+    if((e & 31) == 0) mt->rank[e>>5] = mt->nwt;
+    if(wt[e] == -4.0) continue;
+    mt->bits[e>>5] |= 1U << (e & 31);
+    mt->wt[mt->nwt++] = wt[e];
+  }
+}
+
+/* The weight of motif entry 'e' */
+double motif_weight(struct _motif_table *mt, int e) {
+  unsigned int w = mt->bits[e>>5], m = 1U << (e & 31);
+
+  if((w & m) == 0) return -4.0;
+  return mt->wt[mt->rank[e>>5] + count_bits(w & (m-1))];
+}
+
+/* Number of bits set in a 32-bit word */
+int count_bits(unsigned int w) {
+  w = w - ((w >> 1) & 0x55555555U);
+  w = (w & 0x33333333U) + ((w >> 2) & 0x33333333U);
+  w = (w + (w >> 4)) & 0x0f0f0f0fU;
+  return (int)(((w * 0x01010101U) & 0xffffffffU) >> 24);
+}
+
+/*******************************************************************************
+  Motif counts are kept for all 4x4x4096 length/spacer/mer combinations, at
+  entry (len*4+spacendx)*4096+mer, but only a few hundred of them are ever
+  nonzero for a given set of starts.  The entries counted are listed in
+  'used' so clearing, summing and merging the counts only touches those.
+*******************************************************************************/
+void alloc_motif_counts(struct _motif_counts *mc) {
+  mc->cnt = (double *)calloc(MOTIF_ENTRIES, sizeof(double));
+  mc->used = (int *)malloc(MOTIF_ENTRIES*sizeof(int));
+  if(mc->cnt == NULL || mc->used == NULL) {
+    fprintf(stderr, "Malloc failed on motif counts\n\n");
+    exit(11);
+  }
+  mc->nused = 0;
+  mc->zero = 0.0;
+}
+
+void free_motif_counts(struct _motif_counts *mc) {
+  free(mc->cnt);
+  free(mc->used);
+}
+
+void clear_motif_counts(struct _motif_counts *mc) {
+  int i;
+
+  for(i = 0; i < mc->nused; i++) mc->cnt[mc->used[i]] = 0.0;
+  mc->nused = 0;
+  mc->zero = 0.0;
+}
+
+void add_motif_count(struct _motif_counts *mc, int e) {
+  if(mc->cnt[e] == 0.0) mc->used[mc->nused++] = e;
+  mc->cnt[e] += 1.0;
+}
+
+/* Add the counts in 'src' to those in 'dst' */
+void merge_motif_counts(struct _motif_counts *dst, struct _motif_counts *src) {
+  int i, e;
+
+  for(i = 0; i < src->nused; i++) {
+    e = src->used[i];
+    if(dst->cnt[e] == 0.0) dst->used[dst->nused++] = e;
+    dst->cnt[e] += src->cnt[e];
+  }
+  dst->zero += src->zero;
+}
+
 /*******************************************************************************
   Update the motif counts from a putative "real" start.  This is done in three
   stages.  In stage 0, all motifs sizes 3-6bp in the region with spacer 3-15bp
@@ -1245,18 +1968,13 @@ void find_best_upstream_motif(struct _training *tinf, unsigned char *seq,
   counted (e.g. for AGGAG, we would count AGGAG, AGGA, GGAG, AGG, GGA, and
   GAG).  In stage 2, only the best single motif is counted.
 *******************************************************************************/
-void update_motif_counts(double mcnt[4][4][4096], double *zero, unsigned char
-                         *seq, unsigned char *rseq, int slen, struct _node *nod,
-                         int stage) {
-  int i, j, k, start, spacendx;
-  unsigned char *wseq;
+void update_motif_counts(struct _motif_counts *mc, unsigned short *ups,
+                         struct _node *nod, int stage) {
+  int i, j, k, start = UPS_START, spacendx;
   struct _motif *mot = &(nod->mot);
 
   if(nod->type == STOP || nod->edge == 1) return;
-  if(mot->len == 0) { *zero += 1.0; return; }
-
-  if(nod->strand == 1) { wseq = seq; start = nod->ndx; }
-  else { wseq = rseq; start = slen-1-nod->ndx; }
+  if(mot->len == 0) { mc->zero += 1.0; return; }
 
   /* Stage 0:  Count all motifs.  If a motif is detected, */
   /* it is counted for every distance in stage 0.  This   */
@@ -1265,107 +1983,104 @@ void update_motif_counts(double mcnt[4][4][4096], double *zero, unsigned char
   if(stage == 0) {
     for(i = 3; i >= 0; i--) {
       for(j = start-18-i; j <= start-6-i; j++) {
-        if(j < 0) continue;
-        if(j <= start-16-i) spacendx = 3;
-        else if(j <= start-14-i) spacendx = 2;
-        else if(j >= start-7-i) spacendx = 1;
-        else spacendx = 0;
-        for(k = 0; k < 4; k++) mcnt[i][k][mer_ndx(i+3, wseq, j)] += 1.0;
+        if(ups[j] == NO_MER) continue;
+        for(k = 0; k < 4; k++)
+          add_motif_count(mc, (i*4+k)*4096 + (ups[j] & ((1 << (2*i+6)) - 1)));
       }
     }
   }
   /* Stage 1:  Count only the best motif, but also count  */
   /* all its sub-motifs.                                  */
   else if(stage == 1) {
-    mcnt[mot->len-3][mot->spacendx][mot->ndx] += 1.0;
+    add_motif_count(mc, ((mot->len-3)*4+mot->spacendx)*4096 + mot->ndx);
     for(i = 0; i < mot->len-3; i++) {
       for(j = start-(mot->spacer)-(mot->len); j <= start-(mot->spacer)-(i+3);
           j++) {
-        if(j < 0) continue;
+        if(ups[j] == NO_MER) continue;
         if(j <= start-16-i) spacendx = 3;
         else if(j <= start-14-i) spacendx = 2;
         else if(j >= start-7-i) spacendx = 1;
         else spacendx = 0;
-        mcnt[i][spacendx][mer_ndx(i+3, wseq, j)] += 1.0;
+        add_motif_count(mc, (i*4+spacendx)*4096 +
+                        (ups[j] & ((1 << (2*i+6)) - 1)));
       }
     }
   }
   /* Stage 2:  Only count the highest scoring motif. */
-  else if(stage == 2) mcnt[mot->len-3][mot->spacendx][mot->ndx] += 1.0;
+  else if(stage == 2)
+    add_motif_count(mc, ((mot->len-3)*4+mot->spacendx)*4096 + mot->ndx);
 }
 
 /*******************************************************************************
   In addition to log likelihood, we also require a motif to actually be
   present a good portion of the time in an absolute sense across the genome.
-  The coverage map is just a numerical map of whether or not to accept a
-  putative motif as a real one (despite its log likelihood score.  A motif is
-  considered "good" if it contains a 3-base subset of itself that is present
-  in at least 20% of the total genes.  In the final stage of iterative start
-  training, all motifs are labeled good.  0 = bad, 1 = good, 2 = good
-  w/mismatch.
+  A motif is considered "good" if it contains a 3-base subset of itself that
+  is present in at least 20% of the total genes.  This routine marks the good
+  3-base motifs (at any spacer), from which motif_coverage below tells
+  whether a given motif counts as a real one (despite its log likelihood
+  score).  In the final stage of iterative start training, the map from the
+  previous stage is kept.
 *******************************************************************************/
-void build_coverage_map(double real[4][4][4096], int good[4][4][4096], double
-                        ng, int stage) {
-  int i, j, k, l, tmp, decomp[3];
+void build_coverage_map(struct _motif_counts *real, unsigned char *good,
+                        double ng) {
+  int i, j;
   double thresh = 0.2;
 
-  for(i = 0; i < 4; i++) for(j = 0; j < 4; j++) for(k = 0; k < 4096; k++)
-    good[i][j][k] = 0;
-
-  /* 3-base motifs */
-  for(i = 0; i < 4; i++) for(j = 0; j < 64; j++) {
-    if(real[0][i][j]/ng >= thresh) { for(k = 0; k < 4; k++) good[0][k][j] = 1; }
-  }
-
-  /* 4-base motifs, must contain two valid 3-base motifs */
-  for(i = 0; i < 4; i++) for(j = 0; j < 256; j++) {
-    decomp[0] = (j&252)>>2;
-    decomp[1] = j&63;
-    if(good[0][i][decomp[0]] == 0 || good[0][i][decomp[1]] == 0) continue;
-    good[1][i][j] = 1;
-  }
-
-  /* 5-base motifs, interior mismatch allowed only if entire 5-base */
-  /* motif represents 3 valid 3-base motifs (if mismatch converted) */
-  for(i = 0; i < 4; i++) for(j = 0; j < 1024; j++) {
-    decomp[0] = (j&1008)>>4;
-    decomp[1] = (j&252)>>2;
-    decomp[2] = j&63;
-    if(good[0][i][decomp[0]] == 0 || good[0][i][decomp[1]] == 0 ||
-       good[0][i][decomp[2]] == 0)
-      continue;
-    good[2][i][j] = 1;
-    tmp = j;
-    for(k = 0; k <= 16; k+= 16) {
-      tmp = tmp ^ k;
-      for(l = 0; l <= 32; l+= 32) {
-        tmp = tmp ^ l;
-        if(good[2][i][tmp] == 0) good[2][i][tmp] = 2;
-      }
-    }
-  }
-
-  /* 6-base motifs, must contain two valid 5-base motifs */
-  for(i = 0; i < 4; i++) for(j = 0; j < 4096; j++) {
-    decomp[0] = (j&4092)>>2;
-    decomp[1] = j&1023;
-    if(good[2][i][decomp[0]] == 0 || good[2][i][decomp[1]] == 0) continue;
-    if(good[2][i][decomp[0]] == 1 && good[2][i][decomp[1]] == 1)
-      good[3][i][j] = 1;
-    else good[3][i][j] = 2;
+  for(j = 0; j < 64; j++) {
+    good[j] = 0;
+    for(i = 0; i < 4; i++) if(real->cnt[i*4096+j]/ng >= thresh) good[j] = 1;
   }
 
 /* output all good motifs, useful info, keeping it in
 printf("GOOD MOTIFS\n");
-for(i = 0; i < 4; i++) for(j = 0; j < 4; j++) for(k = 0; k < 4096; k++) {
-  if(good[i][j][k] == 0) continue;
-  mer_text(qt, i+3, k);
-  printf("motif %s %d %d %d is good\n", qt, i+3, j, k);
+for(i = 0; i < MOTIF_ENTRIES; i++) {
+  if(motif_coverage(good, i) == 0) continue;
+  mer_text(qt, i/16384+3, i%4096);
+  printf("motif %s %d %d %d is good\n", qt, i/16384+3, (i/4096)%4, i%4096);
 }
 */
 
 }
 
+/* 1 if all three 3-base motifs in a 5-base motif are good */
+int good_triple(unsigned char *good, int j) {
+  return (good[(j&1008)>>4] == 1 && good[(j&252)>>2] == 1 &&
+          good[j&63] == 1);
+}
+
+/* Coverage of the 5-base motif 'j':  interior mismatch allowed only if the */
+/* entire 5-base motif represents 3 valid 3-base motifs (if mismatch        */
+/* converted).                                                              */
+int coverage5(unsigned char *good, int j) {
+  if(good_triple(good, j) == 1) return 1;
+  if(good_triple(good, j^16) == 1 || good_triple(good, j^32) == 1 ||
+     good_triple(good, j^48) == 1) return 2;
+  return 0;
+}
+
+/*******************************************************************************
+  Whether motif entry 'e' is covered by the good 3-base motifs from
+  build_coverage_map.  0 = bad, 1 = good, 2 = good w/mismatch.
+*******************************************************************************/
+int motif_coverage(unsigned char *good, int e) {
+  int j = e%4096, c0, c1;
+
+  switch(e/16384) {
+    /* 3-base motifs */
+    case 0: return good[j];
+    /* 4-base motifs, must contain two valid 3-base motifs */
+    case 1: return (good[(j&252)>>2] == 1 && good[j&63] == 1);
+    /* 5-base motifs */
+    case 2: return coverage5(good, j);
+    /* 6-base motifs, must contain two valid 5-base motifs */
+    default:
+      c0 = coverage5(good, (j&4092)>>2);
+      c1 = coverage5(good, j&1023);
+      if(c0 == 0 || c1 == 0) return 0;
+      if(c0 == 1 && c1 == 1) return 1;
+      return 2;
+  }
+}
 
 /*******************************************************************************
   When connecting two genes, we add a bonus for the -1 and -4 base overlaps on
@@ -1600,3 +2315,12 @@ int stopcmp_nodes(const void *v1, const void *v2) {
   if(n1->ndx > n2->ndx) return 1;
   return 0;
 }
+
+/* Sort ints in ascending order */
+int compare_ints(const void *v1, const void *v2) {
+  int i1 = *(int *)v1, i2 = *(int *)v2;
+
+  if(i1 < i2) return -1;
+  if(i1 > i2) return 1;
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include <math.h>
 #include "sequence.h"
 #include "training.h"
+#include "threads.h"
 
 #define STT_NOD 100000
 #define MIN_GENE 90
@@ -35,6 +36,19 @@
 #define EDGE_BONUS 0.74
 #define EDGE_UPS -1.00
 #define META_PEN 7.5
+#define END_NODES 16
+#define UPS_MERS 16
+#define UPS_START 21
+#define NO_MER 0xffff
+#define SD_POS 15
+#define UPS_BASES 32
+#define MOTIF_ENTRIES 65536
+#define NO_BASE 4
+#define MAX_BATCH 4000000
+#define SD_ITER 10
+#define SD_MIN_ITER 4
+#define NONSD_MIN_ITER { 2, 3, 3 }
+#define TRAIN_TOL 0.01
 
 struct _motif {
   int ndx;             /* Index of the best motif for this node */
@@ -51,6 +65,9 @@ struct _node {
   int strand;          /* 1 = forward, -1 = reverse */
   int stop_val;        /* For a stop, record previous stop; for start, record
                           its stop */
+  int stop_ptr;        /* For a start, index of its stop node; for a stop, index
+                          of its first start in node order, or -1 if none */
+  int next_start;      /* Next start of the same ORF in node order, or -1 */
   int star_ptr[3];     /* Array of starts w/in MAX_SAM_OVLP bases of a stop in 3
                           frames */
   int gc_bias;         /* Frame of highest GC content within this node */
@@ -69,51 +86,194 @@ struct _node {
   int tracef;          /* Forward trace */
   int ov_mark;         /* Marker to help untangle overlapping genes */
   double score;        /* Score of total solution to this point */
+  double gap;          /* Narrowest margin of a comparison made on this node's
+                          score (see join_segment) */
   int elim;            /* If set to 1, eliminate this gene from the model */
 };
 
+struct _node_feats {
+  int cap;             /* Number of nodes there is room for */
+  unsigned char *open; /* 1 if the node's stop codon is missing */
+  unsigned int *sd;    /* Exact/mismatch SD motif sets at each of the SD_POS
+                          positions upstream of a start */
+  unsigned short *ups; /* Upstream 6-mer indices from calc_upstream_mers */
+  unsigned char *ucomp;/* Bases scored by score_upstream_composition, ending
+                          in NO_BASE if the sequence runs out */
+  int nbins;           /* Bins in the coding score batch */
+  int bin;             /* Batch column to score from, or -1 for none */
+  int dc_cap;          /* Bins there is room for in 'dc' */
+  int raw_cap;         /* Entries there is room for in 'raw' */
+  double *dc;          /* Hexamer x bin coding weights */
+  float *cdc;          /* The same as floats (compact tables), or NULL */
+  double *raw;         /* Start x bin summed coding weights (before the
+                          adjustments in finish_coding_score) */
+};
+
+struct _score_job {
+  unsigned char *seq;  /* Forward strand */
+  unsigned char *rseq; /* Reverse complement */
+  int slen;            /* Sequence length */
+  struct _node *nod;   /* Nodes being scored */
+  int nn;              /* Number of nodes */
+  struct _training *tinf;
+  struct _motif_table *mt; /* Its upstream motif weights (non-SD only) */
+  unsigned short *ups; /* Upstream 6-mer indices (non-SD only) */
+  struct _node_feats *feat; /* Precomputed features, or NULL */
+  int closed;          /* Genes may not run off the edges */
+  int is_meta;         /* Metagenomic scoring adjustments */
+  int base;            /* Index of nod[0] in the whole sequence's nodes */
+  int total;           /* Nodes in the whole sequence */
+  unsigned char *redo; /* Stops whose ORFs coding_sums walks, or NULL */
+  int *gc;             /* Most GC-rich frame at each base (record_gc_bias) */
+};
+
+/* Sparse counts of upstream motifs, at entry (len*4+spacendx)*4096+mer */
+struct _motif_counts {
+  double *cnt;          /* Count of each entry */
+  int *used;            /* Entries with a nonzero count */
+  int nused;            /* Number of entries in 'used' */
+  double zero;          /* Starts with no motif */
+};
+
+/* Upstream motif weights, at the same entries, that are not at the -4.0 */
+/* floor: bit e of 'bits' is set for each, and its weight is wt[rank of  */
+/* e among them]; 'rank' holds the number set before each word of bits. */
+struct _motif_table {
+  unsigned int bits[MOTIF_ENTRIES/32];
+  int rank[MOTIF_ENTRIES/32];
+  double *wt;           /* Weights of the entries set in 'bits' */
+  int nwt;              /* Number of them */
+};
+
+/* When the start trainers stop, and where they report each round */
+struct _train_ctl {
+  int strict;           /* Always run the full number of rounds */
+  double tol;           /* Largest weight change still counted as settled */
+  FILE *log;            /* Per-round statistics, or NULL */
+};
+
+/* Shared state for the parallel passes of the start trainers */
+struct _train_job {
+  struct _node *nod;
+  int nn;
+  struct _training *tinf;
+  struct _motif_table *mt; /* Current motif weights (non-SD only) */
+  unsigned short *ups;  /* Upstream 6-mer indices (non-SD only) */
+  int stage;            /* Motif finding stage (non-SD only) */
+  double sthresh;       /* Score a start needs to be counted */
+  int nslice;           /* Slices of nodes the background is counted in */
+  int hsize;            /* Entries in each slice's histogram */
+  double *bg;           /* Background histogram of each slice (SD) */
+  struct _motif_counts *mc; /* Motif background of each slice (non-SD) */
+  int *pick;            /* For each stop, its counted start or -1 */
+};
+
 int add_nodes(unsigned char *, unsigned char *, int, struct _node *, int,
               mask *, int, struct _training *);
+int add_node_range(unsigned char *, unsigned char *, int, struct _node *, int,
+                   mask *, int, struct _training *, int, int);
+int add_strand_nodes(unsigned char *, int, int, struct _node *, int, int,
+                     mask *, int, struct _training *, int, int);
+void link_orfs(struct _node *, int);
 void reset_node_scores(struct _node *, int);
+void save_end_edges(struct _node *, int, int *);
+void restore_end_edges(struct _node *, int, int *);
 int compare_nodes(const void *, const void *);
 int stopcmp_nodes(const void *, const void *);
+int compare_ints(const void *, const void *);
 
 void record_overlapping_starts(struct _node *, int, struct _training *, int);
+void record_overlapping_range(struct _node *, int, struct _training *, int,
+                              int, int);
 void record_gc_bias(int *, struct _node *, int, struct _training *);
+void gc_bias_range(void *, int, int);
 
 void calc_dicodon_gene(struct _training *, unsigned char *, unsigned char *,
                        int, struct _node *, int);
 void calc_amino_bg(struct _training *, unsigned char *, unsigned char *, int,
                    struct _node *, int);
 
-void score_nodes(unsigned char *, unsigned char *, int, struct _node *, int,
-                 struct _training *, int, int);
+void score_nodes(unsigned char *, unsigned char *, int, int *,
+                 struct _node_feats *, struct _node *, int, struct _training *,
+                 struct _motif_table *, int, int);
+void score_node_slice(unsigned char *, unsigned char *, int, int *,
+                      struct _node_feats *, struct _node *, int,
+                      struct _training *, struct _motif_table *, int, int,
+                      int, int);
+void calc_node_feats(unsigned char *, unsigned char *, int, int *,
+                     struct _node *, int, struct _training *,
+                     struct _node_feats *);
+void alloc_node_feats(struct _node_feats *, int);
+void node_feat_range(void *, int, int);
+void free_node_feats(struct _node_feats *);
+void cached_rbs_range(void *, int, int);
 void raw_coding_score(unsigned char *, unsigned char *, int, struct _node *,
                       int, struct _training *);
-void calc_orf_gc(unsigned char *, unsigned char *, int, struct _node *, int, 
-                 struct _training *);
+void coding_sums(unsigned char *, unsigned char *, int, struct _node *, int,
+                 struct _training *, unsigned char *);
+void coding_sum_range(void *, int, int);
+void finish_coding_score(struct _node *, int, struct _training *);
+void finish_coding_range(void *, int, int);
+void batch_coding_scores(unsigned char *, unsigned char *, int,
+                         struct _node *, int, struct _training **, int,
+                         struct _node_feats *, int);
+int becomes_edge(struct _node *, int, int);
+void score_start_range(void *, int, int);
+void calc_orf_gc(int *, struct _node *, int);
 void rbs_score(unsigned char *, unsigned char *, int, struct _node *, int,
                struct _training *);
+void rbs_score_range(void *, int, int);
 void score_upstream_composition(unsigned char *, int, struct _node *, 
                                 struct _training *);
+void score_upstream_bases(unsigned char *, struct _node *,
+                          struct _training *);
 
 void determine_sd_usage(struct _training *);
 
 double intergenic_mod(struct _node *, struct _node *, struct _training *);
 
 void train_starts_sd(unsigned char *, unsigned char *, int, struct _node *,
-                        int, struct _training *);
+                     int, struct _training *, struct _train_ctl *);
 void train_starts_nonsd(unsigned char *, unsigned char *, int, struct _node *,
-                        int, struct _training *);
+                        int, struct _training *, struct _train_ctl *);
+int train_converged(struct _train_ctl *, int, int, double, int);
+double max_change(double *, double *, int);
+void log_train_iter(struct _train_ctl *, char *, int, int, double, double,
+                    double, double);
+double train_clock();
 
 void count_upstream_composition(unsigned char *, int, int, int, 
                                 struct _training *);
+void init_train_job(struct _train_job *, struct _node *, int,
+                    struct _training *, unsigned short *, int);
+void free_train_job(struct _train_job *);
+void sd_background_range(void *, int, int);
+void motif_background_range(void *, int, int);
+int max_rbs_motif(struct _node *, double *);
+void sd_pick_range(void *, int, int);
+void motif_pick_range(void *, int, int);
 
-void build_coverage_map(double [4][4][4096], int [4][4][4096], double, int);
-void find_best_upstream_motif(struct _training *, unsigned char *, unsigned
-                              char *, int, struct _node *, int);
-void update_motif_counts(double [4][4][4096], double *, unsigned char *,
-                         unsigned char *, int, struct _node *, int);
+void build_coverage_map(struct _motif_counts *, unsigned char *, double);
+int good_triple(unsigned char *, int);
+int coverage5(unsigned char *, int);
+int motif_coverage(unsigned char *, int);
+void alloc_motif_counts(struct _motif_counts *);
+void free_motif_counts(struct _motif_counts *);
+void clear_motif_counts(struct _motif_counts *);
+void add_motif_count(struct _motif_counts *, int);
+void merge_motif_counts(struct _motif_counts *, struct _motif_counts *);
+void calc_upstream_mers(unsigned char *, unsigned char *, int, struct _node *,
+                        int, unsigned short *);
+void upstream_motif_range(void *, int, int);
+void find_best_upstream_motif(struct _training *, struct _motif_table *,
+                              unsigned short *, struct _node *, int);
+void init_motif_table(struct _motif_table *);
+void free_motif_table(struct _motif_table *);
+void build_motif_table(struct _motif_table *, struct _training *);
+double motif_weight(struct _motif_table *, int);
+int count_bits(unsigned int);
+void update_motif_counts(struct _motif_counts *, unsigned short *,
+                         struct _node *, int);
 
 void write_start_file(FILE *, struct _node *, int, struct _training *, int,
                       int, int, char *, char *, char *);
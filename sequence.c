@@ -24,15 +24,17 @@
   Read the sequence for training purposes.  If we encounter multiple
   sequences, we insert TTAATTAATTAA between each one to force stops in all
   six frames.  When we hit MAX_SEQ bp, we stop and return what we've got so
-  far for training.  This routine reads in FASTA, and has a very 'loose' 
-  Genbank and Embl parser, but, to be safe, FASTA should generally be 
-  preferred.
+  far for training.  If 'pick' is not NULL, only the sequences it flags
+  (see sample_contigs) are read.  This routine reads in FASTA, and has a
+  very 'loose' Genbank and Embl parser, but, to be safe, FASTA should
+  generally be preferred.
 *******************************************************************************/
 
 int read_seq_training(FILE *fp, unsigned char *seq, unsigned char *useq, 
-                      double *gc, int do_mask, mask *mlist, int *nm) {
+                      double *gc, int do_mask, mask *mlist, int *nm,
+                      unsigned char *pick) {
   char line[MAX_LINE+1];
-  int hdr = 0, fhdr = 0, bctr = 0, len = 0, wrn = 0;
+  int hdr = 0, fhdr = 0, bctr = 0, len = 0, wrn = 0, keep = 1, nkeep = 0;
   int gc_cont = 0, mask_beg = -1;
   unsigned int i, gapsize = 0;
 
@@ -47,16 +49,17 @@ int read_seq_training(FILE *fp, unsigned char *seq, unsigned char *useq,
     if(line[0] == '>' || (line[0] == 'S' && line[1] == 'Q') ||
        (strlen(line) > 6 && strncmp(line, "ORIGIN", 6) == 0)) {
       hdr = 1;
-      if(fhdr > 0) {
+      keep = (pick == NULL || pick[fhdr] == 1);
+      if(keep == 1 && nkeep > 0) {
         for(i = 0; i < 12; i++) {
           if(i%4 == 0 || i%4 == 1) { set(seq, bctr); set(seq, bctr+1); }
           bctr+=2; len++;
         }
       }
-      fhdr++;
+      fhdr++; nkeep += keep;
     }
     else if(hdr == 1 && (line[0] == '/' && line[1] == '/')) hdr = 0;
-    else if(hdr == 1) {
+    else if(hdr == 1 && keep == 1) {
       if(strstr(line, "Expand") != NULL && strstr(line, "gap") != NULL) {
         sscanf(strstr(line, "gap")+4, "%u", &gapsize); 
         if(gapsize < 1 || gapsize > MAX_LINE) {
@@ -103,11 +106,13 @@ int read_seq_training(FILE *fp, unsigned char *seq, unsigned char *useq,
     if(len+MAX_LINE >= MAX_SEQ) {
       fprintf(stderr, "\n\nWarning:  Sequence is long (max %d for training).\n",
               MAX_SEQ);
-      fprintf(stderr, "Training on the first %d bases.\n\n", MAX_SEQ);
+      fprintf(stderr, "Training on the first %d bases (use -b to train",
+              MAX_SEQ);
+      fprintf(stderr, " on a sample\nof all the sequences instead).\n\n");
       break;
     }
   }
-  if(fhdr > 1) {
+  if(nkeep > 1) {
     for(i = 0; i < 12; i++) {
       if(i%4 == 0 || i%4 == 1) { set(seq, bctr); set(seq, bctr+1); }
       bctr+=2; len++;
@@ -117,6 +122,123 @@ int read_seq_training(FILE *fp, unsigned char *seq, unsigned char *useq,
   return len;
 }
 
+/*******************************************************************************
+  Scan the training input once for the length and GC count of each of its
+  sequences, so a sample of them can be chosen before they are read in.
+  Returns the number of sequences, or -1 if the file can't be rewound
+  afterwards.  Headers and gaps are recognized just as in
+  read_seq_training.
+*******************************************************************************/
+int scan_seq_contigs(FILE *fp, struct _contig_stat **cs) {
+  char line[MAX_LINE+1];
+  int hdr = 0, n = 0, cap = 0;
+  unsigned int i, gapsize = 0;
+  struct _contig_stat *cur = NULL;
+
+  *cs = NULL;
+  line[MAX_LINE] = '\0';
+  while(fgets(line, MAX_LINE, fp) != NULL) {
+    if(line[0] == '>' || (line[0] == 'S' && line[1] == 'Q') ||
+       (strlen(line) > 6 && strncmp(line, "ORIGIN", 6) == 0)) {
+      hdr = 1;
+      if(n == cap) {
+        cap = (cap == 0 ? 1024 : 2*cap);
+        *cs = (struct _contig_stat *)realloc(*cs, cap*
+                                             sizeof(struct _contig_stat));
+        if(*cs == NULL) {
+          fprintf(stderr, "Realloc failed on training contigs\n\n");
+          exit(11);
+        }
+      }
+      cur = &(*cs)[n];
+      cur->ndx = n; cur->len = 0; cur->gc = 0; cur->stratum = 0; cur->key = 0;
+      n++;
+    }
+    else if(hdr == 1 && (line[0] == '/' && line[1] == '/')) hdr = 0;
+    else if(hdr == 1) {
+      if(strstr(line, "Expand") != NULL && strstr(line, "gap") != NULL) {
+        sscanf(strstr(line, "gap")+4, "%u", &gapsize);
+        if(gapsize >= 1 && gapsize <= MAX_LINE) cur->len += gapsize;
+        continue;
+      }
+      for(i = 0; i < strlen(line); i++) {
+        if(line[i] < 'A' || line[i] > 'z') continue;
+        if(line[i] == 'g' || line[i] == 'G' || line[i] == 'c' ||
+           line[i] == 'C') cur->gc++;
+        cur->len++;
+      }
+    }
+  }
+  if(fseek(fp, 0, SEEK_SET) == -1) return -1;
+  return n;
+}
+
+/*******************************************************************************
+  Choose about 'target' bases of the 'n' sequences in 'cs' to train on,
+  setting pick[i] to 1 for each chosen sequence i.  The sequences are put
+  into strata by GC content and length and shuffled within each stratum
+  with a fixed seed.  Each stratum then gives up sequences, in that order,
+  until it has its share of the target (any shortfall carries over to the
+  next stratum), so the sample looks like the whole input and the same
+  input always gives the same sample.  Returns the number of bases picked.
+*******************************************************************************/
+double sample_contigs(struct _contig_stat *cs, int n, double target,
+                      unsigned char *pick) {
+  int i, j, lbin;
+  unsigned int rs = SAMPLE_SEED;
+  double total = 0.0, want = 0.0, sbases, picked = 0.0;
+
+  for(i = 0; i < n; i++) {
+    pick[cs[i].ndx] = 0;
+    total += cs[i].len;
+    for(lbin = 0; lbin < 31 && (1 << (lbin+1)) <= cs[i].len; lbin++);
+    cs[i].stratum = lbin;
+    if(cs[i].len > 0)
+      cs[i].stratum += 32*imin((int)(SAMPLE_GC_BINS*(double)cs[i].gc/
+                                     cs[i].len), SAMPLE_GC_BINS-1);
+    cs[i].key = sample_rand(&rs);
+  }
+  qsort(cs, n, sizeof(struct _contig_stat), &compare_contigs);
+
+  for(i = 0; i < n; i = j) {
+    sbases = 0.0;
+    for(j = i; j < n && cs[j].stratum == cs[i].stratum; j++)
+      sbases += cs[j].len;
+    want += target*sbases/total;
+    for(j = i; j < n && cs[j].stratum == cs[i].stratum; j++) {
+      if(picked > 0.0 && picked + cs[j].len/2.0 > want) continue;
+      pick[cs[j].ndx] = 1;
+      picked += cs[j].len;
+    }
+  }
+  return picked;
+}
+
+/* Order contigs by stratum, then by their random key */
+int compare_contigs(const void *v1, const void *v2) {
+  struct _contig_stat *c1 = (struct _contig_stat *)v1;
+  struct _contig_stat *c2 = (struct _contig_stat *)v2;
+
+  if(c1->stratum < c2->stratum) return -1;
+  if(c1->stratum > c2->stratum) return 1;
+  if(c1->key < c2->key) return -1;
+  if(c1->key > c2->key) return 1;
+  if(c1->ndx < c2->ndx) return -1;
+  if(c1->ndx > c2->ndx) return 1;
+  return 0;
+}
+
+/* Xorshift random numbers, so samples don't depend on the C library */
+unsigned int sample_rand(unsigned int *state) {
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
 /* This routine reads in the next sequence in a FASTA/GB/EMBL file */
 
 int next_seq_multi(FILE *fp, unsigned char *seq, unsigned char *useq,
@@ -563,37 +685,60 @@ int max_fr(int n1, int n2, int n3) {
     if(n2 > n3) return 1; else return 2;
 }
 
+/*******************************************************************************
+  Builds running G+C counts for each of the three frames.  Entry k holds the
+  number of G/C bases at positions k-3, k-6, ... back to the start of the
+  sequence, so the G+C count of a codon-aligned stretch [a, b) is the sum of
+  sum[b+r] - sum[a+r] for r = 0..2 (see gc_count).  The array has slen+6
+  entries so stretches ending just past the end of the sequence can be
+  looked up.  It is built once per sequence and shared by the GC frame plot
+  and the ORF GC content calculation.
+*******************************************************************************/
+
+int *calc_gc_frame_sums(unsigned char *seq, int slen) {
+  int i, *sum;
+
+  sum = (int *)malloc((slen+6)*sizeof(int));
+  if(sum == NULL) return NULL;
+  for(i = 0; i < 3; i++) sum[i] = 0;
+  for(i = 3; i < slen+6; i++) {
+    sum[i] = sum[i-3];
+    if(i-3 < slen) sum[i] += is_gc(seq, i-3);
+  }
+  return sum;
+}
+
+/* Number of G/C bases in the codon-aligned stretch [a, b) */
+int gc_count(int *sum, int a, int b) {
+  return sum[b] + sum[b+1] + sum[b+2] - sum[a] - sum[a+1] - sum[a+2];
+}
+
 /*******************************************************************************
   Creates a GC frame plot for a given sequence.  This is simply a string with 
   the highest GC content frame for a window centered on position for every
-  position in the sequence.
+  position in the sequence.  The running frame counts come from
+  calc_gc_frame_sums: sum[i+3] covers positions i, i-3, ... and the counts
+  from i to the end of the sequence are the frame total minus sum[i].
 *******************************************************************************/
 
-int *calc_most_gc_frame(unsigned char *seq, int slen) {
-  int i, j, *fwd, *bwd, *tot;
+int *calc_most_gc_frame(unsigned char *seq, int *sum, int slen) {
+  int i, j, *tot;
   int win, *gp;
 
   gp = (int *)malloc(slen*sizeof(double));
-  fwd = (int *)malloc(slen*sizeof(int));
-  bwd = (int *)malloc(slen*sizeof(int));
   tot = (int *)malloc(slen*sizeof(int));
-  if(fwd == NULL || bwd == NULL || gp == NULL || tot == NULL) return NULL;
-  for(i = 0; i < slen; i++) { fwd[i] = 0; bwd[i] = 0; tot[i] = 0; gp[i] = -1; }
-
-  for(i = 0; i < 3; i++) {
-    for(j = 0 + i; j < slen; j++) {
-      if(j < 3) fwd[j] = is_gc(seq, j);
-      else fwd[j] = fwd[j-3] + is_gc(seq, j);
-      if(j < 3) bwd[slen-j-1] = is_gc(seq, slen-j-1);
-      else bwd[slen-j-1] = bwd[slen-j+2] + is_gc(seq, slen-j-1);
-    }
-  }
+  if(gp == NULL || tot == NULL) return NULL;
+  for(i = 0; i < slen; i++) { tot[i] = 0; gp[i] = -1; }
+
   for(i = 0; i < slen; i++) {
-    tot[i] = fwd[i] + bwd[i] - is_gc(seq, i);
-    if(i - WINDOW/2 >= 0) tot[i] -= fwd[i-WINDOW/2];
-    if(i + WINDOW/2 < slen) tot[i] -= bwd[i+WINDOW/2];
+    j = slen + (i - slen%3 + 3)%3;
+    tot[i] = sum[i+3] + sum[j] - sum[i] - is_gc(seq, i);
+    if(i - WINDOW/2 >= 0) tot[i] -= sum[i-WINDOW/2+3];
+    if(i + WINDOW/2 < slen) {
+      j = slen + (i + WINDOW/2 - slen%3 + 3)%3;
+      tot[i] -= sum[j] - sum[i+WINDOW/2];
+    }
   }
-  free(fwd); free(bwd);
   for(i = 0; i < slen-2; i+=3) {
     win = max_fr(tot[i], tot[i+1], tot[i+2]);
     for(j = 0; j < 3; j++) gp[i+j] = win;
@@ -659,7 +804,17 @@ void calc_mer_bg(int len, unsigned char *seq, unsigned char *rseq, int slen,
 *******************************************************************************/
 
 int shine_dalgarno_exact(unsigned char *seq, int pos, int start, double *rwt) {
-  int i, j, k, mism, rdis, limit, max_val, cur_val = 0;
+  return best_rbs_motif(sd_exact_motifs(seq, pos, start), rwt);
+}
+
+/*******************************************************************************
+  The RBS motif categories (as a bitmask) of every exact match to AGGAGG in
+  this stretch of sequence.  Which one is best depends on the weights, but
+  the set itself does not, so it can be kept and rescored with other weights.
+*******************************************************************************/
+unsigned int sd_exact_motifs(unsigned char *seq, int pos, int start) {
+  int i, j, k, mism, rdis, limit, cur_val = 0;
+  unsigned int found = 0;
   double match[6], cur_ctr, dis_flag;
 
   limit = imin(6, start-4-pos);
@@ -673,8 +828,7 @@ int shine_dalgarno_exact(unsigned char *seq, int pos, int start, double *rwt) {
     else match[i] = -10.0;
   }
 
-  /* Find the maximally scoring motif */
-  max_val = 0;
+  /* Find every matching motif */
   for(i = limit; i >= 3; i--) {
     for(j = 0; j <= limit-i; j++) {
       cur_ctr = -2.0;
@@ -720,13 +874,11 @@ int shine_dalgarno_exact(unsigned char *seq, int pos, int start, double *rwt) {
       else if(cur_ctr == 14.0 && dis_flag == 1) cur_val = 26;
       else if(cur_ctr == 14.0 && dis_flag == 0) cur_val = 27;
 
-      if(rwt[cur_val] < rwt[max_val]) continue;
-      if(rwt[cur_val] == rwt[max_val] && cur_val < max_val) continue;
-      max_val = cur_val;
+      found |= (1U << cur_val);
     }
   }
 
-  return max_val;
+  return found;
 }
 
 /*******************************************************************************
@@ -735,7 +887,13 @@ int shine_dalgarno_exact(unsigned char *seq, int pos, int start, double *rwt) {
 *******************************************************************************/
 
 int shine_dalgarno_mm(unsigned char *seq, int pos, int start, double *rwt) {
-  int i, j, k, mism, rdis, limit, max_val, cur_val = 0;
+  return best_rbs_motif(sd_mm_motifs(seq, pos, start), rwt);
+}
+
+/* As sd_exact_motifs, but for matches with a single mismatch. */
+unsigned int sd_mm_motifs(unsigned char *seq, int pos, int start) {
+  int i, j, k, mism, rdis, limit, cur_val = 0;
+  unsigned int found = 0;
   double match[6], cur_ctr, dis_flag;
 
   limit = imin(6, start-4-pos);
@@ -754,8 +912,7 @@ int shine_dalgarno_mm(unsigned char *seq, int pos, int start, double *rwt) {
     }
   }
 
-  /* Find the maximally scoring motif */
-  max_val = 0;
+  /* Find every matching motif */
   for(i = limit; i >= 5; i--) {
     for(j = 0; j <= limit-i; j++) {
       cur_ctr = -2.0;
@@ -788,12 +945,26 @@ int shine_dalgarno_mm(unsigned char *seq, int pos, int start, double *rwt) {
       else if(cur_ctr == 9.0 && dis_flag == 1) cur_val = 18;
       else if(cur_ctr == 9.0 && dis_flag == 0) cur_val = 19;
 
-      if(rwt[cur_val] < rwt[max_val]) continue;
-      if(rwt[cur_val] == rwt[max_val] && cur_val < max_val) continue;
-      max_val = cur_val;
+      found |= (1U << cur_val);
     }
   }
 
+  return found;
+}
+
+/*******************************************************************************
+  Pick the best RBS motif out of a set of categories: the highest weight,
+  with ties going to the higher category.  Category 0 (no motif) is always
+  a candidate.
+*******************************************************************************/
+int best_rbs_motif(unsigned int found, double *rwt) {
+  int i, max_val = 0;
+
+  for(i = 1; found >> i != 0; i++) {
+    if((found & (1U << i)) == 0) continue;
+    if(rwt[i] < rwt[max_val]) continue;
+    max_val = i;
+  }
   return max_val;
 }
 
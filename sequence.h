@@ -33,6 +33,8 @@
 #define WINDOW 120
 #define MASK_SIZE 50
 #define MAX_MASKS 5000
+#define SAMPLE_SEED 2463534242U
+#define SAMPLE_GC_BINS 10
 #define ATG 0
 #define GTG 1
 #define TTG 2
@@ -44,8 +46,21 @@ typedef struct _mask {
   int end;
 } mask;
 
+/* Length and GC count of one sequence of the training input */
+struct _contig_stat {
+  int ndx;              /* Position of the sequence in the file */
+  int len;              /* Bases */
+  int gc;               /* G/C bases */
+  int stratum;          /* GC bin * 32 + log2 length (sample_contigs) */
+  unsigned int key;     /* Random order within the stratum */
+};
+
 int read_seq_training(FILE *, unsigned char *, unsigned char *, double *, int,
-                      mask *, int *);
+                      mask *, int *, unsigned char *);
+int scan_seq_contigs(FILE *, struct _contig_stat **);
+double sample_contigs(struct _contig_stat *, int, double, unsigned char *);
+int compare_contigs(const void *, const void *);
+unsigned int sample_rand(unsigned int *);
 int next_seq_multi(FILE *, unsigned char *, unsigned char *, int *, double *,
                    int, mask *, int *, char *, char *);
 void rcom_seq(unsigned char *, unsigned char *, unsigned char *, int);
@@ -74,7 +89,9 @@ char amino_letter(int);
 int rframe(int, int);
 int max_fr(int, int, int);
 
-int *calc_most_gc_frame(unsigned char *, int);
+int *calc_gc_frame_sums(unsigned char *, int);
+int gc_count(int *, int, int);
+int *calc_most_gc_frame(unsigned char *, int *, int);
 
 int mer_ndx(int, unsigned char *, int);
 void mer_text(char *, int, int);
@@ -82,6 +99,9 @@ void calc_mer_bg(int, unsigned char *, unsigned char *, int, double *);
 
 int shine_dalgarno_exact(unsigned char *, int, int, double *);
 int shine_dalgarno_mm(unsigned char *, int, int, double *);
+unsigned int sd_exact_motifs(unsigned char *, int, int);
+unsigned int sd_mm_motifs(unsigned char *, int, int);
+int best_rbs_motif(unsigned int, double *);
 
 int imin(int, int);
 
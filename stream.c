@@ -0,0 +1,452 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#include "stream.h"
+
+/*******************************************************************************
+  Gene finding in windows (-w).  Instead of building the whole sequence's
+  list of nodes at once, the nodes are added a window of bases at a time.
+  Each ORF is scored once all of its nodes are in, and the dynamic
+  programming is filled in as far as the scored nodes allow.  A node only
+  ever connects back to the nodes within MAX_NODE_DIST of it or to those
+  inside its own ORF, so the paths back from every node that a later one
+  could still connect to soon run into each other.  Everything before the
+  point where they all meet is on the final path whatever comes later, so
+  it is untangled, turned into genes and printed, and the nodes behind it
+  are dropped.  A single pass ends the path at its best scoring end node,
+  so that part is only handed on once a later node outscores every end node
+  in it (path_settled); after a stretch with no genes this can wait until
+  the genes past it catch up.  The genes are then the ones a single pass
+  over the whole list would find.  The sequence itself is still read in
+  whole, but only a few windows' worth of nodes is normally held.
+*******************************************************************************/
+
+void init_stream(struct _stream *st, int win, FILE *out, int format, FILE
+                 *trans, FILE *nuc) {
+  memset(st, 0, sizeof(struct _stream));
+  st->win = win;
+  st->out = out;
+  st->format = format;
+  st->trans = trans;
+  st->nuc = nuc;
+}
+
+void free_stream(struct _stream *st) {
+  if(st->nod != NULL) free(st->nod);
+  if(st->tmp != NULL) free(st->tmp);
+  if(st->done != NULL) free(st->done);
+  if(st->meet != NULL) free(st->meet);
+  if(st->genes != NULL) free(st->genes);
+  memset(st, 0, sizeof(struct _stream));
+}
+
+/*******************************************************************************
+  Find the genes in one sequence and print them as they are found.  Returns
+  the number of genes.
+*******************************************************************************/
+int stream_genes(struct _stream *st, unsigned char *seq, unsigned char *rseq,
+                 unsigned char *useq, int slen, int *gc_sum, mask *mlist,
+                 int nm, struct _training *tinf, struct _motif_table *mt,
+                 int closed, int sctr, char *header, char *short_hdr,
+                 char *version) {
+  int i, low, last, max_ndx = -1;
+  double max_sc = -1.0;
+  struct _node *nod;
+
+  st->nn = 0; st->base = 0; st->pos = 0; st->scored = 0; st->filled = 0;
+  st->root = -1; st->adj = -1; st->mark = -1; st->add = -1;
+  st->held = DP_FLOOR;
+  st->ng = 0; st->tw = 0; st->printed = 0;
+  if(st->gcap < 2) {
+    st->genes = (struct _gene *)realloc(st->genes, 2*sizeof(struct _gene));
+    if(st->genes == NULL) {
+      fprintf(stderr, "Realloc failed on genes\n\n");
+      exit(11);
+    }
+    st->gcap = 2;
+  }
+  memset(st->genes, 0, st->gcap*sizeof(struct _gene));
+  st->genes[0].start_ndx = -1; st->genes[0].stop_ndx = -1;
+
+  print_genes_header(st->out, slen, st->format, sctr, 0, NULL, tinf, header,
+                     version);
+  while(1) {
+    if(st->pos < slen) add_window(st, seq, rseq, slen, mlist, nm, tinf,
+                                  closed);
+    score_window(st, seq, rseq, slen, gc_sum, tinf, mt, closed);
+    fill_window(st, tinf, slen);
+    if(st->pos == slen && st->filled == st->nn) break;
+    low = live_nodes(st, slen);
+    last = path_meet(st, low);
+    if(last != -1 && path_settled(st, last) == 1)
+      take_path(st, last, 0, seq, rseq, useq, slen, tinf, sctr, short_hdr,
+                version);
+    if(st->root != -1) evict_nodes(st, low);
+  }
+
+  /* The best end node, as in dprog_trace */
+  nod = st->nod;
+  for(i = st->nn-1; i > st->root; i--) {
+    if(nod[i].strand == 1 && nod[i].type != STOP) continue;
+    if(nod[i].strand == -1 && nod[i].type == STOP) continue;
+    if(nod[i].score > max_sc) { max_sc = nod[i].score; max_ndx = i; }
+  }
+  if(max_ndx != -1 && st->root == -1 && nod[max_ndx].traceb == -1)
+    max_ndx = -1;
+  take_path(st, max_ndx, 1, seq, rseq, useq, slen, tinf, sctr, short_hdr,
+            version);
+  print_genes_footer(st->out, st->format);
+  return st->printed;
+}
+
+/* Make room for 'n' nodes */
+void grow_stream(struct _stream *st, int n) {
+  if(n <= st->cap) return;
+  n += n/2;
+  st->nod = (struct _node *)realloc(st->nod, n*sizeof(struct _node));
+  st->tmp = (struct _node *)realloc(st->tmp, n*sizeof(struct _node));
+  st->done = (unsigned char *)realloc(st->done, n*sizeof(unsigned char));
+  st->meet = (int *)realloc(st->meet, n*sizeof(int));
+  if(st->nod == NULL || st->tmp == NULL || st->done == NULL ||
+     st->meet == NULL) {
+    fprintf(stderr, "Realloc failed on window nodes\n\n");
+    exit(11);
+  }
+  st->cap = n;
+}
+
+/*******************************************************************************
+  Add the nodes of the next window.  They all come after the nodes already
+  there, so the list stays in order.  Like main, this allows for at most one
+  node every 4 bases (twice what main allows for).
+*******************************************************************************/
+void add_window(struct _stream *st, unsigned char *seq, unsigned char *rseq,
+                int slen, mask *mlist, int nm, struct _training *tinf, int
+                closed) {
+  int i, n, hi;
+
+  hi = st->pos + st->win;
+  if(hi > slen) hi = slen;
+  grow_stream(st, st->nn + (hi-st->pos)/4 + END_NODES);
+  memset(&st->nod[st->nn], 0, (st->cap-st->nn)*sizeof(struct _node));
+  n = add_node_range(seq, rseq, slen, &st->nod[st->nn], closed, mlist, nm,
+                     tinf, st->pos, hi);
+  qsort(&st->nod[st->nn], n, sizeof(struct _node), &compare_nodes);
+  for(i = st->nn; i < st->nn+n; i++) {
+    st->nod[i].tracef = -1;
+    st->done[i] = 0;
+  }
+  st->nn += n;
+  st->pos = hi;
+  link_orfs(st->nod, st->nn);
+}
+
+/*******************************************************************************
+  Score the ORFs whose nodes are all in.  A forward ORF is complete once its
+  stop is, and a reverse one once the window has passed the stop before it.
+  Nodes within 500 of the end of the whole list are scored differently
+  (see score_start_range), so until the last window is in, ORFs reaching
+  that close to the last node wait for the next one.  The ORFs are scored
+  in a copy of the stretch of nodes they span, and copied back.
+*******************************************************************************/
+void score_window(struct _stream *st, unsigned char *seq, unsigned char
+                  *rseq, int slen, int *gc_sum, struct _training *tinf, struct
+                  _motif_table *mt, int closed) {
+  int i, j, lo, hi, lim, top, sp, ns;
+  struct _node *nod = st->nod;
+  unsigned char *done = st->done;
+
+  lo = st->nn; hi = -1;
+  lim = (st->pos == slen) ? st->nn : st->nn-500;
+  for(i = st->scored; i < st->nn; i++) {
+    if(done[i] != 0 || nod[i].type != STOP) continue;
+    if(nod[i].strand == -1 && nod[i].stop_val >= st->pos && st->pos < slen)
+      continue;
+    top = i;
+    for(j = nod[i].stop_ptr; j != -1; j = nod[j].next_start)
+      if(j > top) top = j;
+    if(top >= lim) continue;
+    if(orf_floor(nod, i) < lo) lo = orf_floor(nod, i);
+    if(top+1 > hi) hi = top+1;
+    done[i] = 2;
+    for(j = nod[i].stop_ptr; j != -1; j = nod[j].next_start) done[j] = 2;
+  }
+  if(hi == -1) return;
+
+  memcpy(st->tmp, &nod[lo], (hi-lo)*sizeof(struct _node));
+  link_orfs(st->tmp, hi-lo);
+  score_node_slice(seq, rseq, slen, gc_sum, NULL, st->tmp, hi-lo, tinf, mt,
+                   closed, 0, st->base+lo, st->base+st->nn);
+  for(i = lo; i < hi; i++) {
+    if(done[i] != 2) continue;
+    sp = nod[i].stop_ptr; ns = nod[i].next_start;
+    memcpy(&nod[i], &st->tmp[i-lo], sizeof(struct _node));
+    nod[i].stop_ptr = sp; nod[i].next_start = ns;
+    done[i] = 1;
+  }
+  while(st->scored < st->nn && done[st->scored] == 1) st->scored++;
+}
+
+/*******************************************************************************
+  Fill in the dynamic programming up to the first node that would look at an
+  unscored node, or at a position the windows haven't reached yet.  A stop's
+  overlapping starts are the furthest ahead any node looks.
+*******************************************************************************/
+void fill_window(struct _stream *st, struct _training *tinf, int slen) {
+  int d, lim;
+  struct _node *nod = st->nod;
+
+  if(st->scored == st->nn && st->pos == slen) d = st->nn;
+  else {
+    lim = (st->scored < st->nn) ? nod[st->scored].ndx : st->pos;
+    for(d = st->filled; d < st->scored && nod[d].ndx+MAX_SAM_OVLP+3 < lim;
+        d++);
+  }
+  if(d == st->filled) return;
+  record_overlapping_range(nod, st->nn, tinf, 1, st->filled, d);
+  dprog_fill(nod, d, tinf, 1, 0, NULL, 0, st->filled);
+  st->filled = d;
+}
+
+/*******************************************************************************
+  Returns the first node that later rounds may still read.  Nodes filled in
+  from here on connect back to the last 2*MAX_NODE_DIST nodes filled in, or
+  anywhere in their own ORF (and to stops just before it), so this is
+  STREAM_MARGIN bases before the lowest node of any of those ORFs or of any
+  ORF that is still open.
+*******************************************************************************/
+int live_nodes(struct _stream *st, int slen) {
+  int i, f0, low;
+  struct _node *nod = st->nod;
+
+  if(st->nn == 0) return 0;
+  f0 = st->filled - 2*MAX_NODE_DIST;
+  if(f0 < 0) f0 = 0;
+  low = nod[f0].ndx;
+  for(i = 0; i < st->nn; i++) {
+    if(i < f0 && (nod[i].strand == -1 || nod[i].type == STOP ||
+       nod[i].stop_ptr != -1) && (nod[i].strand == 1 || nod[i].type != STOP ||
+       nod[i].stop_val < st->pos || st->pos == slen)) continue;
+    if(nod[orf_floor(nod, i)].ndx < low) low = nod[orf_floor(nod, i)].ndx;
+  }
+  return first_ndx_at(nod, st->nn, low-STREAM_MARGIN);
+}
+
+/*******************************************************************************
+  The lowest node of x's ORF.  A start whose stop isn't in yet gives itself;
+  the starts below it in the ORF are in the same state.
+*******************************************************************************/
+int orf_floor(struct _node *nod, int x) {
+  int s = nod[x].stop_ptr;
+
+  if(s == -1) return x;
+  if(nod[x].strand == 1 && nod[x].type != STOP) return nod[s].stop_ptr;
+  if(nod[x].strand == 1 || nod[x].type != STOP) return s;
+  return x;
+}
+
+/*******************************************************************************
+  Follow the paths back from the filled in nodes from 'low' on to the point
+  where they all meet, and return the last node of that shared path before
+  'low', or -1 if there is none past the root yet.  A path that stops short
+  of the root (only seen at the very start of a sequence) means there is no
+  shared path yet.
+*******************************************************************************/
+int path_meet(struct _stream *st, int low) {
+  int x, y, m, c, root = st->root, *meet = st->meet;
+  struct _node *nod = st->nod;
+
+  if(low >= st->filled) return -1;
+  for(x = (root == -1) ? 0 : root; x < st->filled; x++) meet[x] = -1;
+
+  /* The path from the last node filled in */
+  for(y = st->filled-1; ; y = nod[y].traceb) {
+    meet[y] = y;
+    if(y == root || nod[y].traceb == -1) break;
+    if(nod[y].traceb < root) return -1;
+  }
+  if(y != root && root != -1) return -1;
+
+  /* Where every other path joins it */
+  c = st->filled-1;
+  for(x = st->filled-1; x >= low; x--) {
+    for(y = x; meet[y] == -1; y = nod[y].traceb)
+      if(nod[y].traceb == -1 || nod[y].traceb < root) return -1;
+    m = meet[y];
+    if(m < c) c = m;
+    for(y = x; meet[y] == -1; y = nod[y].traceb) meet[y] = m;
+  }
+
+  for(y = c; y != root && y >= low; y = nod[y].traceb);
+  return (y == root) ? -1 : y;
+}
+
+/*******************************************************************************
+  A single pass ends the path at the best scoring 3'fwd/5'rev of the whole
+  sequence (dprog_trace, where ties go to the later node).  So the path up
+  to 'last' is only final if a node filled in after 'last' already scores
+  at least as well as every such node up to it, which then can never be
+  the end.  Returns 1 and updates 'held' if so, 0 if the path has to wait.
+*******************************************************************************/
+int path_settled(struct _stream *st, int last) {
+  int i, c;
+  double top = st->held, after = DP_FLOOR;
+  struct _node *nod = st->nod;
+
+  for(i = st->root+1; i < st->filled; i++) {
+    c = node_class(&nod[i]);
+    if(c != 1 && c != 2) continue;
+    if(i <= last && nod[i].score > top) top = nod[i].score;
+    if(i > last && nod[i].score > after) after = nod[i].score;
+  }
+  if(after < top) return 0;
+  st->held = top;
+  return 1;
+}
+
+/*******************************************************************************
+  Hand on the final path from the root up to node 'last' (-1 for none):
+  untangle it, then run it through eliminate_bad_genes, add_genes and
+  tweak_final_starts as far as each can go without the rest of the path,
+  and print the genes that are done.  'Final' is set for the rest of the
+  sequence.
+*******************************************************************************/
+void take_path(struct _stream *st, int last, int final, unsigned char *seq,
+               unsigned char *rseq, unsigned char *useq, int slen, struct
+               _training *tinf, int sctr, char *short_hdr, char *version) {
+  int i, n, path;
+  struct _node *nod = st->nod;
+  struct _gene *genes;
+
+  if(last != -1) {
+    untangle_path(nod, last, st->root);
+    if(st->root == -1) {
+      for(path = last; nod[path].traceb != -1; path = nod[path].traceb);
+      st->adj = path; st->mark = path; st->add = path;
+    }
+    st->root = last;
+  }
+  if(st->adj == -1) return;
+
+  /* The two passes of eliminate_bad_genes, each a step behind the last */
+  while(nod[st->adj].tracef != -1) {
+    intergenic_adjust(nod, st->adj, tinf);
+    st->adj = nod[st->adj].tracef;
+  }
+  while(st->mark != st->adj && (final == 1 || nod[st->mark].tracef !=
+        st->adj)) {
+    mark_bad_gene(nod, st->mark);
+    st->mark = nod[st->mark].tracef;
+  }
+  while(st->add != -1 && (final == 1 || st->add != st->mark)) {
+    if(st->ng+2 > st->gcap) {
+      st->gcap *= 2;
+      st->genes = (struct _gene *)realloc(st->genes, st->gcap*
+                                          sizeof(struct _gene));
+      if(st->genes == NULL) {
+        fprintf(stderr, "Realloc failed on genes\n\n");
+        exit(11);
+      }
+    }
+    n = st->ng;
+    st->ng = add_gene_node(st->genes, st->ng, nod, st->add);
+    if(st->ng > n) {
+      st->genes[st->ng].start_ndx = -1;
+      st->genes[st->ng].stop_ndx = -1;
+    }
+    st->add = nod[st->add].tracef;
+  }
+
+  /* Each gene's start is tweaked once the next gene is known */
+  genes = st->genes;
+  n = (final == 1) ? st->ng : st->ng-1;
+  for(i = st->tw; i < n; i++) {
+    tweak_start(genes, st->ng, i, nod, tinf);
+    record_gene_data(&genes[i], 1, nod, tinf);
+    print_gene_lines(st->out, &genes[i], 1, nod, slen, st->format, sctr,
+                     short_hdr, version, st->printed+1);
+    if(st->trans != NULL)
+      write_translations(st->trans, &genes[i], 1, nod, seq, rseq, useq, slen,
+                         tinf, sctr, short_hdr, st->printed+1);
+    if(st->nuc != NULL)
+      write_nucleotide_seqs(st->nuc, &genes[i], 1, nod, seq, rseq, useq,
+                            slen, tinf, sctr, short_hdr, st->printed+1);
+    st->printed++;
+  }
+  if(i > st->tw) st->tw = i;
+
+  /* Keep the last gene printed for the next one's tweak */
+  if(st->tw > 1) {
+    n = st->tw-1;
+    memmove(genes, &genes[n], (st->ng+1-n)*sizeof(struct _gene));
+    st->ng -= n;
+    st->tw = 1;
+  }
+}
+
+/*******************************************************************************
+  Drop the nodes before everything still in use: the live nodes from 'low',
+  the root and the three passes following the path behind it, and the
+  genes not yet printed (with their ORFs, for tweak_start).
+*******************************************************************************/
+void evict_nodes(struct _stream *st, int low) {
+  int i, j, e = low;
+  struct _node *nod = st->nod;
+  struct _gene *genes = st->genes;
+
+  e = imin(e, imin(st->root, imin(st->adj, imin(st->mark, st->add))));
+  for(i = 0; i <= st->ng; i++) {
+    if(genes[i].start_ndx != -1)
+      e = imin(e, orf_floor(nod, genes[i].start_ndx));
+    if(genes[i].stop_ndx != -1) e = imin(e, genes[i].stop_ndx);
+  }
+  e = first_ndx_at(nod, st->nn, nod[e].ndx-STREAM_MARGIN);
+  if(e <= 0) return;
+
+  st->nn -= e;
+  memmove(nod, &nod[e], st->nn*sizeof(struct _node));
+  memmove(st->done, &st->done[e], st->nn*sizeof(unsigned char));
+  for(i = 0; i < st->nn; i++) {
+    nod[i].traceb = (nod[i].traceb < e) ? -1 : nod[i].traceb-e;
+    nod[i].tracef = (nod[i].tracef < e) ? -1 : nod[i].tracef-e;
+    for(j = 0; j < 3; j++)
+      nod[i].star_ptr[j] = (nod[i].star_ptr[j] < e) ? -1 :
+                           nod[i].star_ptr[j]-e;
+  }
+  link_orfs(nod, st->nn);
+  for(i = 0; i <= st->ng; i++) {
+    if(genes[i].start_ndx != -1) genes[i].start_ndx -= e;
+    if(genes[i].stop_ndx != -1) genes[i].stop_ndx -= e;
+  }
+  st->base += e; st->scored -= e; st->filled -= e;
+  st->root -= e; st->adj -= e; st->mark -= e; st->add -= e;
+}
+
+/* First node at or after position 'ndx' */
+int first_ndx_at(struct _node *nod, int nn, int ndx) {
+  int lo = 0, hi = nn, mid;
+
+  while(lo < hi) {
+    mid = (lo+hi)/2;
+    if(nod[mid].ndx < ndx) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
@@ -0,0 +1,85 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sequence.h"
+#include "node.h"
+#include "dprog.h"
+#include "gene.h"
+
+#define MIN_WINDOW 10000
+#define STREAM_MARGIN 1000   /* Bases kept below anything still in use */
+
+/* Gene finding on one sequence a window at a time (see stream.c) */
+struct _stream {
+  int win;             /* Bases of sequence added per round */
+  FILE *out;           /* Gene output */
+  int format;          /* Output format (-f) */
+  FILE *trans;         /* Translations, or NULL */
+  FILE *nuc;           /* Gene nucleotide sequences, or NULL */
+  struct _node *nod;   /* Nodes base to base+nn-1 of the sequence */
+  struct _node *tmp;   /* Scratch copy of nodes being scored */
+  unsigned char *done; /* 1 if the node is scored */
+  int *meet;           /* Scratch for finding where the paths meet */
+  int cap;             /* Nodes there is room for */
+  int nn;
+  int base;            /* Index of nod[0] in the whole sequence's nodes */
+  int pos;             /* Nodes are in for the bases before this */
+  int scored;          /* Nodes before this one are all scored */
+  int filled;          /* Nodes before this one are filled in */
+  int root;            /* Last node of the final path so far, or -1 */
+  double held;         /* Best score of a 3'fwd/5'rev up to the root */
+  int adj;             /* Next node of the path for intergenic_adjust */
+  int mark;            /* Next node of the path for mark_bad_gene */
+  int add;             /* Next node of the path to add to the genes */
+  struct _gene *genes; /* Genes not yet printed, after the last one that
+                          was (kept for tweak_start) */
+  int ng;              /* Complete genes in 'genes' */
+  int tw;              /* Next of them to tweak and print */
+  int gcap;            /* Genes there is room for */
+  int printed;         /* Genes printed for this sequence */
+};
+
+void init_stream(struct _stream *, int, FILE *, int, FILE *, FILE *);
+void free_stream(struct _stream *);
+int stream_genes(struct _stream *, unsigned char *, unsigned char *,
+                 unsigned char *, int, int *, mask *, int, struct _training *,
+                 struct _motif_table *, int, int, char *, char *, char *);
+void grow_stream(struct _stream *, int);
+void add_window(struct _stream *, unsigned char *, unsigned char *, int,
+                mask *, int, struct _training *, int);
+void score_window(struct _stream *, unsigned char *, unsigned char *, int,
+                  int *, struct _training *, struct _motif_table *, int);
+void fill_window(struct _stream *, struct _training *, int);
+int live_nodes(struct _stream *, int);
+int orf_floor(struct _node *, int);
+int path_meet(struct _stream *, int);
+int path_settled(struct _stream *, int);
+void take_path(struct _stream *, int, int, unsigned char *, unsigned char *,
+               unsigned char *, int, struct _training *, int, char *, char *);
+void evict_nodes(struct _stream *, int);
+int first_ndx_at(struct _node *, int, int);
+
+#endif
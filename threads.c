@@ -0,0 +1,160 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#include <pthread.h>
+#include "threads.h"
+
+static int nthreads = 1;
+static int busy = 0;
+static int quitting = 0;
+static int generation = 0;
+static int pending = 0;
+static int job_n = 0;
+static range_func job_fn = NULL;
+static void *job_arg = NULL;
+static int thread_id[MAX_THREADS];
+static pthread_t workers[MAX_THREADS];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t item_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*******************************************************************************
+  Each worker sleeps until a new job is posted, runs its fixed share of the
+  items, and reports back.  Shares are static so that a given item is always
+  handled the same way no matter how the threads are scheduled.
+*******************************************************************************/
+static void *worker_main(void *arg) {
+  int id = *(int *)arg, seen = 0, n;
+  range_func fn;
+  void *fa;
+
+  while(1) {
+    pthread_mutex_lock(&pool_lock);
+    while(generation == seen && quitting == 0)
+      pthread_cond_wait(&job_ready, &pool_lock);
+    if(quitting == 1) {
+      pthread_mutex_unlock(&pool_lock);
+      return NULL;
+    }
+    seen = generation; fn = job_fn; fa = job_arg; n = job_n;
+    pthread_mutex_unlock(&pool_lock);
+
+    fn(fa, (int)((long)n*id/nthreads), (int)((long)n*(id+1)/nthreads));
+
+    pthread_mutex_lock(&pool_lock);
+    pending--;
+    if(pending == 0) pthread_cond_signal(&job_done);
+    pthread_mutex_unlock(&pool_lock);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+  Start a pool of 'n' threads (counting the calling thread, which always
+  takes the first share of each job).  Returns -1 if a worker could not be
+  created, in which case the pool is left at whatever size was reached.
+*******************************************************************************/
+int start_threads(int n) {
+  int i;
+
+  if(n > MAX_THREADS) n = MAX_THREADS;
+  for(i = 1; i < n; i++) {
+    thread_id[i] = i;
+    if(pthread_create(&workers[i], NULL, worker_main, &thread_id[i]) != 0) {
+      stop_threads();
+      return -1;
+    }
+    nthreads = i+1;
+  }
+  return 0;
+}
+
+/* Shut down the pool and wait for the workers to exit. */
+void stop_threads() {
+  int i;
+
+  if(nthreads == 1) return;
+  pthread_mutex_lock(&pool_lock);
+  quitting = 1;
+  pthread_cond_broadcast(&job_ready);
+  pthread_mutex_unlock(&pool_lock);
+  for(i = 1; i < nthreads; i++) pthread_join(workers[i], NULL);
+  nthreads = 1;
+  quitting = 0;
+}
+
+int num_threads() {
+  return nthreads;
+}
+
+/*******************************************************************************
+  Run fn over items [0, n) split into one contiguous chunk per thread, and
+  return once every chunk is finished.  Jobs of fewer than 'min_items', and
+  jobs posted while the pool is already busy (i.e. from inside another job),
+  run serially in the calling thread.
+*******************************************************************************/
+static void run_job(int n, int min_items, range_func fn, void *arg) {
+  pthread_mutex_lock(&pool_lock);
+  if(nthreads == 1 || n < min_items || busy == 1) {
+    pthread_mutex_unlock(&pool_lock);
+    fn(arg, 0, n);
+    return;
+  }
+  busy = 1;
+  job_fn = fn; job_arg = arg; job_n = n;
+  pending = nthreads-1;
+  generation++;
+  pthread_cond_broadcast(&job_ready);
+  pthread_mutex_unlock(&pool_lock);
+
+  fn(arg, 0, (int)((long)n/nthreads));
+
+  pthread_mutex_lock(&pool_lock);
+  while(pending > 0) pthread_cond_wait(&job_done, &pool_lock);
+  busy = 0;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/* Many small items, e.g. one per node:  not worth waking the pool for few */
+void parallel_for(int n, range_func fn, void *arg) {
+  run_job(n, MIN_PAR_ITEMS, fn, arg);
+}
+
+/* A handful of large, independent items, e.g. one per sequence segment */
+void parallel_tasks(int n, range_func fn, void *arg) {
+  run_job(n, 2, fn, arg);
+}
+
+/*******************************************************************************
+  For items too uneven in size for fixed shares:  each thread of a job
+  calls this to take the next of the 'n' items counted by '*next', until
+  it returns -1.  Which thread handles an item then varies from run to
+  run, so the results must not depend on it.
+*******************************************************************************/
+int take_item(int *next, int n) {
+  int i = -1;
+
+  pthread_mutex_lock(&item_lock);
+  if(*next < n) i = (*next)++;
+  pthread_mutex_unlock(&item_lock);
+  return i;
+}
@@ -0,0 +1,41 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef _THREADS_H
+#define _THREADS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 64
+#define MIN_PAR_ITEMS 1024
+
+/* Work function for parallel_for: handles items [lo, hi) */
+typedef void (*range_func)(void *, int, int);
+
+int start_threads(int);
+void stop_threads();
+int num_threads();
+void parallel_for(int, range_func, void *);
+void parallel_tasks(int, range_func, void *);
+int take_item(int *, int);
+
+#endif
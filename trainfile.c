@@ -0,0 +1,251 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trainfile.h"
+
+/*******************************************************************************
+  Binary training files.  A file is a fixed header (magic, version, byte
+  order, value count and storage flags, and a checksum) followed by every
+  value of the training structure in a fixed order, as doubles or, to halve
+  the size, floats.  Files are written to a temporary file of their own
+  (mkstemp) in the same directory and renamed, so runs writing the same
+  file at once (as with a shared cache, -k) never touch each other's
+  data.  They are read by mapping them read-only, so any number of runs
+  can load the same file at once while it is replaced.  Anything that
+  doesn't check out (wrong version or byte order, short file, bad
+  checksum) is rejected before any of it is used.  Files without the
+  magic are left to the original reader, read_training_file.
+*******************************************************************************/
+
+int write_training_binary(char *fn, struct _training *tinf, int use_float) {
+  struct _train_head head;
+  double *val;
+  float *fval = NULL;
+  unsigned char *data;
+  size_t size;
+  char *tmp;
+  FILE *fh;
+  int i, fd, rv = 0;
+  mode_t mask;
+
+  val = (double *)malloc(TRAIN_VALUES*sizeof(double));
+  tmp = (char *)malloc(strlen(fn)+8);
+  if(val == NULL || tmp == NULL) {
+    fprintf(stderr, "Malloc failed on training values\n\n");
+    exit(11);
+  }
+  pack_training(tinf, val);
+  data = (unsigned char *)val;
+  size = TRAIN_VALUES*sizeof(double);
+  if(use_float == 1) {
+    fval = (float *)malloc(TRAIN_VALUES*sizeof(float));
+    if(fval == NULL) {
+      fprintf(stderr, "Malloc failed on training values\n\n");
+      exit(11);
+    }
+    for(i = 0; i < TRAIN_VALUES; i++) fval[i] = (float)val[i];
+    data = (unsigned char *)fval;
+    size = TRAIN_VALUES*sizeof(float);
+  }
+
+  memset(&head, 0, sizeof(struct _train_head));
+  strcpy(head.magic, TRAIN_MAGIC);
+  head.version = TRAIN_VERSION;
+  head.endian = TRAIN_ENDIAN;
+  head.flags = (use_float == 1 ? TRAIN_FLOAT : 0);
+  head.nval = TRAIN_VALUES;
+  head.checksum = fnv_hash(FNV_BASIS, data, size);
+
+  /* mkstemp makes the file private; give it the usual permissions */
+  sprintf(tmp, "%s.XXXXXX", fn);
+  fd = mkstemp(tmp);
+  if(fd == -1) rv = -1;
+  else {
+    mask = umask(0);
+    umask(mask);
+    if(fchmod(fd, 0666 & ~mask) != 0 || (fh = fdopen(fd, "wb")) == NULL) {
+      close(fd);
+      rv = -1;
+    }
+    else {
+      if(fwrite(&head, sizeof(struct _train_head), 1, fh) != 1 ||
+         fwrite(data, 1, size, fh) != size) rv = -1;
+      if(fclose(fh) != 0) rv = -1;
+    }
+    if(rv == 0 && rename(tmp, fn) != 0) rv = -1;
+    if(rv != 0) remove(tmp);
+  }
+  free(val);
+  free(tmp);
+  if(fval != NULL) free(fval);
+  return rv;
+}
+
+/*******************************************************************************
+  Load a binary training file.  Returns 0 on success, 1 if the file can't
+  be opened (as read_training_file does), 2 if it is not a binary training
+  file, -1 if it has the wrong version, byte order or layout, -2 if it is
+  truncated, and -3 if its checksum doesn't match.
+*******************************************************************************/
+int map_training_file(char *fn, struct _training *tinf) {
+  struct _train_head *head;
+  struct stat fbuf;
+  unsigned char *map;
+  double *val;
+  float *fval;
+  size_t width = sizeof(double);
+  int fd, i, rv = 0;
+
+  fd = open(fn, O_RDONLY);
+  if(fd == -1) return 1;
+  if(fstat(fd, &fbuf) == -1) { close(fd); return -1; }
+  if(fbuf.st_size < (off_t)sizeof(head->magic)) { close(fd); return 2; }
+  map = (unsigned char *)mmap(NULL, fbuf.st_size, PROT_READ, MAP_SHARED, fd,
+                              0);
+  close(fd);
+  if(map == MAP_FAILED) return -1;
+  head = (struct _train_head *)map;
+
+  if(memcmp(head->magic, TRAIN_MAGIC, sizeof(head->magic)) != 0) rv = 2;
+  else if(fbuf.st_size < (off_t)sizeof(struct _train_head)) rv = -2;
+  else if(head->endian != TRAIN_ENDIAN || head->version != TRAIN_VERSION ||
+          head->nval != TRAIN_VALUES || (head->flags & ~TRAIN_FLOAT) != 0)
+    rv = -1;
+  else {
+    width = ((head->flags & TRAIN_FLOAT) != 0 ? sizeof(float) :
+             sizeof(double));
+    if(fbuf.st_size != (off_t)(sizeof(struct _train_head) +
+       TRAIN_VALUES*width)) rv = -2;
+    else if(fnv_hash(FNV_BASIS, map + sizeof(struct _train_head),
+                     TRAIN_VALUES*width) != head->checksum) rv = -3;
+  }
+  if(rv != 0) { munmap(map, fbuf.st_size); return rv; }
+
+  if(width == sizeof(double))
+    unpack_training((double *)(map + sizeof(struct _train_head)), tinf);
+  else {
+    val = (double *)malloc(TRAIN_VALUES*sizeof(double));
+    if(val == NULL) {
+      fprintf(stderr, "Malloc failed on training values\n\n");
+      exit(11);
+    }
+    fval = (float *)(map + sizeof(struct _train_head));
+    for(i = 0; i < TRAIN_VALUES; i++) val[i] = fval[i];
+    unpack_training(val, tinf);
+    free(val);
+  }
+  munmap(map, fbuf.st_size);
+  return 0;
+}
+
+/* Lay out the training values in file order */
+void pack_training(struct _training *tinf, double *val) {
+  int n = 0;
+
+  val[n++] = tinf->gc;
+  val[n++] = tinf->trans_table;
+  val[n++] = tinf->st_wt;
+  memcpy(&val[n], tinf->bias, 3*sizeof(double)); n += 3;
+  memcpy(&val[n], tinf->type_wt, 3*sizeof(double)); n += 3;
+  val[n++] = tinf->uses_sd;
+  memcpy(&val[n], tinf->rbs_wt, 28*sizeof(double)); n += 28;
+  memcpy(&val[n], tinf->ups_comp, 32*4*sizeof(double)); n += 32*4;
+  memcpy(&val[n], tinf->mot_wt, 4*4*4096*sizeof(double)); n += 4*4*4096;
+  val[n++] = tinf->no_mot;
+  memcpy(&val[n], tinf->gene_dc, 4096*sizeof(double));
+}
+
+/* Fill in a training structure from values in file order */
+void unpack_training(double *val, struct _training *tinf) {
+  int n = 0;
+
+  memset(tinf, 0, sizeof(struct _training));
+  tinf->gc = val[n++];
+  tinf->trans_table = (int)val[n++];
+  tinf->st_wt = val[n++];
+  memcpy(tinf->bias, &val[n], 3*sizeof(double)); n += 3;
+  memcpy(tinf->type_wt, &val[n], 3*sizeof(double)); n += 3;
+  tinf->uses_sd = (int)val[n++];
+  memcpy(tinf->rbs_wt, &val[n], 28*sizeof(double)); n += 28;
+  memcpy(tinf->ups_comp, &val[n], 32*4*sizeof(double)); n += 32*4;
+  memcpy(tinf->mot_wt, &val[n], 4*4*4096*sizeof(double)); n += 4*4*4096;
+  tinf->no_mot = val[n++];
+  memcpy(tinf->gene_dc, &val[n], 4096*sizeof(double));
+}
+
+/* 32-bit FNV-1a hash of 'len' bytes, continuing from 'h' */
+unsigned int fnv_hash(unsigned int h, unsigned char *data, size_t len) {
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= 16777619U;
+  }
+  return h;
+}
+
+/*******************************************************************************
+  Name of the file in 'dir' caching the model trained on a packed sequence
+  (from read_seq_training) with the options that change what training
+  produces.  The name is a 64-bit hash of all of these, so a later run
+  training the same sequence the same way finds the same file.  Bumping
+  CACHE_KEY_VERSION whenever the options hashed change keeps files cached
+  under an older key from being picked up.
+*******************************************************************************/
+char *training_cache_file(char *dir, unsigned char *seq, unsigned char *useq,
+                          int slen, struct _training *tinf, int closed,
+                          int do_mask, int force_nonsd, int strict,
+                          int exact) {
+  double opt[10];
+  unsigned long long h = FNV64_BASIS;
+  char *fn;
+
+  opt[0] = TRAIN_VERSION; opt[1] = slen; opt[2] = tinf->trans_table;
+  opt[3] = tinf->st_wt; opt[4] = closed; opt[5] = do_mask;
+  opt[6] = force_nonsd; opt[7] = strict; opt[8] = exact;
+  opt[9] = CACHE_KEY_VERSION;
+  h = fnv_hash64(h, (unsigned char *)opt, sizeof(opt));
+  h = fnv_hash64(h, seq, slen/4+1);
+  h = fnv_hash64(h, useq, slen/8+1);
+
+  fn = (char *)malloc(strlen(dir)+22);
+  if(fn == NULL) {
+    fprintf(stderr, "Malloc failed on training cache file name\n\n");
+    exit(11);
+  }
+  sprintf(fn, "%s/%016llx.trn", dir, h);
+  return fn;
+}
+
+/* 64-bit FNV-1a hash of 'len' bytes, continuing from 'h' */
+unsigned long long fnv_hash64(unsigned long long h, unsigned char *data,
+                              size_t len) {
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#ifndef _TRAINFILE_H
+#define _TRAINFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "training.h"
+
+#define TRAIN_MAGIC "PRODTRN"
+#define TRAIN_VERSION 1
+#define TRAIN_ENDIAN 0x01020304
+#define TRAIN_FLOAT 1         /* Values are stored as floats */
+#define TRAIN_VALUES 69799    /* Values in a struct _training */
+#define FNV_BASIS 2166136261U
+#define FNV64_BASIS 14695981039346656037ULL
+#define CACHE_KEY_VERSION 2   /* Layout of the training cache key */
+
+/* Header of a binary training file, followed by its TRAIN_VALUES values */
+struct _train_head {
+  char magic[8];              /* TRAIN_MAGIC */
+  unsigned int version;       /* TRAIN_VERSION */
+  unsigned int endian;        /* TRAIN_ENDIAN, as written */
+  unsigned int flags;         /* TRAIN_FLOAT or 0 */
+  unsigned int nval;          /* TRAIN_VALUES */
+  unsigned int checksum;      /* FNV-1a hash of the stored values */
+  unsigned int unused;
+};
+
+int write_training_binary(char *, struct _training *, int);
+int map_training_file(char *, struct _training *);
+void pack_training(struct _training *, double *);
+void unpack_training(double *, struct _training *);
+unsigned int fnv_hash(unsigned int, unsigned char *, size_t);
+char *training_cache_file(char *, unsigned char *, unsigned char *, int,
+                          struct _training *, int, int, int, int, int);
+unsigned long long fnv_hash64(unsigned long long, unsigned char *, size_t);
+
+#endif
@@ -0,0 +1,333 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#include "update.h"
+
+/*******************************************************************************
+  Incremental re-annotation.  With -u, each sequence's scored nodes, their
+  features (see calc_node_feats) and the filled in dynamic programming are
+  saved to a state file.  When the next run finds the same sequence again,
+  only slightly edited, the unchanged stretches at its start and end are
+  found by comparing it with the saved copy.  Starts whose ORF and upstream
+  region lie wholly inside one of those stretches take their features and
+  raw coding sums from the state instead of the sequence; the rest are
+  gathered afresh.  The dynamic programming is then redone only from the
+  first node whose inputs differ.  Every decision still runs through
+  score_nodes and dprog, so the result is the same as a full run.
+
+  Nothing is reused unless the earlier run had the same training data and
+  options, so in practice this wants a fixed training file (-t).
+*******************************************************************************/
+
+int open_update_state(struct _update *upd, char *file, struct _training
+                      *tinf, int closed, int exact) {
+  struct _state_head *head;
+  int rv = 0;
+
+  memset(upd, 0, sizeof(struct _update));
+  upd->file = file;
+  if(strlen(file) > MAX_LINE-5) return -1;
+  sprintf(upd->tmp, "%s.tmp", file);
+  head = (struct _state_head *)malloc(sizeof(struct _state_head));
+  if(head == NULL) {
+    fprintf(stderr, "Malloc failed on update state\n\n");
+    exit(11);
+  }
+
+  upd->in = fopen(file, "rb");
+  if(upd->in != NULL && (fread(head, sizeof(struct _state_head), 1, upd->in)
+     != 1 || head->version != STATE_VERSION || head->node_size !=
+     sizeof(struct _node) || head->closed != closed || head->exact != exact ||
+     memcmp(&head->tinf, tinf, sizeof(struct _training)) != 0)) {
+    fclose(upd->in);
+    upd->in = NULL;
+  }
+
+  memset(head, 0, sizeof(struct _state_head));
+  head->version = STATE_VERSION;
+  head->node_size = sizeof(struct _node);
+  head->closed = closed;
+  head->exact = exact;
+  memcpy(&head->tinf, tinf, sizeof(struct _training));
+  upd->out = fopen(upd->tmp, "wb");
+  if(upd->out == NULL ||
+     fwrite(head, sizeof(struct _state_head), 1, upd->out) != 1) rv = -1;
+  free(head);
+  return rv;
+}
+
+/* Finish the new state and move it over the old one. */
+int close_update_state(struct _update *upd) {
+  if(upd->in != NULL) fclose(upd->in);
+  free_prev_seq(&upd->prev);
+  free_node_feats(&upd->feat);
+  if(fclose(upd->out) != 0) return -1;
+  if(rename(upd->tmp, upd->file) != 0) return -1;
+  return 0;
+}
+
+void free_prev_seq(struct _prev_seq *prev) {
+  if(prev->seq != NULL) free(prev->seq);
+  if(prev->useq != NULL) free(prev->useq);
+  if(prev->nod != NULL) free(prev->nod);
+  free_node_feats(&prev->feat);
+  memset(prev, 0, sizeof(struct _prev_seq));
+}
+
+/*******************************************************************************
+  Read the next sequence of the earlier state into upd->prev.  Returns -1,
+  and stops reading, at the end of the state or if it is damaged.
+*******************************************************************************/
+int read_prev_seq(struct _update *upd) {
+  struct _prev_seq *prev = &upd->prev;
+  struct _node_feats *feat = &prev->feat;
+  FILE *fp = upd->in;
+  int len, nn;
+  size_t sz;
+
+  if(fp == NULL) return -1;
+  free_prev_seq(prev);
+  if(fread(&len, sizeof(int), 1, fp) != 1 || len < 0 || len >= MAX_LINE ||
+     fread(prev->header, 1, len, fp) != (size_t)len ||
+     fread(&prev->slen, sizeof(int), 1, fp) != 1 ||
+     fread(&prev->nn, sizeof(int), 1, fp) != 1 || prev->slen < 0 ||
+     prev->nn < 0) {
+    fclose(fp);
+    upd->in = NULL;
+    return -1;
+  }
+  prev->header[len] = '\0';
+  nn = prev->nn;
+
+  prev->seq = (unsigned char *)malloc(prev->slen/4+1);
+  prev->useq = (unsigned char *)malloc(prev->slen/8+1);
+  prev->nod = (struct _node *)malloc((nn+1)*sizeof(struct _node));
+  alloc_node_feats(feat, nn+1);
+  feat->raw = (double *)malloc((nn+1)*sizeof(double));
+  if(prev->seq == NULL || prev->useq == NULL || prev->nod == NULL ||
+     feat->raw == NULL) {
+    fprintf(stderr, "Malloc failed on update state\n\n");
+    exit(11);
+  }
+  feat->raw_cap = nn+1;
+
+  sz = nn;
+  if(fread(prev->seq, 1, prev->slen/4+1, fp) != (size_t)(prev->slen/4+1) ||
+     fread(prev->useq, 1, prev->slen/8+1, fp) != (size_t)(prev->slen/8+1) ||
+     fread(prev->nod, sizeof(struct _node), sz, fp) != sz ||
+     fread(feat->open, 1, sz, fp) != sz ||
+     fread(feat->sd, sizeof(unsigned int), sz*SD_POS*2, fp) != sz*SD_POS*2 ||
+     fread(feat->ups, sizeof(unsigned short), sz*UPS_MERS, fp) !=
+     sz*UPS_MERS ||
+     fread(feat->ucomp, 1, sz*UPS_BASES, fp) != sz*UPS_BASES ||
+     fread(feat->raw, sizeof(double), sz, fp) != sz) {
+    free_prev_seq(prev);
+    fclose(fp);
+    upd->in = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+/* Save the current sequence and its nodes to the new state. */
+void write_seq_state(struct _update *upd, struct _node *nod, int nn) {
+  struct _node_feats *feat = &upd->feat;
+  FILE *fp = upd->out;
+  int len = strlen(upd->header);
+  size_t sz = nn;
+
+  if(fwrite(&len, sizeof(int), 1, fp) != 1 ||
+     fwrite(upd->header, 1, len, fp) != (size_t)len ||
+     fwrite(&upd->slen, sizeof(int), 1, fp) != 1 ||
+     fwrite(&nn, sizeof(int), 1, fp) != 1 ||
+     fwrite(upd->seq, 1, upd->slen/4+1, fp) != (size_t)(upd->slen/4+1) ||
+     fwrite(upd->useq, 1, upd->slen/8+1, fp) != (size_t)(upd->slen/8+1) ||
+     fwrite(nod, sizeof(struct _node), sz, fp) != sz ||
+     fwrite(feat->open, 1, sz, fp) != sz ||
+     fwrite(feat->sd, sizeof(unsigned int), sz*SD_POS*2, fp) != sz*SD_POS*2 ||
+     fwrite(feat->ups, sizeof(unsigned short), sz*UPS_MERS, fp) !=
+     sz*UPS_MERS ||
+     fwrite(feat->ucomp, 1, sz*UPS_BASES, fp) != sz*UPS_BASES ||
+     fwrite(feat->raw, sizeof(double), sz, fp) != sz) {
+    fprintf(stderr, "\nError: could not write update state file %s.\n\n",
+            upd->tmp);
+    exit(21);
+  }
+}
+
+/*******************************************************************************
+  Score the nodes of a sequence as score_nodes would, taking the features
+  of starts outside the edited part from the earlier run of the sequence
+  (if it is next in the state).  Each ORF with a start that could not be
+  reused is walked again for its coding sums.
+*******************************************************************************/
+void update_scores(unsigned char *seq, unsigned char *rseq, unsigned char
+                   *useq, int slen, int *gc_sum, char *header, struct _node
+                   *nod, int nn, struct _training *tinf, struct _motif_table
+                   *mt, int closed, struct _update *upd) {
+  struct _prev_seq *prev = &upd->prev;
+  struct _node_feats *feat = &upd->feat, *pf = &prev->feat;
+  struct _score_job job;
+  unsigned char *redo;
+  int i, j, n;
+
+  upd->seq = seq; upd->useq = useq; upd->slen = slen; upd->header = header;
+  upd->have_prev = (read_prev_seq(upd) == 0 &&
+                    strcmp(prev->header, header) == 0);
+  upd->same[0] = 0; upd->same[1] = 0;
+  if(upd->have_prev == 1) {
+    n = imin(slen, prev->slen);
+    for(i = 0; i < n && same_base(seq, useq, i, prev->seq, prev->useq, i)
+        == 1; i++);
+    upd->same[0] = i;
+    for(i = 0; i < n-upd->same[0] && same_base(seq, useq, slen-1-i,
+        prev->seq, prev->useq, prev->slen-1-i) == 1; i++);
+    upd->same[1] = i;
+  }
+
+  alloc_node_feats(feat, nn);
+  if(nn > feat->raw_cap) {
+    if(feat->raw != NULL) free(feat->raw);
+    feat->raw = (double *)malloc(nn*sizeof(double));
+    feat->raw_cap = nn;
+  }
+  redo = (unsigned char *)calloc(nn+1, sizeof(unsigned char));
+  if(feat->raw == NULL || redo == NULL) {
+    fprintf(stderr, "Malloc failed on node features\n\n");
+    exit(11);
+  }
+
+  job.seq = seq; job.rseq = rseq; job.slen = slen;
+  job.nod = nod; job.nn = nn; job.tinf = tinf; job.mt = mt; job.feat = feat;
+  job.ups = NULL; job.closed = closed; job.is_meta = 0;
+
+  calc_orf_gc(gc_sum, nod, nn);
+  for(i = 0; i < nn; i++) {
+    if(nod[i].type == STOP) continue;
+    j = (upd->have_prev == 1) ? prev_node(upd, &nod[i], slen) : -1;
+    if(j != -1) {
+      feat->open[i] = pf->open[j];
+      memcpy(&feat->sd[i*SD_POS*2], &pf->sd[j*SD_POS*2],
+             SD_POS*2*sizeof(unsigned int));
+      memcpy(&feat->ups[i*UPS_MERS], &pf->ups[j*UPS_MERS],
+             UPS_MERS*sizeof(unsigned short));
+      memcpy(&feat->ucomp[i*UPS_BASES], &pf->ucomp[j*UPS_BASES],
+             UPS_BASES*sizeof(unsigned char));
+      nod[i].cscore = pf->raw[j];
+      continue;
+    }
+    node_feat_range(&job, i, i+1);
+    calc_upstream_mers(seq, rseq, slen, &nod[i], 1, &feat->ups[i*UPS_MERS]);
+    if(nod[i].stop_ptr != -1) redo[nod[i].stop_ptr] = 1;
+  }
+  coding_sums(seq, rseq, slen, nod, nn, tinf, redo);
+  free(redo);
+
+  for(i = 0; i < nn; i++) if(nod[i].type != STOP) feat->raw[i] = nod[i].cscore;
+  feat->nbins = 1;
+  feat->bin = 0;
+  score_nodes(seq, rseq, slen, gc_sum, feat, nod, nn, tinf, mt, closed, 0);
+}
+
+/*******************************************************************************
+  Final dynamic programming for a sequence scored by update_scores.  A node's
+  fill depends on the nodes before it and on the starts within MAX_SAM_OVLP
+  after it, so the earlier run's scores and tracebacks are kept up to
+  MAX_OPP_OVLP bases before the first node whose inputs have changed.  The
+  new state is saved before the traceback untangles the path.
+*******************************************************************************/
+int update_dprog(struct _node *nod, int nn, struct _training *tinf, int exact,
+                 mask *mlist, int nm, struct _update *upd) {
+  struct _prev_seq *prev = &upd->prev;
+  int i, k, first = 0;
+
+  if(upd->have_prev == 1 && exact == 0) {
+    for(k = 0; k < nn && k < prev->nn && same_dp_input(&nod[k], &prev->nod[k])
+        == 1; k++);
+    first = k;
+    if(k < nn)
+      while(first > 0 && nod[first-1].ndx + MAX_OPP_OVLP >= nod[k].ndx)
+        first--;
+    for(i = 0; i < first; i++) {
+      nod[i].score = prev->nod[i].score;
+      nod[i].traceb = prev->nod[i].traceb;
+      nod[i].ov_mark = prev->nod[i].ov_mark;
+    }
+  }
+  dprog_fill(nod, nn, tinf, 1, exact, mlist, nm, first);
+  write_seq_state(upd, nod, nn);
+  return dprog_trace(nod, nn);
+}
+
+/*******************************************************************************
+  The earlier run's copy of start 'nod' if everything its features and raw
+  coding sum are read from (the ORF and UPS_REACH bases upstream) lies in
+  the unchanged start or end of the sequence, or -1 if not.
+*******************************************************************************/
+int prev_node(struct _update *upd, struct _node *nod, int slen) {
+  struct _prev_seq *prev = &upd->prev;
+  int lo, hi, shift, j;
+
+  if(nod->strand == 1) { lo = nod->ndx-UPS_REACH; hi = nod->stop_val+3; }
+  else { lo = nod->stop_val-2; hi = nod->ndx+UPS_REACH+1; }
+  if(hi <= upd->same[0]) shift = 0;
+  else if(lo >= slen-upd->same[1]) shift = slen-prev->slen;
+  else return -1;
+
+  j = find_node(prev->nod, prev->nn, nod->ndx-shift, nod->strand, nod->type);
+  if(j == -1 || prev->nod[j].stop_val != nod->stop_val-shift ||
+     prev->nod[j].edge != nod->edge) return -1;
+  return j;
+}
+
+/* Index of the node at 'ndx' with the given strand and type, or -1 */
+int find_node(struct _node *nod, int nn, int ndx, int strand, int type) {
+  int lo = 0, hi = nn, mid;
+
+  while(lo < hi) {
+    mid = (lo+hi)/2;
+    if(nod[mid].ndx < ndx) lo = mid+1;
+    else hi = mid;
+  }
+  for(; lo < nn && nod[lo].ndx == ndx; lo++)
+    if(nod[lo].strand == strand && nod[lo].type == type) return lo;
+  return -1;
+}
+
+/* 1 if base i of one sequence and base j of another are the same */
+int same_base(unsigned char *seq1, unsigned char *useq1, int i, unsigned char
+              *seq2, unsigned char *useq2, int j) {
+  if(test(seq1, 2*i) != test(seq2, 2*j)) return 0;
+  if(test(seq1, 2*i+1) != test(seq2, 2*j+1)) return 0;
+  if(test(useq1, i) != test(useq2, j)) return 0;
+  return 1;
+}
+
+/* 1 if everything the final dynamic programming reads from two nodes agrees */
+int same_dp_input(struct _node *n1, struct _node *n2) {
+  int i;
+
+  if(n1->type != n2->type || n1->edge != n2->edge || n1->ndx != n2->ndx ||
+     n1->strand != n2->strand || n1->stop_val != n2->stop_val ||
+     n1->cscore != n2->cscore || n1->sscore != n2->sscore) return 0;
+  for(i = 0; i < 3; i++)
+    if(n1->star_ptr[i] != n2->star_ptr[i]) return 0;
+  return 1;
+}
@@ -0,0 +1,88 @@
+/*******************************************************************************
+    PRODIGAL (PROkaryotic DynamIc Programming Genefinding ALgorithm)
+    Copyright (C) 2007-2016 University of Tennessee / UT-Battelle
+
+    Code Author:  Doug Hyatt
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+#ifndef _UPDATE_H
+#define _UPDATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "sequence.h"
+#include "node.h"
+#include "dprog.h"
+
+#define STATE_VERSION 1
+#define UPS_REACH 45      /* Bases before a start its features depend on */
+
+/* Settings an earlier run must share for its state to be reused */
+struct _state_head {
+  int version;         /* STATE_VERSION */
+  int node_size;       /* sizeof(struct _node) */
+  int closed;          /* -c */
+  int exact;           /* -e */
+  struct _training tinf;
+};
+
+/* One sequence as it was left by an earlier run */
+struct _prev_seq {
+  char header[MAX_LINE];
+  int slen;
+  int nn;
+  unsigned char *seq;  /* Forward strand */
+  unsigned char *useq; /* Unknown bases */
+  struct _node *nod;   /* Scored nodes, holding the filled in scores and
+                          tracebacks of the dynamic programming */
+  struct _node_feats feat; /* Their features and raw coding sums */
+};
+
+struct _update {
+  char *file;          /* State file */
+  char tmp[MAX_LINE];  /* The new state is written here, then renamed */
+  FILE *in;            /* Earlier state, or NULL if none can be used */
+  FILE *out;
+  struct _prev_seq prev;
+  int have_prev;       /* 1 if 'prev' is this sequence's earlier run */
+  int same[2];         /* Lengths of the unchanged start and end */
+  struct _node_feats feat; /* Features of the current nodes */
+  unsigned char *seq;  /* Current sequence, saved with its nodes */
+  unsigned char *useq;
+  int slen;
+  char *header;
+};
+
+int open_update_state(struct _update *, char *, struct _training *, int,
+                      int);
+int close_update_state(struct _update *);
+void free_prev_seq(struct _prev_seq *);
+int read_prev_seq(struct _update *);
+void write_seq_state(struct _update *, struct _node *, int);
+void update_scores(unsigned char *, unsigned char *, unsigned char *, int,
+                   int *, char *, struct _node *, int, struct _training *,
+                   struct _motif_table *, int, struct _update *);
+int update_dprog(struct _node *, int, struct _training *, int, mask *, int,
+                 struct _update *);
+int prev_node(struct _update *, struct _node *, int);
+int find_node(struct _node *, int, int, int, int);
+int same_base(unsigned char *, unsigned char *, int, unsigned char *,
+              unsigned char *, int);
+int same_dp_input(struct _node *, struct _node *);
+
+#endif